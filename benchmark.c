@@ -0,0 +1,332 @@
+#include <time.h>
+#include "hashtable.h"
+
+/***
+* Single-threaded benchmark suite
+*   Runs each workload against every combination of storage, built-in hash
+*   function, max_load and starting size, over each key set:
+*     uniform:     n random integers, each used equally often
+*     zipf:        the same keys, but operations pick them with a Zipf(0.99)
+*                  distribution, so a few hot keys take most of the operations
+*     adversarial: n multiples of 2^20, whose low 20 bits are all zero -- only a
+*                  hash and bin mapping that mix in the high bits spread them out
+*     strings:     n random 16-byte strings
+*   Workloads: insert (into an empty table), lookup-hit, lookup-miss and delete.
+*
+*   Each workload runs twice: once timed as a whole for ns/op, then again
+*   timing every operation, for the p50/p99/p99.9 latencies. The typical cost
+*   of reading the clock is subtracted from each of those.
+*   Tables are sized in powers of two, so they map hashes to bins with a multiply-shift.
+*
+*   Usage: benchmark [keys] [csv|json]
+***/
+
+typedef enum {UNIFORM, ZIPF, ADVERSARIAL, STRINGS} key_set;
+static const char *key_set_names[] = {"uniform", "zipf", "adversarial", "strings"};
+static const char *storage_names[] = {"chained", "open", "swiss"};
+static const char *hash_names[] = {"wyhash", "fnv1a", "identity"};
+static const double max_loads[] = {0.5, 0.75, 0.9};
+
+typedef struct benchmark_keys {
+    long int count;
+    hash_type type;
+    union Hashable *keys;    // the distinct keys
+    union Hashable *misses;  // as many keys that are not in keys
+    long int *order;         // which key each operation uses
+} BenchmarkKeys;
+
+typedef struct benchmark_result {
+    long int ops;
+    double ns_per_op;
+    long int p50, p99, p999;
+} BenchmarkResult;
+
+static unsigned long int next_random(unsigned long int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static long int now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/***
+* The median time between two back-to-back clock reads
+***/
+static long int clock_overhead(void) {
+    long int samples[1001];
+    int i;
+    for (i = 0; i < 1001; i++) {
+        long int start = now_ns();
+        samples[i] = now_ns() - start;
+    }
+    int j;
+    for (i = 1; i < 1001; i++) { // insertion sort -- it's only run once
+        long int sample = samples[i];
+        for (j = i; (j > 0) && (samples[j - 1] > sample); j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = sample;
+    }
+    return samples[500];
+}
+
+static union Hashable random_string(unsigned long int *rng) {
+    union Hashable key;
+    key.len = 16;
+    key.str = malloc(key.len + 1);
+    size_t i;
+    for (i = 0; i < key.len; i++) {
+        key.str[i] = 'a' + (char)(next_random(rng) % 26);
+    }
+    key.str[key.len] = '\0';
+    return key;
+}
+
+/***
+* Operation order for Zipf: rank r (0-based) is picked with probability proportional to 1 / (r + 1)^0.99,
+*   by binary search over the cumulative weights.
+***/
+static void zipf_order(long int count, long int *order, unsigned long int *rng) {
+    double *cumulative = malloc(count*sizeof(double));
+    double total = 0;
+    long int i;
+    for (i = 0; i < count; i++) {
+        total += 1.0 / pow((double)(i + 1), 0.99);
+        cumulative[i] = total;
+    }
+    for (i = 0; i < count; i++) {
+        double target = (double)(next_random(rng) >> 11) / (double)(1UL << 53) * total;
+        long int low = 0, high = count - 1;
+        while (low < high) {
+            long int middle = (low + high) / 2;
+            if (cumulative[middle] < target) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        order[i] = low;
+    }
+    free(cumulative);
+}
+
+static BenchmarkKeys *make_keys(key_set set, long int count) {
+    BenchmarkKeys *keys = malloc(sizeof(BenchmarkKeys));
+    keys->count = count;
+    keys->type = (set == STRINGS) ? STRING : INTEGER;
+    keys->keys = malloc(count*sizeof(union Hashable));
+    keys->misses = malloc(count*sizeof(union Hashable));
+    keys->order = malloc(count*sizeof(long int));
+    unsigned long int rng = 0x9e3779b97f4a7c15UL;
+
+    long int i;
+    for (i = 0; i < count; i++) {
+        switch (set) {
+            case ADVERSARIAL:
+                keys->keys[i].i = i << 20;
+                keys->misses[i].i = (i + count) << 20;
+                break;
+            case STRINGS:
+                keys->keys[i] = random_string(&rng);
+                keys->misses[i] = random_string(&rng);
+                keys->misses[i].str[0] = 'A'; // never matches a key, which is all lower case
+                break;
+            default:
+                // even keys hit, odd keys miss
+                keys->keys[i].i = (long int)(next_random(&rng) & ~1UL);
+                keys->misses[i].i = keys->keys[i].i | 1;
+                break;
+        }
+    }
+
+    if (set == ZIPF) {
+        zipf_order(count, keys->order, &rng);
+    }
+    else {
+        // a random permutation, so every key is used once
+        for (i = 0; i < count; i++) {
+            keys->order[i] = i;
+        }
+        for (i = count - 1; i > 0; i--) {
+            long int j = (long int)(next_random(&rng) % (unsigned long int)(i + 1));
+            long int swap = keys->order[i];
+            keys->order[i] = keys->order[j];
+            keys->order[j] = swap;
+        }
+    }
+    return keys;
+}
+
+static void free_keys(BenchmarkKeys *keys) {
+    if (keys->type == STRING) {
+        long int i;
+        for (i = 0; i < keys->count; i++) {
+            free(keys->keys[i].str);
+            free(keys->misses[i].str);
+        }
+    }
+    free(keys->keys);
+    free(keys->misses);
+    free(keys->order);
+    free(keys);
+}
+
+static union Hashable copy_key(union Hashable key, hash_type type) {
+    if (type == STRING) {
+        union Hashable copy;
+        copy.len = key.len;
+        copy.str = malloc(key.len + 1);
+        memcpy(copy.str, key.str, key.len + 1);
+        return copy;
+    }
+    return key;
+}
+
+static HashTable *filled_table(BenchmarkKeys *keys, long int size, double max_load, TableOptions options) {
+    HashTable *hashtable = init_with_options(size, max_load, options);
+    union Hashable value;
+    long int i;
+    for (i = 0; i < keys->count; i++) {
+        value.i = i;
+        hashtable = add(LONG_MAX, copy_key(keys->keys[i], keys->type), keys->type, value, INTEGER, hashtable);
+    }
+    return hashtable;
+}
+
+typedef enum {INSERT, LOOKUP_HIT, LOOKUP_MISS, DELETE} workload;
+static const char *workload_names[] = {"insert", "lookup-hit", "lookup-miss", "delete"};
+
+/***
+* Runs one pass of a workload, writing each operation's time to latencies unless it is NULL.
+*   Returns the total time in ns, and counts the operations that found their key in *found.
+***/
+static long int run_pass(workload work, BenchmarkKeys *keys, long int size, double max_load, TableOptions options,
+                         long int *latencies, long int overhead, long int *found) {
+    HashTable *hashtable = (work == INSERT) ? init_with_options(size, max_load, options)
+                                            : filled_table(keys, size, max_load, options);
+    union Hashable value;
+    value.i = 0;
+    *found = 0;
+
+    long int start = now_ns();
+    long int i;
+    for (i = 0; i < keys->count; i++) {
+        long int key_index = keys->order[i];
+        long int op_start = (latencies != NULL) ? now_ns() : 0;
+        switch (work) {
+            case INSERT:
+                hashtable = add(LONG_MAX, copy_key(keys->keys[key_index], keys->type), keys->type,
+                                value, INTEGER, hashtable);
+                break;
+            case LOOKUP_HIT:
+                *found += (lookup(keys->keys[key_index], keys->type, hashtable) != NULL);
+                break;
+            case LOOKUP_MISS:
+                *found += (lookup(keys->misses[key_index], keys->type, hashtable) != NULL);
+                break;
+            case DELETE:
+                *found += discard(keys->keys[key_index], keys->type, hashtable);
+                break;
+        }
+        if (latencies != NULL) {
+            latencies[i] = now_ns() - op_start - overhead;
+            if (latencies[i] < 0) {
+                latencies[i] = 0;
+            }
+        }
+    }
+    long int elapsed = now_ns() - start;
+    free_table(hashtable);
+    return elapsed;
+}
+
+static int compare_longs(const void *a, const void *b) {
+    long int x = *(const long int *)a, y = *(const long int *)b;
+    return (x > y) - (x < y);
+}
+
+static BenchmarkResult run_workload(workload work, BenchmarkKeys *keys, long int size, double max_load,
+                                    TableOptions options, long int overhead) {
+    BenchmarkResult result;
+    long int *latencies = malloc(keys->count*sizeof(long int));
+    long int found;
+    result.ops = keys->count;
+    result.ns_per_op = (double)run_pass(work, keys, size, max_load, options, NULL, 0, &found) / keys->count;
+    run_pass(work, keys, size, max_load, options, latencies, overhead, &found);
+    qsort(latencies, keys->count, sizeof(long int), compare_longs);
+    result.p50 = latencies[keys->count / 2];
+    result.p99 = latencies[(long int)(keys->count * 0.99)];
+    result.p999 = latencies[(long int)(keys->count * 0.999)];
+    free(latencies);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    long int count = (argc > 1) ? atol(argv[1]) : 100000;
+    int json = (argc > 2) && (strcmp(argv[2], "json") == 0);
+    if (count < 1) {
+        count = 1;
+    }
+    long int overhead = clock_overhead();
+
+    if (json) {
+        printf("[\n");
+    }
+    else {
+        printf("key_set,storage,hash,max_load,sizing,workload,ops,ns_per_op,p50_ns,p99_ns,p999_ns\n");
+    }
+    int first = 1;
+    int set, storage, hash, load, presized, work;
+    for (set = UNIFORM; set <= STRINGS; set++) {
+        BenchmarkKeys *keys = make_keys(set, count);
+        for (storage = CHAINED; storage <= SWISS_TABLE; storage++) {
+            for (hash = WYHASH; hash <= IDENTITY; hash++) {
+                if ((hash == IDENTITY) && (set == STRINGS)) {
+                    continue; // strings would all hash by length
+                }
+                for (load = 0; load < 3; load++) {
+                    for (presized = 0; presized <= 1; presized++) {
+                        TableOptions options = default_table_options();
+                        options.storage = storage;
+                        options.hash_family = hash;
+                        options.power_of_two_size = 1;
+                        long int size = presized ? (long int)(count / max_loads[load]) + 1 : 8;
+
+                        for (work = INSERT; work <= DELETE; work++) {
+                            BenchmarkResult result = run_workload(work, keys, size, max_loads[load], options,
+                                                                  overhead);
+                            const char *sizing = presized ? "presized" : "grown";
+                            if (json) {
+                                printf("%s  {\"key_set\": \"%s\", \"storage\": \"%s\", \"hash\": \"%s\", "
+                                       "\"max_load\": %.2f, \"sizing\": \"%s\", \"workload\": \"%s\", \"ops\": %ld, "
+                                       "\"ns_per_op\": %.1f, \"p50_ns\": %ld, \"p99_ns\": %ld, \"p999_ns\": %ld}",
+                                       first ? "" : ",\n", key_set_names[set], storage_names[storage],
+                                       hash_names[hash], max_loads[load], sizing, workload_names[work], result.ops,
+                                       result.ns_per_op, result.p50, result.p99, result.p999);
+                            }
+                            else {
+                                printf("%s,%s,%s,%.2f,%s,%s,%ld,%.1f,%ld,%ld,%ld\n", key_set_names[set],
+                                       storage_names[storage], hash_names[hash], max_loads[load], sizing,
+                                       workload_names[work], result.ops, result.ns_per_op,
+                                       result.p50, result.p99, result.p999);
+                            }
+                            first = 0;
+                            fflush(stdout);
+                        }
+                    }
+                }
+            }
+        }
+        free_keys(keys);
+    }
+    if (json) {
+        printf("\n]\n");
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+"""Benchmarks the Python extension -- the counterpart of benchmark.c.
+
+Runs insert, lookup-hit, lookup-miss and delete over uniform, Zipf-distributed,
+adversarial and string key sets, for every combination of storage, hash_func,
+max_load and starting size, plus a dict as a baseline. Each workload runs
+twice: timed as a whole for ns/op, then in batches of LATENCY_BATCH operations
+for the p50/p99/p99.9 latencies (less the typical cost of reading the clock).
+Python 2's clock only ticks every microsecond or so, too coarse to time single
+operations, so each latency is the mean of its batch.
+
+Usage: python benchmark.py [--keys N] [--format csv|json]
+"""
+import argparse
+import bisect
+import json
+import random
+import sys
+import timeit
+
+import hashtable
+
+STORAGES = ["chained", "open", "swiss"]
+HASH_FUNCS = [("builtin", hash), ("native", "native")]
+MAX_LOADS = [0.5, 0.75, 0.9]
+WORKLOADS = ["insert", "lookup-hit", "lookup-miss", "delete"]
+LATENCY_BATCH = 16
+FIELDS = ["key_set", "table", "hash", "max_load", "sizing", "workload", "ops",
+          "ns_per_op", "p50_ns", "p99_ns", "p999_ns"]
+
+clock = timeit.default_timer
+
+
+class DictTable(object):
+    """A dict behind the HashTable methods the benchmark uses."""
+    def __init__(self):
+        self.d = {}
+    def set(self, key, value):
+        self.d[key] = value
+    def get(self, key):
+        return self.d.get(key)
+    def discard(self, key):
+        return self.d.pop(key, None) is not None
+
+
+def zipf_order(count, rng):
+    """Picks rank r with probability proportional to 1 / (r + 1)^0.99."""
+    cumulative = []
+    total = 0.0
+    for i in range(count):
+        total += 1.0 / (i + 1) ** 0.99
+        cumulative.append(total)
+    return [min(bisect.bisect_left(cumulative, rng.random() * total), count - 1) for _ in range(count)]
+
+
+def make_keys(key_set, count):
+    """Returns (keys, misses, order): the keys, as many keys not among them, and the key used by each operation."""
+    rng = random.Random(0x9e3779b9)
+    if key_set == "adversarial":
+        keys = [i << 20 for i in range(count)]
+        misses = [(i + count) << 20 for i in range(count)]
+    elif key_set == "strings":
+        letters = "abcdefghijklmnopqrstuvwxyz"
+        keys = ["".join(rng.choice(letters) for _ in range(16)) for _ in range(count)]
+        misses = ["A" + key[1:] for key in keys]
+    else:
+        keys = [int(rng.getrandbits(62) & ~1) for _ in range(count)]
+        misses = [key | 1 for key in keys]
+    if key_set == "zipf":
+        order = zipf_order(count, rng)
+    else:
+        order = range(count)
+        rng.shuffle(order)
+    return keys, misses, order
+
+
+def clock_overhead():
+    samples = []
+    for _ in range(1001):
+        start = clock()
+        samples.append(clock() - start)
+    return sorted(samples)[500]
+
+
+def run_pass(workload, make_table, keys, misses, order, latencies, overhead):
+    table = make_table()
+    if workload != "insert":
+        for key in keys:
+            table.set(key, 0)
+    if workload == "insert":
+        operation, operands = table.set, [keys[i] for i in order]
+    elif workload == "lookup-hit":
+        operation, operands = table.get, [keys[i] for i in order]
+    elif workload == "lookup-miss":
+        operation, operands = table.get, [misses[i] for i in order]
+    else:
+        operation, operands = table.discard, [keys[i] for i in order]
+
+    if latencies is None:
+        start = clock()
+        if workload == "insert":
+            for key in operands:
+                operation(key, 0)
+        else:
+            for key in operands:
+                operation(key)
+        return clock() - start
+
+    for first in range(0, len(operands), LATENCY_BATCH):
+        batch = operands[first:first + LATENCY_BATCH]
+        start = clock()
+        if workload == "insert":
+            for key in batch:
+                operation(key, 0)
+        else:
+            for key in batch:
+                operation(key)
+        latencies.append(max(clock() - start - overhead, 0.0) / len(batch))
+
+
+def run_workload(workload, make_table, keys, misses, order, overhead):
+    count = len(order)
+    elapsed = run_pass(workload, make_table, keys, misses, order, None, overhead)
+    latencies = []
+    run_pass(workload, make_table, keys, misses, order, latencies, overhead)
+    latencies.sort()
+    percentile = lambda p: int(round(latencies[int(len(latencies) * p)] * 1e9))
+    return {"ops": count, "ns_per_op": round(elapsed * 1e9 / count, 1),
+            "p50_ns": percentile(0.5), "p99_ns": percentile(0.99), "p999_ns": percentile(0.999)}
+
+
+def configurations(count):
+    """Yields (table, hash, max_load, sizing, make_table) for every table to benchmark."""
+    yield "dict", "builtin", "", "grown", DictTable
+    for storage in STORAGES:
+        for hash_name, hash_func in HASH_FUNCS:
+            for max_load in MAX_LOADS:
+                for sizing, size in [("grown", 8), ("presized", int(count / max_load) + 1)]:
+                    make_table = (lambda storage=storage, hash_func=hash_func, max_load=max_load, size=size:
+                                  hashtable.HashTable(size = size, max_load = max_load, hash_func = hash_func,
+                                                      storage = storage, power_of_two = True))
+                    yield storage, hash_name, max_load, sizing, make_table
+
+
+def main():
+    parser = argparse.ArgumentParser(description = "Benchmark the hashtable extension.")
+    parser.add_argument("--keys", type = int, default = 20000)
+    parser.add_argument("--format", choices = ["csv", "json"], default = "csv")
+    args = parser.parse_args()
+
+    overhead = clock_overhead()
+    results = []
+    if args.format == "csv":
+        print ",".join(FIELDS)
+    for key_set in ["uniform", "zipf", "adversarial", "strings"]:
+        keys, misses, order = make_keys(key_set, max(args.keys, 1))
+        for table, hash_name, max_load, sizing, make_table in configurations(len(keys)):
+            for workload in WORKLOADS:
+                result = run_workload(workload, make_table, keys, misses, order, overhead)
+                result.update({"key_set": key_set, "table": table, "hash": hash_name, "max_load": max_load,
+                               "sizing": sizing, "workload": workload})
+                if args.format == "csv":
+                    print ",".join(str(result[field]) for field in FIELDS)
+                    sys.stdout.flush()
+                else:
+                    results.append(result)
+    if args.format == "json":
+        print json.dumps(results, indent = 2, sort_keys = True)
+
+
+if __name__ == "__main__":
+    main()
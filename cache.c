@@ -0,0 +1,194 @@
+#include "cache.h"
+
+/***
+* Cache
+*   A HashTable bounded to capacity pairs. The pairs themselves live in a ring of
+*   CacheEntries, and the table maps each key to its entry, so a hit is one lookup
+*   that also sets the entry's referenced bit -- nothing is unlinked or moved.
+*
+*   Eviction is CLOCK, a cheap approximation of LRU: a hand sweeps the ring,
+*   clearing referenced bits, and evicts the first entry whose bit is already clear
+*   (one that hasn't been hit since the hand last came round). The new pair takes
+*   its place, just behind the hand, so it's the last the hand looks at. Each
+*   eviction clears at most capacity bits, and every bit it clears was set by a hit,
+*   so eviction costs O(1) per operation, amortised.
+*
+*   The table is reserved for capacity items up front, so it never resizes, and it
+*   may use any storage: entries find their keys by hash, not by position.
+***/
+
+static void free_value(union Hashable value, hash_type value_type) {
+    if (value_type == STRING) {
+        free(value.str);
+    }
+    else if ((value_type == OBJECT) && (release_object != NULL)) {
+        release_object(value.object);
+    }
+}
+
+/***
+* Creates an empty cache for up to capacity (at least 1) pairs, whose table uses the given options.
+*   A cache's table never shrinks, so options.min_load_proportion is ignored.
+***/
+Cache *cache_init(long int capacity, double max_load_proportion, TableOptions options) {
+    Cache *cache = malloc(sizeof(Cache));
+    cache->capacity = capacity;
+    cache->count = 0;
+    cache->hand = 0;
+    cache->ring = malloc(capacity*sizeof(CacheEntry));
+    options.min_load_proportion = 0;
+    cache->table = reserve(capacity, init_with_options(SHRINK_MIN_SIZE, max_load_proportion, options));
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    cache->on_evict = NULL;
+    cache->on_evict_arg = NULL;
+    return cache;
+}
+
+void cache_free(Cache *cache) {
+    cache_clear(cache);
+    free_table(cache->table);
+    free(cache->ring);
+    free(cache);
+}
+
+/***
+* Frees every pair (without calling on_evict), keeping the counters.
+***/
+void cache_clear(Cache *cache) {
+    long int i;
+    for (i = 0; i < cache->count; i++) {
+        free_value(cache->ring[i].item.value, cache->ring[i].item.value_type);
+    }
+    clear_table(cache->table); // frees the keys
+    cache->count = 0;
+    cache->hand = 0;
+}
+
+/***
+* Sets the function called with each evicted pair (NULL for none). It gets the pair
+*   just before it's freed, and must not use the cache.
+***/
+void cache_set_eviction_callback(eviction_callback on_evict, void *arg, Cache *cache) {
+    cache->on_evict = on_evict;
+    cache->on_evict_arg = arg;
+}
+
+/***
+* Returns the cached pair with the given key, marking it as recently used, or NULL on a miss.
+*   If the key's hash has not been computed yet, pass LONG_MAX.
+***/
+Item *cache_lookup(long int hash, union Hashable key, hash_type key_type, Cache *cache) {
+    Item *found = cache_peek(hash, key, key_type, cache);
+    if (found == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    ((CacheEntry *)found)->referenced = 1;
+    return found;
+}
+
+/***
+* Like cache_lookup, but neither counts a hit or miss nor marks the pair as used.
+***/
+Item *cache_peek(long int hash, union Hashable key, hash_type key_type, Cache *cache) {
+    if (hash == LONG_MAX) {
+        hash = calculate_hash(key, key_type, cache->table);
+    }
+    Item *index = lookup_by_hash(hash, key, key_type, cache->table);
+    return (index == NULL) ? NULL : &cache->ring[index->value.i].item;
+}
+
+/***
+* Moves the hand on to the first entry that hasn't been used since it last passed,
+*   and evicts it. Only called while the ring is full. Returns the freed entry's index.
+***/
+static long int evict(Cache *cache) {
+    while (cache->ring[cache->hand].referenced) {
+        cache->ring[cache->hand].referenced = 0;
+        cache->hand = (cache->hand + 1) % cache->capacity;
+    }
+    long int victim = cache->hand;
+    cache->hand = (cache->hand + 1) % cache->capacity;
+
+    Item *evicted = &cache->ring[victim].item;
+    Item *removed = remove_item_from_table_by_hash(evicted->hash, evicted->key, evicted->key_type, cache->table);
+    if (cache->on_evict != NULL) {
+        cache->on_evict(evicted, cache->on_evict_arg);
+    }
+    free_item(removed, cache->table); // frees the key, which evicted shares
+    free_value(evicted->value, evicted->value_type);
+    cache->evictions++;
+    return victim;
+}
+
+/***
+* Caches a key, value pair, evicting a pair first if the cache is full and the key is new.
+*   Like add, the cache takes ownership of key and value, and hash may be LONG_MAX.
+***/
+void cache_set(long int hash, union Hashable key, hash_type key_type, union Hashable value, hash_type value_type,
+               Cache *cache) {
+    if (hash == LONG_MAX) {
+        hash = calculate_hash(key, key_type, cache->table);
+    }
+
+    Item *index = lookup_by_hash(hash, key, key_type, cache->table);
+    if (index != NULL) {
+        CacheEntry *entry = &cache->ring[index->value.i];
+        free_value(entry->item.value, entry->item.value_type);
+        entry->item.value = value;
+        entry->item.value_type = value_type;
+        entry->referenced = 1;
+        if (key_type == STRING) {
+            free(key.str); // the table keeps its own copy of the key
+        }
+        return;
+    }
+
+    long int slot = (cache->count < cache->capacity) ? cache->count++ : evict(cache);
+    Item item = {hash, key, key_type, value, value_type};
+    cache->ring[slot].item = item;
+    cache->ring[slot].referenced = 0;
+    union Hashable ring_index;
+    ring_index.i = slot;
+    cache->table = add(hash, key, key_type, ring_index, INTEGER, cache->table);
+}
+
+/***
+* Removes the pair with the given key. Returns 1 if it was cached, and 0 if not.
+*   If value is not NULL, the removed value is handed back through *value and
+*   *value_type, and the caller owns it; otherwise it's freed.
+*   The ring's last entry moves into the removed one's place, so the ring stays dense.
+***/
+int cache_remove(long int hash, union Hashable key, hash_type key_type, union Hashable *value, hash_type *value_type,
+                 Cache *cache) {
+    if (hash == LONG_MAX) {
+        hash = calculate_hash(key, key_type, cache->table);
+    }
+
+    Item *removed = remove_item_from_table_by_hash(hash, key, key_type, cache->table);
+    if (removed == NULL) {
+        return 0;
+    }
+    long int slot = removed->value.i;
+    free_item(removed, cache->table);
+
+    CacheEntry *entry = &cache->ring[slot];
+    if (value != NULL) {
+        *value = entry->item.value;
+        *value_type = entry->item.value_type;
+    }
+    else {
+        free_value(entry->item.value, entry->item.value_type);
+    }
+
+    long int last = --cache->count;
+    if (slot != last) {
+        *entry = cache->ring[last];
+        Item *moved = lookup_by_hash(entry->item.hash, entry->item.key, entry->item.key_type, cache->table);
+        moved->value.i = slot;
+    }
+    return 1;
+}
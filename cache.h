@@ -0,0 +1,45 @@
+#include "hashtable.h"
+
+/***
+* Definitions
+***/
+
+// One cached pair. The key is shared with the table's item, which owns it; the value is owned here.
+typedef struct cache_entry {
+    Item item;
+    int referenced; // set by every hit, cleared as the clock hand passes
+} CacheEntry;
+
+// Called with each pair the cache evicts, just before it's freed
+typedef void (*eviction_callback)(Item *evicted, void *arg);
+
+// A HashTable bounded to capacity pairs, evicting with CLOCK: the table maps each key
+//   to its entry in a ring, and a hand sweeps the ring for an entry that hasn't been
+//   used since the hand last passed it
+typedef struct cache {
+    long int capacity;
+    long int count;        // entries in use -- always the first count of the ring
+    long int hand;         // next entry the clock looks at
+    CacheEntry *ring;
+    HashTable *table;      // key -> INTEGER index into ring
+    long int hits;
+    long int misses;
+    long int evictions;
+    eviction_callback on_evict; // or NULL
+    void *on_evict_arg;
+} Cache;
+
+/***
+* Function declarations
+***/
+Cache *cache_init(long int capacity, double max_load_proportion, TableOptions options);
+void cache_free(Cache *cache);
+void cache_clear(Cache *cache);
+void cache_set_eviction_callback(eviction_callback on_evict, void *arg, Cache *cache);
+
+Item *cache_lookup(long int hash, union Hashable key, hash_type key_type, Cache *cache);
+Item *cache_peek(long int hash, union Hashable key, hash_type key_type, Cache *cache);
+void cache_set(long int hash, union Hashable key, hash_type key_type, union Hashable value, hash_type value_type,
+               Cache *cache);
+int cache_remove(long int hash, union Hashable key, hash_type key_type, union Hashable *value, hash_type *value_type,
+                 Cache *cache);
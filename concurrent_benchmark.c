@@ -0,0 +1,148 @@
+#include <time.h>
+#include "concurrent_hashtable.h"
+
+/***
+* Multi-threaded throughput benchmark for the concurrent hashtable
+*   mixed: every thread runs the same mix of lookups, adds and discards over a
+*          pre-filled table, whose size stays about the same.
+*   grow:  every thread inserts its own range of keys into a table that starts
+*          small, so writers keep migrating stripes of resizes in progress.
+*   Each is run with 1, 2, 4, ... up to max_threads threads.
+*
+*   Usage: concurrent_benchmark [max_threads] [keys] [ops_per_thread] [read_percent]
+***/
+
+typedef struct benchmark_thread {
+    pthread_t thread;
+    ConcurrentHashTable *table;
+    long int keys;
+    long int ops;
+    int read_percent;
+    long int first_key;   // grow only
+    unsigned long int rng;
+    long int found;
+} BenchmarkThread;
+
+static unsigned long int next_random(unsigned long int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void *run_mixed(void *arg) {
+    BenchmarkThread *bt = arg;
+    ConcurrentHandle *handle = concurrent_attach(bt->table);
+    union Hashable key, value;
+
+    long int i;
+    for (i = 0; i < bt->ops; i++) {
+        unsigned long int r = next_random(&bt->rng);
+        key.i = (long int)((r >> 8) % (unsigned long int)bt->keys);
+        int op = (int)(r % 100);
+        if (op < bt->read_percent) {
+            concurrent_read_begin(handle);
+            if (concurrent_lookup(LONG_MAX, key, INTEGER, handle) != NULL) {
+                bt->found++;
+            }
+            concurrent_read_end(handle);
+        }
+        else if (op % 2 == 0) {
+            value.i = i;
+            concurrent_add(LONG_MAX, key, INTEGER, value, INTEGER, handle);
+        }
+        else {
+            concurrent_discard(LONG_MAX, key, INTEGER, handle);
+        }
+    }
+    concurrent_detach(handle);
+    return NULL;
+}
+
+static void *run_grow(void *arg) {
+    BenchmarkThread *bt = arg;
+    ConcurrentHandle *handle = concurrent_attach(bt->table);
+    union Hashable key, value;
+
+    long int i;
+    for (i = 0; i < bt->ops; i++) {
+        key.i = bt->first_key + i;
+        value.i = i;
+        concurrent_add(LONG_MAX, key, INTEGER, value, INTEGER, handle);
+    }
+    concurrent_detach(handle);
+    return NULL;
+}
+
+static double run_threads(int threads, void *(*run)(void *), BenchmarkThread *bts) {
+    double start = now();
+    int t;
+    for (t = 0; t < threads; t++) {
+        pthread_create(&bts[t].thread, NULL, run, &bts[t]);
+    }
+    for (t = 0; t < threads; t++) {
+        pthread_join(bts[t].thread, NULL);
+    }
+    return now() - start;
+}
+
+int main(int argc, char **argv) {
+    int max_threads = (argc > 1) ? atoi(argv[1]) : 8;
+    long int keys = (argc > 2) ? atol(argv[2]) : 1000000;
+    long int ops = (argc > 3) ? atol(argv[3]) : 1000000;
+    int read_percent = (argc > 4) ? atoi(argv[4]) : 90;
+
+    BenchmarkThread *bts = calloc(max_threads, sizeof(BenchmarkThread));
+    union Hashable key, value;
+
+    printf("workload,threads,ops,seconds,mops_per_second\n");
+    int threads;
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        ConcurrentHashTable *table = concurrent_init(keys, 0.75, default_table_options());
+        ConcurrentHandle *handle = concurrent_attach(table);
+        long int i;
+        for (i = 0; i < keys; i += 2) {
+            key.i = i;
+            value.i = i;
+            concurrent_add(LONG_MAX, key, INTEGER, value, INTEGER, handle);
+        }
+        concurrent_detach(handle);
+
+        int t;
+        for (t = 0; t < threads; t++) {
+            bts[t].table = table;
+            bts[t].keys = keys;
+            bts[t].ops = ops;
+            bts[t].read_percent = read_percent;
+            bts[t].rng = 0x9e3779b97f4a7c15UL * (t + 1);
+            bts[t].found = 0;
+        }
+        double seconds = run_threads(threads, run_mixed, bts);
+        printf("mixed-%d%%-reads,%d,%ld,%f,%f\n", read_percent, threads, threads*ops, seconds,
+               threads*ops / seconds / 1e6);
+        concurrent_free(table);
+
+        table = concurrent_init(LOCK_STRIPES, 0.75, default_table_options());
+        for (t = 0; t < threads; t++) {
+            bts[t].table = table;
+            bts[t].ops = ops;
+            bts[t].first_key = t*ops;
+        }
+        seconds = run_threads(threads, run_grow, bts);
+        if (concurrent_load(table) != threads*ops) {
+            fprintf(stderr, "grow: expected %ld items, found %ld\n", threads*ops, concurrent_load(table));
+            return 1;
+        }
+        printf("grow,%d,%ld,%f,%f\n", threads, threads*ops, seconds, threads*ops / seconds / 1e6);
+        concurrent_free(table);
+    }
+
+    free(bts);
+    return 0;
+}
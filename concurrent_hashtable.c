@@ -0,0 +1,446 @@
+#include "concurrent_hashtable.h"
+
+/***
+* Concurrent hashtable
+*   A chained table that any number of threads can use at once.
+*
+*   Writers (add, discard) lock one of LOCK_STRIPES stripes. Every key in a bin
+*   belongs to the same stripe at every table size, since both come from the top
+*   bits of the spread hash.
+*
+*   Readers (lookup) take no locks at all. Nodes are never changed once linked in,
+*   so a reader always sees a whole item, and nothing a reader might still hold is
+*   freed until it has left its read section: unlinked nodes and bin arrays are
+*   retired with the current epoch, and freed once the epoch has moved on twice
+*   (epoch-based reclamation).
+*
+*   Resizing is cooperative: the writer that pushes the load over the limit only
+*   allocates the bigger bin array. Every later write then copies one stripe of
+*   bins across, so no single call pays for the whole table, and readers follow
+*   each stripe's migrated flag to whichever array currently holds it.
+*
+*   Each thread attaches to the table once (concurrent_attach) and passes its
+*   handle to every call. Items returned by concurrent_lookup are only valid
+*   until concurrent_read_end.
+***/
+
+static unsigned long int spread(long int hash) {
+    return (unsigned long int)hash * 0x9e3779b97f4a7c15UL;
+}
+
+static int stripe_of(unsigned long int spread_hash) {
+    return (int)(spread_hash >> (64 - STRIPE_BITS));
+}
+
+static ConcurrentBins *allocate_bins(long int size) {
+    long int capacity = LOCK_STRIPES;
+    int shift = 64 - STRIPE_BITS;
+    while (capacity < size) {
+        capacity *= 2;
+        shift--;
+    }
+
+    ConcurrentBins *bins = calloc(1, sizeof(ConcurrentBins) + capacity*sizeof(ConcurrentNode*));
+    bins->size = capacity;
+    bins->shift = shift;
+    return bins;
+}
+
+ConcurrentHashTable *concurrent_init(long int size, double max_load_proportion, TableOptions options) {
+    ConcurrentHashTable *table = malloc(sizeof(ConcurrentHashTable));
+    atomic_init(&table->bins, allocate_bins(size));
+    atomic_init(&table->load, 0);
+    atomic_init(&table->epoch, 0);
+    table->max_load_proportion = max_load_proportion;
+    table->hash_family = options.hash_family;
+    table->seed = (options.seed != 0) ? options.seed : random_seed();
+    table->handles = NULL;
+
+    int i;
+    for (i = 0; i < LOCK_STRIPES; i++) {
+        pthread_mutex_init(&table->stripes[i].mutex, NULL);
+    }
+    pthread_mutex_init(&table->handles_lock, NULL);
+    return table;
+}
+
+long int concurrent_load(ConcurrentHashTable *table) {
+    return atomic_load(&table->load);
+}
+
+/***
+* Epoch-based reclamation
+***/
+
+ConcurrentHandle *concurrent_attach(ConcurrentHashTable *table) {
+    pthread_mutex_lock(&table->handles_lock);
+    ConcurrentHandle *handle = table->handles;
+    while ((handle != NULL) && handle->in_use) {
+        handle = handle->next;
+    }
+    if (handle == NULL) {
+        handle = calloc(1, sizeof(ConcurrentHandle));
+        handle->table = table;
+        handle->next = table->handles;
+        table->handles = handle;
+    }
+    // a reused handle keeps its retired list -- this thread frees it from now on
+    handle->in_use = 1;
+    pthread_mutex_unlock(&table->handles_lock);
+    return handle;
+}
+
+void concurrent_detach(ConcurrentHandle *handle) {
+    pthread_mutex_lock(&handle->table->handles_lock);
+    handle->in_use = 0;
+    pthread_mutex_unlock(&handle->table->handles_lock);
+}
+
+void concurrent_read_begin(ConcurrentHandle *handle) {
+    if (handle->nesting++ > 0) {
+        return;
+    }
+    // Even if the epoch moves on between these two stores, it can't move again
+    // until this thread has caught up, so nothing it can reach will be freed.
+    atomic_store(&handle->epoch, atomic_load(&handle->table->epoch));
+    atomic_store(&handle->active, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void concurrent_read_end(ConcurrentHandle *handle) {
+    if (--handle->nesting > 0) {
+        return;
+    }
+    atomic_store_explicit(&handle->active, 0, memory_order_release);
+}
+
+/***
+* Moves the table's epoch on if every thread in a read section has seen the current one.
+***/
+static void try_advance_epoch(ConcurrentHashTable *table) {
+    unsigned long int epoch = atomic_load(&table->epoch);
+
+    pthread_mutex_lock(&table->handles_lock);
+    ConcurrentHandle *handle = table->handles;
+    while (handle != NULL) {
+        if (atomic_load(&handle->active) && (atomic_load(&handle->epoch) != epoch)) {
+            break;
+        }
+        handle = handle->next;
+    }
+    pthread_mutex_unlock(&table->handles_lock);
+
+    if (handle == NULL) {
+        atomic_compare_exchange_strong(&table->epoch, &epoch, epoch + 1);
+    }
+}
+
+/***
+* Frees whatever this handle retired at least two epochs ago -- no reader can still hold those.
+***/
+static void reclaim(ConcurrentHandle *handle) {
+    try_advance_epoch(handle->table);
+    unsigned long int epoch = atomic_load(&handle->table->epoch);
+
+    long int i, kept = 0;
+    for (i = 0; i < handle->retired_count; i++) {
+        Retired *retired = &handle->retired[i];
+        if (retired->epoch + 2 <= epoch) {
+            retired->release(retired->ptr);
+        }
+        else {
+            handle->retired[kept++] = *retired;
+        }
+    }
+    handle->retired_count = kept;
+}
+
+static void retire(void *ptr, void (*release)(void *), ConcurrentHandle *handle) {
+    if (handle->retired_count == handle->retired_capacity) {
+        handle->retired_capacity = (handle->retired_capacity == 0) ? RETIRE_BATCH : 2*handle->retired_capacity;
+        handle->retired = realloc(handle->retired, handle->retired_capacity*sizeof(Retired));
+    }
+    Retired *retired = &handle->retired[handle->retired_count++];
+    retired->ptr = ptr;
+    retired->release = release;
+    // the unlink must be visible before we read the epoch it happened in
+    atomic_thread_fence(memory_order_seq_cst);
+    retired->epoch = atomic_load(&handle->table->epoch);
+
+    if (handle->retired_count % RETIRE_BATCH == 0) {
+        reclaim(handle);
+    }
+}
+
+static void release_concurrent_node(void *ptr) {
+    ConcurrentNode *node = ptr;
+    free_item_contents(&node->item);
+    free(node);
+}
+
+/***
+* Frees a bin array that has been migrated -- the nodes still linked into it
+*   are only shells, since their copies in the new array own the strings.
+***/
+static void release_migrated_bins(void *ptr) {
+    ConcurrentBins *bins = ptr;
+    long int i;
+    for (i = 0; i < bins->size; i++) {
+        ConcurrentNode *node = atomic_load_explicit(&bins->heads[i], memory_order_relaxed);
+        while (node != NULL) {
+            ConcurrentNode *temp = atomic_load_explicit(&node->next, memory_order_relaxed);
+            free(node);
+            node = temp;
+        }
+    }
+    free(bins);
+}
+
+/***
+* Cooperative resizing
+***/
+
+/***
+* Returns the bin array that currently holds the given stripe.
+*   For writers this is stable while they hold the stripe's lock.
+***/
+static ConcurrentBins *bins_for_stripe(int stripe, ConcurrentHashTable *table) {
+    ConcurrentBins *bins = atomic_load_explicit(&table->bins, memory_order_acquire);
+    ConcurrentBins *next;
+    while (((next = atomic_load_explicit(&bins->next, memory_order_acquire)) != NULL) &&
+           atomic_load_explicit(&bins->migrated[stripe], memory_order_acquire)) {
+        bins = next;
+    }
+    return bins;
+}
+
+/***
+* Copies every node in one stripe of from into to, then points readers and writers at to.
+***/
+static void migrate_stripe(int stripe, ConcurrentBins *from, ConcurrentBins *to, ConcurrentHashTable *table) {
+    long int bins_per_stripe = from->size / LOCK_STRIPES;
+    long int first = stripe * bins_per_stripe;
+
+    pthread_mutex_lock(&table->stripes[stripe].mutex);
+    long int i;
+    for (i = first; i < first + bins_per_stripe; i++) {
+        ConcurrentNode *node = atomic_load_explicit(&from->heads[i], memory_order_relaxed);
+        while (node != NULL) {
+            // until the migrated flag is set, nobody else looks at this stripe of to
+            long int bin_index = spread(node->item.hash) >> to->shift;
+            ConcurrentNode *copy = malloc(sizeof(ConcurrentNode));
+            copy->item = node->item;
+            atomic_init(&copy->next, atomic_load_explicit(&to->heads[bin_index], memory_order_relaxed));
+            atomic_store_explicit(&to->heads[bin_index], copy, memory_order_relaxed);
+            node = atomic_load_explicit(&node->next, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&from->migrated[stripe], 1, memory_order_release);
+    pthread_mutex_unlock(&table->stripes[stripe].mutex);
+}
+
+/***
+* Starts a resize if the load limit has been passed and none is in progress.
+***/
+static void maybe_begin_resize(ConcurrentHashTable *table) {
+    ConcurrentBins *bins = atomic_load(&table->bins);
+    if (atomic_load_explicit(&bins->next, memory_order_relaxed) != NULL) {
+        return;
+    }
+    if ((double)atomic_load_explicit(&table->load, memory_order_relaxed) / (double)bins->size <= table->max_load_proportion) {
+        return;
+    }
+
+    ConcurrentBins *next = allocate_bins(2*bins->size);
+    ConcurrentBins *expected = NULL;
+    if (!atomic_compare_exchange_strong(&bins->next, &expected, next)) {
+        free(next); // another writer got there first
+    }
+}
+
+/***
+* Migrates one stripe of a resize in progress, if any are left.
+*   Whoever finishes the last stripe publishes the new array and retires the old one.
+***/
+static void help_resize(ConcurrentHandle *handle) {
+    ConcurrentHashTable *table = handle->table;
+    ConcurrentBins *bins = atomic_load(&table->bins);
+    ConcurrentBins *next = atomic_load(&bins->next);
+    if (next == NULL) {
+        return;
+    }
+
+    long int stripe = atomic_fetch_add(&bins->next_stripe, 1);
+    if (stripe >= LOCK_STRIPES) {
+        return;
+    }
+    migrate_stripe((int)stripe, bins, next, table);
+    if (atomic_fetch_add(&bins->stripes_done, 1) + 1 == LOCK_STRIPES) {
+        atomic_store(&table->bins, next);
+        retire(bins, release_migrated_bins, handle);
+    }
+}
+
+/***
+* Table operations
+***/
+
+/***
+* Adds a key, value pair, or replaces the value if the key is already present.
+*   As with add, a hash of LONG_MAX means "use the table's built-in hash function",
+*   and the table takes ownership of string keys and values.
+***/
+void concurrent_add(long int hash, union Hashable key, hash_type key_type,
+                    union Hashable value, hash_type value_type, ConcurrentHandle *handle) {
+    ConcurrentHashTable *table = handle->table;
+    if (hash == LONG_MAX) {
+        hash = hash_with_family(key, key_type, table->hash_family, table->seed);
+    }
+    unsigned long int spread_hash = spread(hash);
+    int stripe = stripe_of(spread_hash);
+
+    ConcurrentNode *new = malloc(sizeof(ConcurrentNode));
+    Item item = {hash, key, key_type, value, value_type};
+    new->item = item;
+
+    concurrent_read_begin(handle);
+    pthread_mutex_lock(&table->stripes[stripe].mutex);
+
+    ConcurrentBins *bins = bins_for_stripe(stripe, table);
+    _Atomic(ConcurrentNode *) *head = &bins->heads[spread_hash >> bins->shift];
+    _Atomic(ConcurrentNode *) *link = head;
+    ConcurrentNode *current_node;
+    while ((current_node = atomic_load_explicit(link, memory_order_relaxed)) != NULL) {
+        if (item_has_key(&current_node->item, hash, key, key_type)) {
+            break;
+        }
+        link = &current_node->next;
+    }
+
+    if (current_node != NULL) {
+        // keys are equal -- swap in the new node where the old one was
+        atomic_init(&new->next, atomic_load_explicit(&current_node->next, memory_order_relaxed));
+        atomic_store_explicit(link, new, memory_order_release);
+    }
+    else {
+        atomic_init(&new->next, atomic_load_explicit(head, memory_order_relaxed));
+        atomic_store_explicit(head, new, memory_order_release);
+    }
+    pthread_mutex_unlock(&table->stripes[stripe].mutex);
+
+    if (current_node != NULL) {
+        retire(current_node, release_concurrent_node, handle);
+    }
+    else {
+        atomic_fetch_add_explicit(&table->load, 1, memory_order_relaxed);
+        maybe_begin_resize(table);
+    }
+    help_resize(handle);
+    concurrent_read_end(handle);
+}
+
+/***
+* Returns item associated with the given hash and key, or NULL if no such item exists.
+*   Must be called inside concurrent_read_begin/concurrent_read_end -- the item is only valid until then.
+***/
+Item *concurrent_lookup(long int hash, union Hashable key, hash_type key_type, ConcurrentHandle *handle) {
+    ConcurrentHashTable *table = handle->table;
+    if (hash == LONG_MAX) {
+        hash = hash_with_family(key, key_type, table->hash_family, table->seed);
+    }
+    unsigned long int spread_hash = spread(hash);
+
+    ConcurrentBins *bins = bins_for_stripe(stripe_of(spread_hash), table);
+    ConcurrentNode *current_node = atomic_load_explicit(&bins->heads[spread_hash >> bins->shift], memory_order_acquire);
+    while (current_node != NULL) {
+        if (item_has_key(&current_node->item, hash, key, key_type)) {
+            return &current_node->item;
+        }
+        current_node = atomic_load_explicit(&current_node->next, memory_order_acquire);
+    }
+    return NULL;
+}
+
+/***
+* Removes and frees the item with given hash and key. Returns 1 if it was found, 0 otherwise.
+*   Its memory is only released once no reader can still be looking at it.
+***/
+int concurrent_discard(long int hash, union Hashable key, hash_type key_type, ConcurrentHandle *handle) {
+    ConcurrentHashTable *table = handle->table;
+    if (hash == LONG_MAX) {
+        hash = hash_with_family(key, key_type, table->hash_family, table->seed);
+    }
+    unsigned long int spread_hash = spread(hash);
+    int stripe = stripe_of(spread_hash);
+
+    concurrent_read_begin(handle);
+    pthread_mutex_lock(&table->stripes[stripe].mutex);
+
+    ConcurrentBins *bins = bins_for_stripe(stripe, table);
+    _Atomic(ConcurrentNode *) *link = &bins->heads[spread_hash >> bins->shift];
+    ConcurrentNode *current_node;
+    while ((current_node = atomic_load_explicit(link, memory_order_relaxed)) != NULL) {
+        if (item_has_key(&current_node->item, hash, key, key_type)) {
+            atomic_store_explicit(link, atomic_load_explicit(&current_node->next, memory_order_relaxed),
+                                  memory_order_release);
+            break;
+        }
+        link = &current_node->next;
+    }
+    pthread_mutex_unlock(&table->stripes[stripe].mutex);
+
+    if (current_node != NULL) {
+        atomic_fetch_sub_explicit(&table->load, 1, memory_order_relaxed);
+        retire(current_node, release_concurrent_node, handle);
+    }
+    help_resize(handle);
+    concurrent_read_end(handle);
+    return (current_node != NULL);
+}
+
+/***
+* Frees the table and everything in it. No thread may be using the table any more.
+***/
+void concurrent_free(ConcurrentHashTable *table) {
+    ConcurrentBins *bins = atomic_load(&table->bins);
+    ConcurrentBins *next = atomic_load(&bins->next);
+    if (next != NULL) {
+        // finish the resize in progress, so every item is in exactly one array
+        int stripe;
+        for (stripe = 0; stripe < LOCK_STRIPES; stripe++) {
+            if (!atomic_load(&bins->migrated[stripe])) {
+                migrate_stripe(stripe, bins, next, table);
+            }
+        }
+        release_migrated_bins(bins);
+        bins = next;
+    }
+
+    long int i;
+    for (i = 0; i < bins->size; i++) {
+        ConcurrentNode *node = atomic_load(&bins->heads[i]);
+        while (node != NULL) {
+            ConcurrentNode *temp = atomic_load(&node->next);
+            release_concurrent_node(node);
+            node = temp;
+        }
+    }
+    free(bins);
+
+    ConcurrentHandle *handle = table->handles;
+    while (handle != NULL) {
+        ConcurrentHandle *temp = handle->next;
+        for (i = 0; i < handle->retired_count; i++) {
+            handle->retired[i].release(handle->retired[i].ptr);
+        }
+        free(handle->retired);
+        free(handle);
+        handle = temp;
+    }
+
+    for (i = 0; i < LOCK_STRIPES; i++) {
+        pthread_mutex_destroy(&table->stripes[i].mutex);
+    }
+    pthread_mutex_destroy(&table->handles_lock);
+    free(table);
+}
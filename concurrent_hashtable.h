@@ -0,0 +1,83 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hashtable.h"
+
+/***
+* Definitions
+***/
+
+// Writers lock one of LOCK_STRIPES stripes, chosen by the top STRIPE_BITS bits of the spread hash
+#define STRIPE_BITS 6
+#define LOCK_STRIPES (1 << STRIPE_BITS)
+// How many nodes or bin arrays a thread retires before it tries to free some of them
+#define RETIRE_BATCH 64
+
+// Nodes are immutable once published -- an update links in a new node and retires the old one
+typedef struct concurrent_node {
+    Item item;
+    _Atomic(struct concurrent_node *) next;
+} ConcurrentNode;
+
+// A bin array; while it is being migrated into a bigger one, next points to that array
+typedef struct concurrent_bins {
+    long int size;                     // power of two, at least LOCK_STRIPES
+    int shift;                         // 64 - log2(size): bin index is the top bits of the spread hash
+    _Atomic(struct concurrent_bins *) next;
+    atomic_long next_stripe;           // next stripe for a writer to migrate
+    atomic_long stripes_done;
+    atomic_int migrated[LOCK_STRIPES]; // set once a stripe's bins have been copied into next
+    _Atomic(ConcurrentNode *) heads[];
+} ConcurrentBins;
+
+// Something unlinked from the table, to be freed once no reader can still hold it
+typedef struct retired {
+    void *ptr;
+    void (*release)(void *ptr);
+    unsigned long int epoch;
+} Retired;
+
+// Per-thread state -- each thread using a table attaches once and passes its handle around
+typedef struct concurrent_handle {
+    struct concurrent_hashtable *table;
+    atomic_ulong epoch;  // the table's epoch when the current read section began
+    atomic_int active;   // in a read section
+    int nesting;
+    int in_use;          // attached to a thread (guarded by the table's handles_lock)
+    Retired *retired;
+    long int retired_count;
+    long int retired_capacity;
+    struct concurrent_handle *next;
+} ConcurrentHandle;
+
+typedef struct stripe_lock {
+    _Alignas(64) pthread_mutex_t mutex; // one cache line each, so stripes don't contend falsely
+} StripeLock;
+
+typedef struct concurrent_hashtable {
+    _Atomic(ConcurrentBins *) bins;
+    StripeLock stripes[LOCK_STRIPES];
+    atomic_long load;
+    double max_load_proportion;
+    hash_family hash_family;
+    unsigned long int seed;
+    atomic_ulong epoch;
+    pthread_mutex_t handles_lock;
+    ConcurrentHandle *handles;   // never shrinks -- detached handles are reused
+} ConcurrentHashTable;
+
+/***
+* Function declarations
+***/
+ConcurrentHashTable *concurrent_init(long int size, double max_load_proportion, TableOptions options);
+void concurrent_free(ConcurrentHashTable *table);
+long int concurrent_load(ConcurrentHashTable *table);
+
+ConcurrentHandle *concurrent_attach(ConcurrentHashTable *table);
+void concurrent_detach(ConcurrentHandle *handle);
+void concurrent_read_begin(ConcurrentHandle *handle);
+void concurrent_read_end(ConcurrentHandle *handle);
+
+void concurrent_add(long int hash, union Hashable key, hash_type key_type,
+                    union Hashable value, hash_type value_type, ConcurrentHandle *handle);
+Item *concurrent_lookup(long int hash, union Hashable key, hash_type key_type, ConcurrentHandle *handle);
+int concurrent_discard(long int hash, union Hashable key, hash_type key_type, ConcurrentHandle *handle);
@@ -0,0 +1,349 @@
+#include "frozen_hashtable.h"
+
+/***
+* Frozen hashtable
+*   freeze copies a table into dense key and value arrays, indexed by a minimal
+*   perfect hash (PTHash-style): each key's own hash picks a bucket, and each
+*   bucket stores a "pilot", chosen at build time so that hashing the bucket's
+*   keys with it sends every key in the whole table to a different position.
+*   A lookup is then one bucket read, one position computation and one key compare.
+*
+*   Positions are searched in a table slightly bigger than the item count (which
+*   makes pilots much quicker to find), and the few keys that land past the end
+*   are remapped into the holes that leaves below it.
+*
+*   The perfect hash is built on the keys themselves (with WYHASH), not on the
+*   original table's hashes, which a custom hash function may make collide.
+***/
+
+static unsigned long int key_hash(union Hashable key, hash_type key_type, unsigned long int mph_seed) {
+    // seeded per type, so an integer and a double with the same bits still hash apart
+    return (unsigned long int)hash_with_family(key, key_type, WYHASH, mph_seed + key_type);
+}
+
+static long int bucket_of(unsigned long int hash, long int bucket_count) {
+    return (long int)(((hash >> 32) * (unsigned long int)bucket_count) >> 32);
+}
+
+static long int position_with_pilot(unsigned long int hash, unsigned int pilot, FrozenHashTable *table) {
+    return (long int)((hash ^ hash_integer_mix(pilot, table->mph_seed)) % (unsigned long int)table->table_size);
+}
+
+/***
+* Finds a pilot for every bucket, biggest buckets first, and fills in positions[i]
+*   with where the i'th key goes (before remapping).
+*   Returns 0, or -1 if some bucket has no pilot (which a new seed will fix).
+***/
+static int find_pilots(long int count, unsigned long int *hashes, long int *positions, FrozenHashTable *table) {
+    long int bucket_count = table->bucket_count;
+    long int *bucket_starts = calloc(bucket_count + 1, sizeof(long int));
+    long int *by_bucket = malloc((count + 1)*sizeof(long int));
+    long int i, b;
+
+    // counting sort of the keys by bucket
+    for (i = 0; i < count; i++) {
+        bucket_starts[bucket_of(hashes[i], bucket_count) + 1]++;
+    }
+    long int max_size = 0;
+    for (b = 0; b < bucket_count; b++) {
+        if (bucket_starts[b + 1] > max_size) {
+            max_size = bucket_starts[b + 1];
+        }
+        bucket_starts[b + 1] += bucket_starts[b];
+    }
+    long int *next = malloc(bucket_count*sizeof(long int));
+    memcpy(next, bucket_starts, bucket_count*sizeof(long int));
+    for (i = 0; i < count; i++) {
+        by_bucket[next[bucket_of(hashes[i], bucket_count)]++] = i;
+    }
+
+    // ...and of the buckets by size, biggest first
+    long int *size_starts = calloc(max_size + 2, sizeof(long int));
+    for (b = 0; b < bucket_count; b++) {
+        size_starts[max_size - (bucket_starts[b + 1] - bucket_starts[b]) + 1]++;
+    }
+    long int s;
+    for (s = 0; s <= max_size; s++) {
+        size_starts[s + 1] += size_starts[s];
+    }
+    long int *buckets_in_order = malloc(bucket_count*sizeof(long int));
+    for (b = 0; b < bucket_count; b++) {
+        buckets_in_order[size_starts[max_size - (bucket_starts[b + 1] - bucket_starts[b])]++] = b;
+    }
+
+    char *taken = calloc(table->table_size + 1, 1);
+    long int *tried = malloc((max_size + 1)*sizeof(long int));
+    int ok = 1;
+    long int k;
+    for (k = 0; ok && (k < bucket_count); k++) {
+        b = buckets_in_order[k];
+        long int first = bucket_starts[b];
+        long int size = bucket_starts[b + 1] - first;
+        table->pilots[b] = 0;
+        if (size == 0) {
+            continue; // only empty buckets from here on
+        }
+
+        unsigned int pilot;
+        for (pilot = 0; pilot < FROZEN_MAX_PILOT; pilot++) {
+            long int j, placed;
+            for (placed = 0; placed < size; placed++) {
+                long int position = position_with_pilot(hashes[by_bucket[first + placed]], pilot, table);
+                if (taken[position]) {
+                    break;
+                }
+                taken[position] = 1; // so the bucket's later keys can't land on it too
+                tried[placed] = position;
+            }
+            if (placed == size) {
+                break;
+            }
+            for (j = 0; j < placed; j++) {
+                taken[tried[j]] = 0;
+            }
+        }
+        if (pilot == FROZEN_MAX_PILOT) {
+            ok = 0;
+            break;
+        }
+        table->pilots[b] = pilot;
+        long int j;
+        for (j = 0; j < size; j++) {
+            positions[by_bucket[first + j]] = tried[j];
+        }
+    }
+
+    // keys placed past count move into the holes left below it
+    if (ok) {
+        long int hole = 0;
+        long int position;
+        for (position = count; position < table->table_size; position++) {
+            if (taken[position]) {
+                while (taken[hole]) {
+                    hole++;
+                }
+                table->remap[position - count] = hole++;
+            }
+            else {
+                table->remap[position - count] = 0; // only reached by keys the table doesn't hold
+            }
+        }
+    }
+
+    free(bucket_starts);
+    free(by_bucket);
+    free(next);
+    free(size_starts);
+    free(buckets_in_order);
+    free(taken);
+    free(tried);
+    return ok ? 0 : -1;
+}
+
+/***
+* Copies a key or value into place, putting strings in the shared pool.
+***/
+static union Hashable copy_field(union Hashable field, hash_type type, char **pool) {
+    if (type == STRING) {
+        memcpy(*pool, field.str, field.len);
+        (*pool)[field.len] = '\0';
+        field.str = *pool;
+        *pool += field.len + 1;
+    }
+    return field;
+}
+
+/***
+* Builds a frozen table holding copies of count items, taken from a table hashing with family and seed.
+*   Returns NULL only if the items hold the same key twice, or an OBJECT value.
+***/
+FrozenHashTable *freeze_items(long int count, Item **items, hash_family family, unsigned long int seed) {
+    long int i;
+    for (i = 0; i < count; i++) {
+        if (items[i]->value_type == OBJECT) {
+            return NULL;
+        }
+    }
+
+    FrozenHashTable *table = malloc(sizeof(FrozenHashTable));
+    table->count = count;
+    table->bucket_count = count / FROZEN_BUCKET_SIZE + 1;
+    table->table_size = (long int)ceil(count * FROZEN_SLACK);
+    if (table->table_size < count) {
+        table->table_size = count;
+    }
+    table->hash_family = family;
+    table->seed = seed;
+    table->pilots = malloc(table->bucket_count*sizeof(unsigned int));
+    table->remap = malloc((table->table_size - count + 1)*sizeof(long int));
+
+    unsigned long int *hashes = malloc((count + 1)*sizeof(unsigned long int));
+    long int *positions = malloc((count + 1)*sizeof(long int));
+    int attempt;
+    int built = 0;
+    for (attempt = 0; !built && (attempt < FROZEN_MAX_ATTEMPTS); attempt++) {
+        table->mph_seed = random_seed();
+        for (i = 0; i < count; i++) {
+            hashes[i] = key_hash(items[i]->key, items[i]->key_type, table->mph_seed);
+        }
+        built = (find_pilots(count, hashes, positions, table) == 0);
+    }
+    free(hashes);
+    if (!built) {
+        free(positions);
+        free(table->pilots);
+        free(table->remap);
+        free(table);
+        return NULL;
+    }
+
+    unsigned long int string_bytes = 0;
+    for (i = 0; i < count; i++) {
+        if (items[i]->key_type == STRING) {
+            string_bytes += items[i]->key.len + 1;
+        }
+        if (items[i]->value_type == STRING) {
+            string_bytes += items[i]->value.len + 1;
+        }
+    }
+    table->hashes = malloc((count + 1)*sizeof(long int));
+    table->keys = malloc((count + 1)*sizeof(union Hashable));
+    table->key_types = malloc((count + 1)*sizeof(hash_type));
+    table->values = malloc((count + 1)*sizeof(union Hashable));
+    table->value_types = malloc((count + 1)*sizeof(hash_type));
+    table->strings = malloc(string_bytes + 1);
+
+    char *pool = table->strings;
+    for (i = 0; i < count; i++) {
+        long int position = positions[i];
+        if (position >= count) {
+            position = table->remap[position - count];
+        }
+        table->hashes[position] = items[i]->hash;
+        table->keys[position] = copy_field(items[i]->key, items[i]->key_type, &pool);
+        table->key_types[position] = items[i]->key_type;
+        table->values[position] = copy_field(items[i]->value, items[i]->value_type, &pool);
+        table->value_types[position] = items[i]->value_type;
+    }
+    free(positions);
+    return table;
+}
+
+static void collect_item(Item *item, void *arg) {
+    Item ***next = arg;
+    *(*next)++ = item;
+}
+
+/***
+* Builds a frozen table holding copies of everything in hashtable, which is left as it was.
+***/
+FrozenHashTable *freeze(HashTable *hashtable) {
+    Item **items = malloc((hashtable->load + 1)*sizeof(Item*));
+    Item **next = items;
+    for_each_item(hashtable, collect_item, &next);
+    FrozenHashTable *table = freeze_items(next - items, items, hashtable->hash_family, hashtable->seed);
+    free(items);
+    return table;
+}
+
+/***
+* Builds a frozen table holding copies of everything in a snapshot (see snapshot.c).
+***/
+FrozenHashTable *freeze_snapshot(Snapshot *snapshot) {
+    long int count = (long int)snapshot->header->item_count;
+    Item *entries = malloc((count + 1)*sizeof(Item));
+    Item **items = malloc((count + 1)*sizeof(Item*));
+    long int i;
+    for (i = 0; i < count; i++) {
+        snapshot_item(i, snapshot, &entries[i]);
+        items[i] = &entries[i];
+    }
+    FrozenHashTable *table = freeze_items(count, items, snapshot->header->hash_family, snapshot->header->seed);
+    free(entries);
+    free(items);
+    return table;
+}
+
+/***
+* Fills in *item with what's stored at a position returned by frozen_position.
+***/
+void frozen_item(long int position, FrozenHashTable *table, Item *item) {
+    item->hash = table->hashes[position];
+    item->key = table->keys[position];
+    item->key_type = table->key_types[position];
+    item->value = table->values[position];
+    item->value_type = table->value_types[position];
+}
+
+/***
+* Saves a frozen table as a snapshot file, which open_snapshot, snapshot_to_table
+*   and freeze_snapshot all read. Returns 0, or -1 (with errno set) on failure.
+***/
+int save_frozen_snapshot(FrozenHashTable *table, const char *path) {
+    Item *entries = malloc((table->count + 1)*sizeof(Item));
+    Item **items = malloc((table->count + 1)*sizeof(Item*));
+    long int i;
+    for (i = 0; i < table->count; i++) {
+        frozen_item(i, table, &entries[i]);
+        items[i] = &entries[i];
+    }
+    int result = write_snapshot(table->count, items, table->hash_family, table->seed, path);
+    free(entries);
+    free(items);
+    return result;
+}
+
+void frozen_free(FrozenHashTable *table) {
+    free(table->pilots);
+    free(table->remap);
+    free(table->hashes);
+    free(table->keys);
+    free(table->key_types);
+    free(table->values);
+    free(table->value_types);
+    free(table->strings);
+    free(table);
+}
+
+/***
+* Returns the position of the given key, or -1 if the table doesn't hold it.
+***/
+long int frozen_position(union Hashable key, hash_type key_type, FrozenHashTable *table) {
+    if (table->count == 0) {
+        return -1;
+    }
+    unsigned long int hash = key_hash(key, key_type, table->mph_seed);
+    long int position = position_with_pilot(hash, table->pilots[bucket_of(hash, table->bucket_count)], table);
+    if (position >= table->count) {
+        position = table->remap[position - table->count];
+    }
+
+    // a perfect hash sends keys that aren't in the table somewhere too, so check it's the right one
+    if (table->key_types[position] != key_type) {
+        return -1;
+    }
+    switch (key_type) {
+        case INTEGER:
+            return (table->keys[position].i == key.i) ? position : -1;
+        case DOUBLE:
+            return (table->keys[position].f == key.f) ? position : -1;
+        case STRING:
+            return ((table->keys[position].len == key.len) &&
+                    (memcmp(table->keys[position].str, key.str, key.len) == 0)) ? position : -1;
+        default:
+            return -1;
+    }
+}
+
+/***
+* Looks up the given key. If found, fills in *found (whose strings belong to the table) and returns 1;
+*   otherwise returns 0.
+***/
+int frozen_lookup(union Hashable key, hash_type key_type, FrozenHashTable *table, Item *found) {
+    long int position = frozen_position(key, key_type, table);
+    if (position < 0) {
+        return 0;
+    }
+    frozen_item(position, table, found);
+    return 1;
+}
@@ -0,0 +1,46 @@
+#include "hashtable.h"
+
+/***
+* Definitions
+***/
+
+// Average number of keys per bucket of pilots -- more means a smaller table that takes longer to build
+#define FROZEN_BUCKET_SIZE 4
+// Positions are searched in a table this much bigger than the item count, then remapped down to it
+#define FROZEN_SLACK 1.01
+// A bucket that finds no pilot in this many tries restarts the build with a new seed
+#define FROZEN_MAX_PILOT (1L << 20)
+#define FROZEN_MAX_ATTEMPTS 16
+
+// An immutable table indexed by a minimal perfect hash: every key maps straight
+//   to its own position in dense, parallel key and value arrays
+typedef struct frozen_hashtable {
+    long int count;
+    long int bucket_count;
+    long int table_size;        // count * FROZEN_SLACK -- positions past count are remapped
+    unsigned long int mph_seed; // for the keys' own hashes, which the perfect hash is built on
+    unsigned int *pilots;       // per bucket: which of the position functions its keys use
+    long int *remap;            // [position - count]: where keys placed past count really live
+    long int *hashes;           // the keys' hashes from the original table, kept for saving as a snapshot
+    union Hashable *keys;
+    hash_type *key_types;
+    union Hashable *values;
+    hash_type *value_types;
+    char *strings;              // every key and value string, NUL-terminated
+    hash_family hash_family;    // of the original table
+    unsigned long int seed;
+} FrozenHashTable;
+
+/***
+* Function declarations
+*   A FrozenHashTable is never changed after freeze returns it, so any number
+*   of threads may look keys up in it at once.
+***/
+FrozenHashTable *freeze(HashTable *hashtable);
+FrozenHashTable *freeze_items(long int count, Item **items, hash_family family, unsigned long int seed);
+FrozenHashTable *freeze_snapshot(Snapshot *snapshot);
+int save_frozen_snapshot(FrozenHashTable *table, const char *path);
+void frozen_free(FrozenHashTable *table);
+long int frozen_position(union Hashable key, hash_type key_type, FrozenHashTable *table);
+void frozen_item(long int position, FrozenHashTable *table, Item *item);
+int frozen_lookup(union Hashable key, hash_type key_type, FrozenHashTable *table, Item *found);
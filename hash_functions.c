@@ -0,0 +1,184 @@
+#include "hashtable.h"
+#include <time.h>
+
+/***
+* Built-in hash functions
+*   Used whenever a key's hash is not supplied by the caller (hash == LONG_MAX).
+*   Each hashtable picks a family and a seed when it is created, so two tables
+*   hash the same key differently and crafted inputs can't force collisions.
+*
+*   WYHASH:   wyhash-style multiply-fold for strings, splitmix64 finalizer
+*             for integers and for the bit pattern of doubles. The default.
+*   FNV1A:    byte-at-a-time FNV-1a for every key type. Simple and slower.
+*   IDENTITY: the original placeholders -- an integer hashes to itself, a double
+*             to its floor and a string to its length. Kept for experiments.
+***/
+
+static const unsigned long int wy_secret[4] = {
+    0xa0761d6478bd642fUL, 0xe7037ed1a0b428dbUL, 0x8ebc6af09c88c6e3UL, 0x589965cc75374cc3UL
+};
+
+static unsigned long int wymix(unsigned long int a, unsigned long int b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (unsigned long int)product ^ (unsigned long int)(product >> 64);
+}
+
+static unsigned long int read8(const unsigned char *p) {
+    unsigned long int v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static unsigned long int read4(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+unsigned long int hash_string_wyhash(const char *str, size_t len, unsigned long int seed) {
+    const unsigned char *p = (const unsigned char *)str;
+    unsigned long int a, b;
+
+    seed ^= wymix(seed ^ wy_secret[0], wy_secret[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (read4(p) << 32) | read4(p + ((len >> 3) << 2));
+            b = (read4(p + len - 4) << 32) | read4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0) {
+            a = ((unsigned long int)p[0] << 16) | ((unsigned long int)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        size_t i = len;
+        if (i > 48) {
+            unsigned long int see1 = seed, see2 = seed;
+            do {
+                seed = wymix(read8(p) ^ wy_secret[1], read8(p + 8) ^ seed);
+                see1 = wymix(read8(p + 16) ^ wy_secret[2], read8(p + 24) ^ see1);
+                see2 = wymix(read8(p + 32) ^ wy_secret[3], read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wymix(read8(p) ^ wy_secret[1], read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = read8(p + i - 16);
+        b = read8(p + i - 8);
+    }
+
+    __uint128_t product = (__uint128_t)(a ^ wy_secret[1]) * (b ^ seed);
+    a = (unsigned long int)product;
+    b = (unsigned long int)(product >> 64);
+    return wymix(a ^ wy_secret[0] ^ len, b ^ wy_secret[1]);
+}
+
+unsigned long int hash_integer_mix(unsigned long int i, unsigned long int seed) {
+    unsigned long int x = i ^ seed;
+    x += 0x9e3779b97f4a7c15UL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+    return x ^ (x >> 31);
+}
+
+/***
+* Equal doubles must hash equally, so -0.0 is folded into 0.0 before hashing its bits.
+***/
+static unsigned long int double_bits(double f) {
+    unsigned long int bits;
+    if (f == 0.0) {
+        f = 0.0;
+    }
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+unsigned long int hash_bytes_fnv1a(const void *data, size_t len, unsigned long int seed) {
+    const unsigned char *p = data;
+    unsigned long int h = 0xcbf29ce484222325UL ^ seed;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3UL;
+    }
+    return h;
+}
+
+long int calculate_hash(union Hashable key, hash_type key_type, HashTable *hashtable) {
+    return hash_with_family(key, key_type, hashtable->hash_family, hashtable->seed);
+}
+
+/***
+* Hashes a key with the given family and seed -- for tables other than HashTable
+*   (see concurrent_hashtable.c) that pick their hash function the same way.
+***/
+long int hash_with_family(union Hashable key, hash_type key_type, hash_family family, unsigned long int seed) {
+    unsigned long int bits;
+
+    switch (family) {
+        case WYHASH:
+            switch (key_type) {
+                case INTEGER:
+                    return (long int)hash_integer_mix((unsigned long int)key.i, seed);
+                case DOUBLE:
+                    return (long int)hash_integer_mix(double_bits(key.f), seed);
+                case STRING:
+                    return (long int)hash_string_wyhash(key.str, key.len, seed);
+                default:
+                    return 0;
+            }
+        case FNV1A:
+            switch (key_type) {
+                case INTEGER:
+                    return (long int)hash_bytes_fnv1a(&key.i, sizeof(key.i), seed);
+                case DOUBLE:
+                    bits = double_bits(key.f);
+                    return (long int)hash_bytes_fnv1a(&bits, sizeof(bits), seed);
+                case STRING:
+                    return (long int)hash_bytes_fnv1a(key.str, key.len, seed);
+                default:
+                    return 0;
+            }
+        case IDENTITY:
+        default:
+            switch (key_type) {
+                case INTEGER:
+                    return key.i;
+                case DOUBLE:
+                    return floor(key.f);
+                case STRING:
+                    return key.len;
+                default:
+                    return 0;
+            }
+    }
+}
+
+/***
+* Picks a per-table seed, from the OS if possible
+***/
+unsigned long int random_seed(void) {
+    static unsigned long int counter = 0;
+    unsigned long int seed = 0;
+
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (urandom != NULL) {
+        if (fread(&seed, sizeof(seed), 1, urandom) != 1) {
+            seed = 0;
+        }
+        fclose(urandom);
+    }
+    if (seed == 0) {
+        seed = hash_integer_mix((unsigned long int)time(NULL) ^ (unsigned long int)clock(), (unsigned long int)&counter);
+    }
+    counter++;
+    return hash_integer_mix(seed, counter);
+}
@@ -1,13 +1,72 @@
+#include <stdarg.h>
 #include "hashtable.h"
 
+void (*release_object)(void *object) = NULL;
+
 /***
 * Creates a new hash table, with all bins initialized to NULL
 ***/
 HashTable *init(long int size, double max_load_proportion) {
+    return init_with_options(size, max_load_proportion, default_table_options());
+}
+
+TableOptions default_table_options(void) {
+    TableOptions options;
+    options.storage = CHAINED;
+    options.hash_family = WYHASH;
+    options.seed = 0;
+    options.power_of_two_size = 0;
+    options.incremental_resize = 0;
+    options.collect_stats = 0;
+    options.min_load_proportion = 0;
+    return options;
+}
+
+/***
+* Creates a new hash table using the given storage layout (see TableOptions)
+***/
+HashTable *init_with_options(long int size, double max_load_proportion, TableOptions options) {
     HashTable *hashtable = malloc(sizeof(HashTable));
+    hashtable->power_of_two_size = options.power_of_two_size;
+    if (options.power_of_two_size) {
+        size = round_up_to_power_of_two(size);
+    }
     hashtable->size = size;
+    hashtable->bin_shift = bin_shift_for_size(hashtable);
     hashtable->max_load_proportion = max_load_proportion;
+    hashtable->min_load_proportion = options.min_load_proportion;
     hashtable->load = 0;
+    hashtable->storage = options.storage;
+    hashtable->hash_family = options.hash_family;
+    hashtable->seed = (options.seed != 0) ? options.seed : random_seed();
+    hashtable->bin_list = NULL;
+    hashtable->slots = NULL;
+    hashtable->control = NULL;
+    hashtable->items = NULL;
+    hashtable->incremental_resize = options.incremental_resize;
+    hashtable->old_bin_list = NULL;
+    hashtable->old_size = 0;
+    hashtable->old_bin_shift = 0;
+    hashtable->rehash_index = 0;
+    hashtable->tombstones = 0;
+    hashtable->chunks = NULL;
+    hashtable->free_nodes = NULL;
+    hashtable->next_chunk_size = NODE_CHUNK_MIN;
+    hashtable->string_items = 0;
+    hashtable->stats = NULL;
+    if (options.collect_stats) {
+        enable_stats(hashtable);
+    }
+
+    if (options.storage == OPEN_ADDRESSING) {
+        hashtable->slots = allocate_slots(size);
+        return hashtable;
+    }
+    if (options.storage == SWISS_TABLE) {
+        swiss_table_allocate(size, hashtable);
+        return hashtable;
+    }
+
     hashtable->bin_list = malloc(size*sizeof(Node*));
 
     long int i;
@@ -19,36 +78,48 @@ HashTable *init(long int size, double max_load_proportion) {
     return hashtable;
 }
 
-long int calculate_hash(union Hashable key, hash_type key_type) {
-    long int hash;
-    switch (key_type) {
-        case INTEGER:
-            hash = key.i;
-            break;
-        case DOUBLE:
-            hash = floor(key.f);
-            break;
-        case STRING:
-            hash = strlen(key.str);
-            break;
-        default:
-            hash = 0;
-            break;
+/***
+* Power-of-two sizing helpers
+*   Sizes are at least 2, so the Fibonacci shift is always less than 64.
+***/
+long int round_up_to_power_of_two(long int size) {
+    long int rounded = 2;
+    while (rounded < size) {
+        rounded *= 2;
     }
-    return hash;
-     // TODO actually hash the keys
+    return rounded;
 }
 
-long int calculate_bin_index(long int hash, long int size) {
-    long int bin_index;
-    if (hash < 0) {
-        bin_index = (hash % size) + size;
+int bin_shift_for_size(HashTable *hashtable) {
+    if (!hashtable->power_of_two_size) {
+        return 0;
     }
-    else if (hash == 0) {
-        bin_index = 0;
+    int shift = 64;
+    long int size;
+    for (size = hashtable->size; size > 1; size /= 2) {
+        shift--;
     }
-    else {
-        bin_index = hash % size;
+    return shift;
+}
+
+/***
+* Maps a hash to a bin.
+*   Power-of-two tables use Fibonacci hashing: the top bits of hash * 2^64/phi.
+*   The multiply mixes every bit of the hash into the index, so weak hashes
+*   (sequential integers, multiples of the size) still spread evenly, and
+*   there's no integer division on the hot path.
+***/
+long int calculate_bin_index(long int hash, HashTable *hashtable) {
+    return bin_index_for_size(hash, hashtable->size, hashtable->bin_shift);
+}
+
+long int bin_index_for_size(long int hash, long int size, int bin_shift) {
+    if (bin_shift != 0) {
+        return (long int)(((unsigned long int)hash * 0x9e3779b97f4a7c15UL) >> bin_shift);
+    }
+    long int bin_index = hash % size;
+    if (bin_index < 0) {
+        bin_index += size;
     }
     return bin_index;
 }
@@ -68,7 +139,9 @@ int hashable_equal(union Hashable h1, hash_type type1, union Hashable h2, hash_t
             case DOUBLE:
                 return (h1.f == h2.f);
             case STRING:
-                return (strcmp(h1.str, h2.str) == 0);
+                return (h1.len == h2.len) && (memcmp(h1.str, h2.str, h1.len) == 0);
+            case OBJECT:
+                return (h1.object == h2.object);
             default:
                 return 0;
         }
@@ -86,18 +159,33 @@ HashTable *add(long int hash, union Hashable key, hash_type key_type, union Hash
     }
 
     if (hash == LONG_MAX) {
-        hash = calculate_hash(key, key_type);
+        hash = calculate_hash(key, key_type, hashtable);
     }
 
-    Item *item = malloc(sizeof(Item));
-    item->hash = hash;
-    item->key = key;
-    item->key_type = key_type;
-    item->value = value;
-    item->value_type = value_type;
-
-    hashtable = add_item_to_table(item, hashtable);
+    long int old_load = hashtable->load;
+    Item item = {hash, key, key_type, value, value_type};
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        open_addressing_add(&item, hashtable);
+    }
+    else if (hashtable->storage == SWISS_TABLE) {
+        swiss_table_add(&item, hashtable);
+    }
+    else {
+        if (hashtable->old_bin_list != NULL) {
+            // the key may still be in the old bin array -- move its bin over,
+            // so the new array is the only place the key can be
+            rehash_step(hashtable);
+            if (hashtable->old_bin_list != NULL) {
+                migrate_bin(bin_index_for_size(hash, hashtable->old_size, hashtable->old_bin_shift), hashtable);
+            }
+        }
+        hashtable = add_item_to_table(&item, hashtable);
+    }
 
+    if (hashtable->stats != NULL) {
+        hashtable->stats->adds++;
+        hashtable->stats->updates += (hashtable->load == old_load);
+    }
     return hashtable;
 }
 
@@ -105,7 +193,7 @@ HashTable *add(long int hash, union Hashable key, hash_type key_type, union Hash
 * Determines which bin a new item should be added to.
 ***/
 HashTable *add_item_to_table(Item *item, HashTable *hashtable) {
-    int bin_index = calculate_bin_index(item->hash, hashtable->size);
+    long int bin_index = calculate_bin_index(item->hash, hashtable);
 
     Node *bin_list = hashtable->bin_list[bin_index];
     hashtable->bin_list[bin_index] = add_item_to_bin(item, bin_list, hashtable);
@@ -114,60 +202,86 @@ HashTable *add_item_to_table(Item *item, HashTable *hashtable) {
 }
 
 /***
-* Adds item to the linked list at the given bin
-*   If the new item has the same key as an existing item, the value is updated.
+* Copies item into the linked list at the given bin
+*   If the new item has the same key as an existing item, the value is updated in place.
+*   Otherwise the item goes into a new Node from the hashtable's node pool.
 ***/
 Node *add_item_to_bin(Item *item, Node *bin_list, HashTable *hashtable) {
     Node *head = bin_list;
-    Node *prev_node;
+    Node *prev_node = NULL;
     Node *current_node = bin_list;
-    if (current_node == NULL) {
-        Node *new = malloc(sizeof(Node));
-        new->item = item;
-        new->next = current_node;
-        hashtable->load++;
-        return new;
-    }
-    else {
-        while (current_node != NULL) {
-            Item *current_item = current_node->item;
-            if (hashable_equal(current_item->key, current_item->key_type, item->key, item->key_type)) {
-                // keys are equal -- replace
-                free_item(current_item);
-                current_node->item = item;
-                return head;
-            }
-            prev_node = current_node;
-            current_node = current_node->next;
+    while (current_node != NULL) {
+        Item *current_item = &current_node->item;
+        if (item_has_key(current_item, item->hash, item->key, item->key_type)) {
+            // keys are equal -- replace
+            hashtable->string_items += item_owns_strings(item) - item_owns_strings(current_item);
+            free_item_contents(current_item);
+            *current_item = *item;
+            return head;
         }
-        Node *new = malloc(sizeof(Node));
-        new->item = item;
-        new->next = current_node;
-        prev_node->next = new;
-        hashtable->load++;
-        return head;
+        prev_node = current_node;
+        current_node = current_node->next;
+    }
+
+    Node *new = allocate_node(hashtable);
+    new->item = *item;
+    new->next = NULL;
+    hashtable->load++;
+    hashtable->string_items += item_owns_strings(item);
+
+    if (prev_node == NULL) {
+        return new;
     }
+    prev_node->next = new;
+    return head;
 }
 
 /***
 * Returns item associated with the given hash and key, or NULL if no such item exists.
 ***/
-Item *lookup_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
-    long int bin_index = calculate_bin_index(hash, hashtable->size);
+static Item *find_item(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        return open_addressing_lookup(hash, key, key_type, hashtable);
+    }
+    if (hashtable->storage == SWISS_TABLE) {
+        return swiss_table_lookup(hash, key, key_type, hashtable);
+    }
+
+    if (hashtable->old_bin_list != NULL) {
+        rehash_step(hashtable);
+        if (hashtable->old_bin_list != NULL) {
+            long int old_index = bin_index_for_size(hash, hashtable->old_size, hashtable->old_bin_shift);
+            Item *old_item = lookup_in_bin(hash, key, key_type, hashtable->old_bin_list[old_index]);
+            if (old_item != NULL) {
+                return old_item;
+            }
+        }
+    }
 
-    Node *current_node = hashtable->bin_list[bin_index];
+    long int bin_index = calculate_bin_index(hash, hashtable);
+    return lookup_in_bin(hash, key, key_type, hashtable->bin_list[bin_index]);
+}
 
-    if (current_node == NULL) {
-        return NULL;
+Item *lookup_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    Item *found = find_item(hash, key, key_type, hashtable);
+    if (hashtable->stats != NULL) {
+        hashtable->stats->lookups++;
+        hashtable->stats->lookup_hits += (found != NULL);
     }
-    else {
-        while (current_node != NULL) {
-            Item *current_item = current_node->item;
-            if (hashable_equal(current_item->key, current_item->key_type, key, key_type)) {
-                return current_item;
-            }
-            current_node = current_node->next;
+    return found;
+}
+
+/***
+* Returns item with the given key from the linked list at a bin, or NULL if no such item exists.
+***/
+Item *lookup_in_bin(long int hash, union Hashable key, hash_type key_type, Node *bin_list) {
+    Node *current_node = bin_list;
+    while (current_node != NULL) {
+        Item *current_item = &current_node->item;
+        if (item_has_key(current_item, hash, key, key_type)) {
+            return current_item;
         }
+        current_node = current_node->next;
     }
     return NULL;
 }
@@ -176,22 +290,54 @@ Item *lookup_by_hash(long int hash, union Hashable key, hash_type key_type, Hash
 * Returns item associated with the given key, or NULL if no such item exists.
 ***/
 Item *lookup(union Hashable key, hash_type key_type, HashTable *hashtable) {
-    long int hash = calculate_hash(key, key_type);
+    long int hash = calculate_hash(key, key_type, hashtable);
     return lookup_by_hash(hash, key, key_type, hashtable);
 }
 
+static void count_remove(int hit, HashTable *hashtable) {
+    if (hashtable->stats != NULL) {
+        hashtable->stats->removes++;
+        hashtable->stats->remove_hits += hit;
+    }
+}
+
 /***
 * Removes and returns item with given hash and key from hashtable, or NULL if no such item exists.
+*   The caller must free the item with free_item.
 ***/
-Item *remove_item_from_table_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
-    long int bin_index = calculate_bin_index(hash, hashtable->size);
+static Item *take_item(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        return open_addressing_remove(hash, key, key_type, hashtable);
+    }
+    if (hashtable->storage == SWISS_TABLE) {
+        return swiss_table_remove(hash, key, key_type, hashtable);
+    }
 
-    Node *bin_list = hashtable->bin_list[bin_index];
+    Item *removed = NULL;
+    if (hashtable->old_bin_list != NULL) {
+        rehash_step(hashtable);
+        if (hashtable->old_bin_list != NULL) {
+            long int old_index = bin_index_for_size(hash, hashtable->old_size, hashtable->old_bin_shift);
+            removed = remove_item_from_bin(hash, key, key_type, &hashtable->old_bin_list[old_index]);
+        }
+    }
+    if (removed == NULL) {
+        long int bin_index = calculate_bin_index(hash, hashtable);
+        removed = remove_item_from_bin(hash, key, key_type, &hashtable->bin_list[bin_index]);
+    }
 
-    Item *removed = lookup_by_hash(hash, key, key_type, hashtable);
     if (removed != NULL) {
-        hashtable->bin_list[bin_index] = remove_item_from_bin(key, key_type, bin_list);
         hashtable->load--;
+        hashtable->string_items -= item_owns_strings(removed);
+    }
+    return removed;
+}
+
+Item *remove_item_from_table_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    Item *removed = take_item(hash, key, key_type, hashtable);
+    count_remove(removed != NULL, hashtable);
+    if (removed != NULL) {
+        shrink_if_sparse(hashtable); // removed items live in pool nodes, which resizing leaves alone
     }
     return removed;
 }
@@ -200,62 +346,464 @@ Item *remove_item_from_table_by_hash(long int hash, union Hashable key, hash_typ
 * Removes and returns item with given key from hashtable, or NULL if no such item exists.
 ***/
 Item *remove_item_from_table(union Hashable key, hash_type key_type, HashTable *hashtable) {
-    long int hash = calculate_hash(key, key_type);
+    long int hash = calculate_hash(key, key_type, hashtable);
     return remove_item_from_table_by_hash(hash, key, key_type, hashtable);
 }
 
 /***
-* Removes item from the linked list at the given bin
-*   If the new item has the same key as an existing item, the value is updated.
+* Unlinks the node holding key from the linked list at *bin, in a single walk of the list.
+*   Returns its item, or NULL if the key is not in the list.
+*   The node itself stays allocated until its item is passed to free_item.
 ***/
-Node *remove_item_from_bin(union Hashable key, hash_type key_type, Node *bin_list) {
-    Node *head = bin_list;
-    Node *prev_node = bin_list;
-    Node *current_node = bin_list;
-    if (current_node != NULL) {
-        while (current_node != NULL) {
-            Item *current_item = current_node->item;
-            if (hashable_equal(current_item->key, current_item->key_type, key, key_type)) {
-                if (current_node == head) {
-                    Node *temp = current_node->next;
-                    free(current_node);
-                    return temp;
-                }
-                else {
-                    prev_node->next = current_node->next;
-                    free(current_node);
-                    return head;
-                }
+Item *remove_item_from_bin(long int hash, union Hashable key, hash_type key_type, Node **bin) {
+    Node **link = bin;
+    while (*link != NULL) {
+        Node *current_node = *link;
+        if (item_has_key(&current_node->item, hash, key, key_type)) {
+            *link = current_node->next;
+            return &current_node->item;
+        }
+        link = &current_node->next;
+    }
+    return NULL;
+}
+
+/***
+* Removes and frees the item with given hash and key, without handing it back to the caller.
+*   Returns 1 if the key was removed, 0 if it was not in the hashtable.
+***/
+int discard_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    int discarded;
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        discarded = open_addressing_discard(hash, key, key_type, hashtable);
+    }
+    else if (hashtable->storage == SWISS_TABLE) {
+        discarded = swiss_table_discard(hash, key, key_type, hashtable);
+    }
+    else {
+        Item *removed = take_item(hash, key, key_type, hashtable);
+        discarded = (removed != NULL);
+        if (removed != NULL) {
+            free_item(removed, hashtable);
+        }
+    }
+    count_remove(discarded, hashtable);
+    if (discarded) {
+        shrink_if_sparse(hashtable);
+    }
+    return discarded;
+}
+
+int discard(union Hashable key, hash_type key_type, HashTable *hashtable) {
+    long int hash = calculate_hash(key, key_type, hashtable);
+    return discard_by_hash(hash, key, key_type, hashtable);
+}
+
+/***
+* Doubles the number of bins in the hashtable.
+*   All items are relinked into the new bin array; the hashtable keeps its
+*   settings (storage, hash function and seed), so the same pointer is returned.
+*   With incremental_resize, only the new bin array is set up here -- items
+*   move over a few bins at a time, on each later add, lookup and remove.
+***/
+HashTable *resize(HashTable *hashtable) {
+    if (hashtable->storage != CHAINED || !hashtable->incremental_resize) {
+        return resize_to(2*hashtable->size, hashtable);
+    }
+
+    // a resize still in progress has to finish before the next one can start
+    double start = (hashtable->stats != NULL) ? stats_clock() : 0;
+    finish_rehash(hashtable);
+    begin_rehash(2*hashtable->size, hashtable);
+    if (hashtable->stats != NULL) {
+        record_resize(start, hashtable); // the moves spread over later operations aren't timed
+    }
+    return hashtable;
+}
+
+/***
+* Rebuilds the hashtable with the given number of bins (rounded up to a power of two if
+*   the table uses power_of_two_size), moving every item straight away.
+***/
+HashTable *resize_to(long int size, HashTable *hashtable) {
+    if (hashtable->power_of_two_size) {
+        size = round_up_to_power_of_two(size);
+    }
+    double start = (hashtable->stats != NULL) ? stats_clock() : 0;
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        hashtable = open_addressing_resize(size, hashtable);
+    }
+    else if (hashtable->storage == SWISS_TABLE) {
+        hashtable = swiss_table_resize(size, hashtable);
+    }
+    else {
+        finish_rehash(hashtable);
+        begin_rehash(size, hashtable);
+        finish_rehash(hashtable);
+    }
+    if (hashtable->stats != NULL) {
+        record_resize(start, hashtable);
+    }
+    return hashtable;
+}
+
+/***
+* Shrinking
+*   With a min_load_proportion set, a remove that leaves the table emptier than that
+*   halves its size until its load sits below the midpoint of min_load_proportion and
+*   max_load_proportion. Halving stops short of that midpoint, so a table that has
+*   just shrunk needs to nearly double its load before it grows again.
+***/
+static long int smallest_size(HashTable *hashtable) {
+    return (hashtable->storage == SWISS_TABLE) ? SWISS_GROUP_WIDTH : SHRINK_MIN_SIZE;
+}
+
+void shrink_if_sparse(HashTable *hashtable) {
+    if ((hashtable->min_load_proportion <= 0) || (hashtable->size <= smallest_size(hashtable)) ||
+        ((double)hashtable->load / (double)hashtable->size >= hashtable->min_load_proportion)) {
+        return;
+    }
+    double target = (hashtable->min_load_proportion + hashtable->max_load_proportion) / 2;
+    long int size = hashtable->size;
+    while ((size / 2 >= smallest_size(hashtable)) && ((double)(hashtable->load + 1) / (double)(size / 2) <= target)) {
+        size /= 2;
+    }
+    if (size < hashtable->size) {
+        resize_to(size, hashtable);
+    }
+}
+
+/***
+* Incremental resizing (CHAINED only)
+*   While a resize is in progress, old_bin_list holds the previous bin array.
+*   Bins below rehash_index have been moved to bin_list already; bins above it
+*   may still hold items, so lookups and removes check both arrays.
+***/
+
+/***
+* Swaps in an empty bin array of the given size, keeping the current one as old_bin_list.
+***/
+void begin_rehash(long int size, HashTable *hashtable) {
+    hashtable->old_bin_list = hashtable->bin_list;
+    hashtable->old_size = hashtable->size;
+    hashtable->old_bin_shift = hashtable->bin_shift;
+    hashtable->rehash_index = 0;
+
+    hashtable->size = size;
+    hashtable->bin_shift = bin_shift_for_size(hashtable);
+    hashtable->bin_list = calloc(hashtable->size, sizeof(Node*));
+}
+
+/***
+* Moves every item in one bin of the old bin array into the new bin array.
+***/
+void migrate_bin(long int old_index, HashTable *hashtable) {
+    Node *current_node = hashtable->old_bin_list[old_index];
+    while (current_node != NULL) {
+        Node *temp = current_node->next;
+        long int bin_index = calculate_bin_index(current_node->item.hash, hashtable);
+        current_node->next = hashtable->bin_list[bin_index];
+        hashtable->bin_list[bin_index] = current_node;
+        current_node = temp;
+    }
+    hashtable->old_bin_list[old_index] = NULL;
+}
+
+/***
+* Moves up to REHASH_STEP_BINS non-empty bins (skipping at most REHASH_EMPTY_VISITS
+*   empty ones), so the cost of a resize is spread over many operations.
+***/
+void rehash_step(HashTable *hashtable) {
+    int moved = 0;
+    int empty_visits = 0;
+    while ((hashtable->rehash_index < hashtable->old_size) &&
+           (moved < REHASH_STEP_BINS) && (empty_visits < REHASH_EMPTY_VISITS)) {
+        if (hashtable->old_bin_list[hashtable->rehash_index] == NULL) {
+            empty_visits++;
+        }
+        else {
+            migrate_bin(hashtable->rehash_index, hashtable);
+            moved++;
+        }
+        hashtable->rehash_index++;
+    }
+    if (hashtable->rehash_index == hashtable->old_size) {
+        free(hashtable->old_bin_list);
+        hashtable->old_bin_list = NULL;
+    }
+}
+
+/***
+* Completes any resize in progress.
+***/
+void finish_rehash(HashTable *hashtable) {
+    while (hashtable->old_bin_list != NULL) {
+        rehash_step(hashtable);
+    }
+}
+
+/***
+* Bulk loading
+*   reserve grows the table once, so count items fit without any intermediate resizes.
+*   add_many then hashes every key in one pass and places each pair directly.
+***/
+HashTable *reserve(long int count, HashTable *hashtable) {
+    long int size = hashtable->size;
+    while ((double)(count + 1) / (double)size > hashtable->max_load_proportion) {
+        size *= 2;
+    }
+    if (size != hashtable->size) {
+        hashtable = resize_to(size, hashtable);
+    }
+    finish_rehash(hashtable);
+    return hashtable;
+}
+
+/***
+* Rebuilds the hashtable at the smallest size that fits its items within max_load_proportion,
+*   in freshly allocated storage. A chained table's nodes are copied into one new chunk,
+*   bin by bin, so each chain sits in neighbouring memory, and the old, scattered chunks
+*   are freed. Other storages free the nodes that held removed items.
+*   Removed items that haven't been passed to free_item yet still live in pool nodes,
+*   so the pool is only replaced when there are none.
+***/
+HashTable *compact(HashTable *hashtable) {
+    finish_rehash(hashtable);
+    long int size = (long int)((double)(hashtable->load + 1) / hashtable->max_load_proportion) + 1;
+    if (size < smallest_size(hashtable)) {
+        size = smallest_size(hashtable);
+    }
+    hashtable = resize_to(size, hashtable);
+
+    long int outstanding = nodes_in_use(hashtable) - ((hashtable->storage == CHAINED) ? hashtable->load : 0);
+    if (outstanding != 0) {
+        return hashtable;
+    }
+    if (hashtable->storage != CHAINED) {
+        free_node_pool(hashtable);
+        hashtable->next_chunk_size = NODE_CHUNK_MIN;
+        return hashtable;
+    }
+
+    NodeChunk *old_chunks = hashtable->chunks;
+    hashtable->chunks = NULL;
+    hashtable->free_nodes = NULL;
+    hashtable->next_chunk_size = (hashtable->load > NODE_CHUNK_MIN) ? hashtable->load : NODE_CHUNK_MIN;
+
+    long int i;
+    for (i = 0; i < hashtable->size; i++) {
+        Node **link = &hashtable->bin_list[i];
+        while (*link != NULL) {
+            Node *node = allocate_node(hashtable);
+            *node = **link;
+            *link = node;
+            link = &node->next;
+        }
+    }
+
+    while (old_chunks != NULL) {
+        NodeChunk *temp = old_chunks->next;
+        free(old_chunks);
+        old_chunks = temp;
+    }
+    return hashtable;
+}
+
+/***
+* Adds count key, value pairs from parallel arrays.
+*   hashes may be NULL, or hold LONG_MAX for keys that should use the built-in hash function.
+*   Like add, the hashtable takes ownership of any strings in keys and values.
+***/
+HashTable *add_many(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                    union Hashable *values, hash_type *value_types, HashTable *hashtable) {
+    hashtable = reserve(hashtable->load + count, hashtable);
+
+    long int *computed = malloc(count*sizeof(long int));
+    long int i;
+    for (i = 0; i < count; i++) {
+        if ((hashes == NULL) || (hashes[i] == LONG_MAX)) {
+            computed[i] = calculate_hash(keys[i], key_types[i], hashtable);
+        }
+        else {
+            computed[i] = hashes[i];
+        }
+    }
+
+    long int old_load = hashtable->load;
+    for (i = 0; i < count; i++) {
+        Item item = {computed[i], keys[i], key_types[i], values[i], value_types[i]};
+        switch (hashtable->storage) {
+            case OPEN_ADDRESSING:
+                open_addressing_add(&item, hashtable);
+                break;
+            case SWISS_TABLE:
+                swiss_table_add(&item, hashtable);
+                break;
+            default:
+                add_item_to_table(&item, hashtable);
+                break;
+        }
+    }
+    free(computed);
+    if (hashtable->stats != NULL) {
+        hashtable->stats->adds += count;
+        hashtable->stats->updates += count - (hashtable->load - old_load);
+    }
+    return hashtable;
+}
+
+/***
+* Creates a hashtable sized for count items, and fills it from parallel arrays (see add_many).
+***/
+HashTable *build_table(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                       union Hashable *values, hash_type *value_types,
+                       double max_load_proportion, TableOptions options) {
+    long int size = (long int)((double)count / max_load_proportion) + 1;
+    HashTable *hashtable = init_with_options(size, max_load_proportion, options);
+    return add_many(count, hashes, keys, key_types, values, value_types, hashtable);
+}
+
+
+/***
+* Batched lookups and removes
+*   Keys are processed in windows of BATCH_WINDOW. The bins for a whole window are
+*   prefetched before any keys are compared, so the cache misses for different keys
+*   overlap instead of being paid one after another.
+***/
+void prefetch_bin(long int hash, HashTable *hashtable) {
+    switch (hashtable->storage) {
+        case OPEN_ADDRESSING:
+            __builtin_prefetch(&hashtable->slots[calculate_bin_index(hash, hashtable)]);
+            break;
+        case SWISS_TABLE:
+            swiss_table_prefetch(hash, hashtable);
+            break;
+        default:
+            __builtin_prefetch(&hashtable->bin_list[calculate_bin_index(hash, hashtable)]);
+            break;
+    }
+}
+
+/***
+* Hashes keys start..end-1 into window, and prefetches their bins.
+*   hashes may be NULL, or hold LONG_MAX for keys that should use the built-in hash
+*   function; it is only read, so the caller's array is left as it was.
+***/
+static void hash_window(long int start, long int end, long int *hashes, union Hashable *keys,
+                        hash_type *key_types, long int *window, HashTable *hashtable) {
+    long int i;
+    for (i = start; i < end; i++) {
+        if ((hashes == NULL) || (hashes[i] == LONG_MAX)) {
+            window[i - start] = calculate_hash(keys[i], key_types[i], hashtable);
+        }
+        else {
+            window[i - start] = hashes[i];
+        }
+        prefetch_bin(window[i - start], hashtable);
+    }
+}
+
+/***
+* Looks up count keys, storing each item (or NULL) in found.
+*   hashes may be NULL, or hold LONG_MAX for keys that should use the built-in hash function.
+***/
+void lookup_many(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                 Item **found, HashTable *hashtable) {
+    long int window[BATCH_WINDOW];
+    long int start, i;
+    for (start = 0; start < count; start += BATCH_WINDOW) {
+        long int end = (start + BATCH_WINDOW < count) ? start + BATCH_WINDOW : count;
+        hash_window(start, end, hashes, keys, key_types, window, hashtable);
+        if (hashtable->storage == CHAINED) {
+            // second round: the first node of each chain
+            for (i = start; i < end; i++) {
+                __builtin_prefetch(hashtable->bin_list[calculate_bin_index(window[i - start], hashtable)]);
             }
-            prev_node = current_node;
-            current_node = current_node->next;
+        }
+        for (i = start; i < end; i++) {
+            found[i] = lookup_by_hash(window[i - start], keys[i], key_types[i], hashtable);
         }
     }
-    printf("Item not found\n");
-    return head;
 }
 
 /***
-* Creates a new hashtable with twice as many bins as the initial hashtable.
-*   All items are transferred to the new hashtable.
+* Removes count keys, storing each removed item (or NULL) in removed.
+*   hashes is as for lookup_many. Every removed item must be freed with free_item.
 ***/
-HashTable *resize(HashTable *old_hashtable) {
-    HashTable *new_hashtable = init(2*old_hashtable->size, old_hashtable->max_load_proportion);
-    new_hashtable->load = 0;
+void remove_many(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                 Item **removed, HashTable *hashtable) {
+    long int window[BATCH_WINDOW];
+    long int start, i;
+    for (start = 0; start < count; start += BATCH_WINDOW) {
+        long int end = (start + BATCH_WINDOW < count) ? start + BATCH_WINDOW : count;
+        hash_window(start, end, hashes, keys, key_types, window, hashtable);
+        for (i = start; i < end; i++) {
+            removed[i] = remove_item_from_table_by_hash(window[i - start], keys[i], key_types[i], hashtable);
+        }
+    }
+}
+
 
+/***
+* Calls fn on every item in the hashtable, passing arg along, without changing the table.
+*   fn may change an item's value, but must not add or remove items.
+***/
+void for_each_item(HashTable *hashtable, void (*fn)(Item *item, void *arg), void *arg) {
     long int i;
-    for (i = 0; i < old_hashtable->size; i++) {
-        Node *current_node = old_hashtable->bin_list[i];
+    if (hashtable->storage != CHAINED) {
+        for (i = 0; i < hashtable->size; i++) {
+            Item *item = item_in_slot(i, hashtable);
+            if (item != NULL) {
+                fn(item, arg);
+            }
+        }
+        return;
+    }
+
+    for (i = 0; i < hashtable->size; i++) {
+        Node *current_node = hashtable->bin_list[i];
         while (current_node != NULL) {
-            new_hashtable = add_item_to_table(current_node->item, new_hashtable);
-            Node *temp = current_node->next;
-            free(current_node);
-            current_node = temp;
+            fn(&current_node->item, arg);
+            current_node = current_node->next;
         }
     }
-    free(old_hashtable->bin_list);
-    free(old_hashtable);
-    return new_hashtable;
+    // mid-resize, visit the bins that haven't moved yet where they are, rather than
+    // finish the resize -- callers like stats and the GC only read the table
+    if (hashtable->old_bin_list != NULL) {
+        for (i = hashtable->rehash_index; i < hashtable->old_size; i++) {
+            Node *current_node = hashtable->old_bin_list[i];
+            while (current_node != NULL) {
+                fn(&current_node->item, arg);
+                current_node = current_node->next;
+            }
+        }
+    }
+}
+
+static void note_object(Item *item, void *arg) {
+    *(int *)arg |= (item->value_type == OBJECT);
+}
+
+/***
+* Returns 1 if any value in the hashtable is an OBJECT, which only the program
+*   that stored it can make sense of -- so the table can't be written out.
+***/
+int table_holds_objects(HashTable *hashtable) {
+    int holds_objects = 0;
+    for_each_item(hashtable, note_object, &holds_objects);
+    return holds_objects;
+}
+
+/***
+* Returns the item stored in the given slot of an OPEN_ADDRESSING or SWISS_TABLE
+*   hashtable, or NULL if that slot is empty.
+***/
+Item *item_in_slot(long int index, HashTable *hashtable) {
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        Slot *slot = &hashtable->slots[index];
+        return (slot->distance == EMPTY_SLOT) ? NULL : &slot->item;
+    }
+    return (hashtable->control[index] < 0) ? NULL : &hashtable->items[index];
 }
 
 
@@ -263,7 +811,14 @@ HashTable *resize(HashTable *old_hashtable) {
 * Helper functions to print hashtables and data items
 ***/
 void print_table_simple(HashTable *hashtable) {
+    finish_rehash(hashtable);
     long int i;
+    if (hashtable->storage != CHAINED) {
+        for (i = 0; i < hashtable->size; i++) {
+            printf(item_in_slot(i, hashtable) == NULL ? "[]\n" : "[*]\n");
+        }
+        return;
+    }
     for (i = 0; i < hashtable->size; i++) {
         printf("[]");
         Node *current_node = hashtable->bin_list[i];
@@ -276,6 +831,7 @@ void print_table_simple(HashTable *hashtable) {
 }
 
 void print_table(HashTable *hashtable) {
+    finish_rehash(hashtable);
     printf("\n********************\n--------HashTable--------\n-Array size: "
            "%li -Load: %li -Max Load Prop: %f -Current Load Prop: %f\n",
            hashtable->size,
@@ -286,13 +842,23 @@ void print_table(HashTable *hashtable) {
     long int i;
     for (i = 0; i < hashtable->size; i++) {
         printf("*Bin %li\n", i);
+        if (hashtable->storage != CHAINED) {
+            Item *item = item_in_slot(i, hashtable);
+            if (item == NULL) {
+                printf("(empty)\n");
+            }
+            else {
+                print_item(item);
+            }
+            continue;
+        }
         Node *current_node = hashtable->bin_list[i];
         if (current_node == NULL) {
             printf("(empty)\n");
         }
         else {
             while (current_node != NULL) {
-                print_item(current_node->item);
+                print_item(&current_node->item);
                 current_node = current_node->next;
             }
         }
@@ -314,7 +880,9 @@ void print_item(Item *item) {
                 printf("%f", item->key.f);
                 break;
             case STRING:
-                printf("%s", item->key.str);
+                printf("%.*s", (int)item->key.len, item->key.str);
+                break;
+            case OBJECT: // values only
                 break;
         }
         printf("---Value: ");
@@ -326,38 +894,113 @@ void print_item(Item *item) {
                 printf("%f", item->value.f);
                 break;
             case STRING:
-                printf("%s", item->value.str);
+                printf("%.*s", (int)item->value.len, item->value.str);
+                break;
+            case OBJECT:
+                printf("<object at %p>", item->value.object);
                 break;
         }
         printf("------\n");
     }
 }
 
+/***
+* The stringify functions build their strings in a buffer that grows as needed,
+*   so long keys, long chains and big tables can't overrun it.
+***/
+typedef struct string_builder {
+    char *str;
+    size_t len;
+    size_t capacity;
+} StringBuilder;
+
+static void start_string(StringBuilder *builder, size_t capacity) {
+    builder->capacity = capacity;
+    builder->len = 0;
+    builder->str = malloc(capacity);
+    builder->str[0] = '\0';
+}
+
+static void append_format(StringBuilder *builder, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int needed = vsnprintf(builder->str + builder->len, builder->capacity - builder->len, format, args);
+    va_end(args);
+    if (needed < 0) {
+        return;
+    }
+    if (builder->len + needed >= builder->capacity) {
+        // didn't fit -- grow and write it again
+        while (builder->len + needed >= builder->capacity) {
+            builder->capacity *= 2;
+        }
+        builder->str = realloc(builder->str, builder->capacity);
+        va_start(args, format);
+        vsnprintf(builder->str + builder->len, builder->capacity - builder->len, format, args);
+        va_end(args);
+    }
+    builder->len += needed;
+}
+
+static void append_hashable(StringBuilder *builder, union Hashable h, hash_type type) {
+    switch (type) {
+        case INTEGER:
+            append_format(builder, "%li", h.i);
+            break;
+        case DOUBLE:
+            append_format(builder, "%f", h.f);
+            break;
+        case STRING:
+            append_format(builder, "%.*s", (int)h.len, h.str);
+            break;
+        case OBJECT:
+            append_format(builder, "<object at %p>", h.object);
+            break;
+    }
+}
+
+static void append_item(StringBuilder *builder, Item *item) {
+    if (item == NULL) {
+        append_format(builder, "------NULL\n");
+        return;
+    }
+    append_format(builder, "---------Hash: %li---Key: ", item->hash);
+    append_hashable(builder, item->key, item->key_type);
+    append_format(builder, "---Value: ");
+    append_hashable(builder, item->value, item->value_type);
+    append_format(builder, "------\n");
+}
+
 char *stringify_table_simple(HashTable *hashtable) {
-    int max_len = 200 + 200 * hashtable->load; // a guess
-    int len = 0;
-    char *hashtable_string = malloc(max_len);
+    finish_rehash(hashtable);
+    StringBuilder builder;
+    start_string(&builder, 4*hashtable->size + 2*hashtable->load + 1);
 
     long int i;
+    if (hashtable->storage != CHAINED) {
+        for (i = 0; i < hashtable->size; i++) {
+            append_format(&builder, item_in_slot(i, hashtable) == NULL ? "[]\n" : "[*]\n");
+        }
+        return builder.str;
+    }
     for (i = 0; i < hashtable->size; i++) {
-        len = len + snprintf(hashtable_string + len, max_len - len, "[]");
+        append_format(&builder, "[]");
         Node *current_node = hashtable->bin_list[i];
         while (current_node != NULL) {
-            len = len + snprintf(hashtable_string + len, max_len - len, "*");
+            append_format(&builder, "*");
             current_node = current_node->next;
         }
-        len = len + snprintf(hashtable_string + len, max_len - len, "\n");
+        append_format(&builder, "\n");
     }
-    return hashtable_string;
+    return builder.str;
 }
 
 char *stringify_table(HashTable *hashtable) {
-    int max_len = 200 + 200 * hashtable->load; // a guess
-    int len = 0;
-    char *hashtable_string = malloc(max_len);
-    char *item_string;
+    finish_rehash(hashtable);
+    StringBuilder builder;
+    start_string(&builder, 200 + 20*hashtable->size + 100*hashtable->load);
 
-    len = len + snprintf(hashtable_string, max_len,
+    append_format(&builder,
         "\n********************\n--------HashTable--------\n-Array size: "
         "%li -Load: %li -Max Load Prop: %f -Current Load Prop: %f\n",
         hashtable->size,
@@ -367,90 +1010,149 @@ char *stringify_table(HashTable *hashtable) {
 
     long int i;
     for (i = 0; i < hashtable->size; i++) {
-        len = len + snprintf(hashtable_string + len, max_len - len, "*Bin %li\n", i);
+        append_format(&builder, "*Bin %li\n", i);
+        if (hashtable->storage != CHAINED) {
+            Item *item = item_in_slot(i, hashtable);
+            if (item == NULL) {
+                append_format(&builder, "(empty)\n");
+            }
+            else {
+                append_item(&builder, item);
+            }
+            continue;
+        }
         Node *current_node = hashtable->bin_list[i];
         if (current_node == NULL) {
-            len = len + snprintf(hashtable_string + len, max_len - len, "(empty)\n");
+            append_format(&builder, "(empty)\n");
         }
         else {
             while (current_node != NULL) {
-                item_string = stringify_item(current_node->item);
-                len = len + snprintf(hashtable_string + len, max_len - len, "%s", item_string);
-                free(item_string);
+                append_item(&builder, &current_node->item);
                 current_node = current_node->next;
             }
         }
     }
-    len = len + snprintf(hashtable_string + len, max_len - len, "********************\n");
-    return hashtable_string;
+    append_format(&builder, "********************\n");
+    return builder.str;
 }
 
 char *stringify_item(Item *item) {
-    int max_len = 200;
-    int len = 0;
-    char *item_string = malloc(max_len);
-    if (item == NULL) {
-        len = len + snprintf(item_string + len, max_len - len, "------NULL\n");
+    StringBuilder builder;
+    start_string(&builder, 200);
+    append_item(&builder, item);
+    return builder.str;
+}
+
+void free_table(HashTable *hashtable) {
+    free(hashtable->stats);
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        open_addressing_free(hashtable);
+        return;
     }
-    else {
-        len = len + snprintf(item_string + len, max_len - len, "---------Hash: %li---Key: ", item->hash);
-        switch (item->key_type) {
-            case INTEGER:
-                len = len + snprintf(item_string + len, max_len - len, "%li", item->key.i);
-                break;
-            case DOUBLE:
-                len = len + snprintf(item_string + len, max_len - len, "%f", item->key.f);
-                break;
-            case STRING:
-                len = len + snprintf(item_string + len, max_len - len, "%s", item->key.str);
-                break;
-        }
-        len = len + snprintf(item_string + len, max_len - len, "---Value: ");
-        switch (item->value_type) {
-            case INTEGER:
-                len = len + snprintf(item_string + len, max_len - len, "%li", item->value.i);
-                break;
-            case DOUBLE:
-                len = len + snprintf(item_string + len, max_len - len, "%f", item->value.f);
-                break;
-            case STRING:
-                len = len + snprintf(item_string + len, max_len - len, "%s", item->value.str);
-                break;
+    if (hashtable->storage == SWISS_TABLE) {
+        swiss_table_free(hashtable);
+        return;
+    }
+
+    finish_rehash(hashtable);
+
+    // Nodes are released a whole chunk at a time, so bins only need walking to free strings
+    if (hashtable->string_items > 0) {
+        long int i;
+        for (i = 0; i < hashtable->size; i++) {
+            Node *current_node = hashtable->bin_list[i];
+            while (current_node != NULL) {
+                free_item_contents(&current_node->item);
+                current_node = current_node->next;
+            }
         }
-        len = len + snprintf(item_string + len, max_len - len, "------\n");
     }
-    return item_string;
+    free(hashtable->bin_list);
+    free_node_pool(hashtable);
+    free(hashtable);
 }
 
-void free_table(HashTable *hashtable) {
+/***
+* Removes and frees every item, keeping the hashtable's size and settings.
+*   Items already removed from the table (and not yet passed to free_item) stay valid.
+***/
+void clear_table(HashTable *hashtable) {
     long int i;
+    if (hashtable->storage != CHAINED) {
+        for (i = 0; i < hashtable->size; i++) {
+            Item *item = item_in_slot(i, hashtable);
+            if (item != NULL) {
+                free_item_contents(item);
+            }
+        }
+        if (hashtable->storage == OPEN_ADDRESSING) {
+            for (i = 0; i < hashtable->size; i++) {
+                hashtable->slots[i].distance = EMPTY_SLOT;
+            }
+        }
+        else {
+            memset(hashtable->control, SWISS_EMPTY, hashtable->size);
+            hashtable->tombstones = 0;
+        }
+        hashtable->load = 0;
+        return;
+    }
+
+    finish_rehash(hashtable);
     for (i = 0; i < hashtable->size; i++) {
         Node *current_node = hashtable->bin_list[i];
         while (current_node != NULL) {
-            free_item(current_node->item);
-            Node *temp_node = current_node->next;
-            free(current_node);
-            current_node = temp_node;
+            Node *temp = current_node->next;
+            free_item_contents(&current_node->item);
+            release_node(current_node, hashtable);
+            current_node = temp;
         }
+        hashtable->bin_list[i] = NULL;
     }
-    free(hashtable->bin_list);
-    free(hashtable);
+    hashtable->load = 0;
+    hashtable->string_items = 0;
+}
+
+/***
+* Frees an item that was removed from hashtable, returning its storage to the node pool.
+***/
+void free_item(Item *item, HashTable *hashtable) {
+    if (item == NULL) {
+        return;
+    }
+    free_item_contents(item);
+    release_node((Node *)item, hashtable);
 }
 
-void free_item(Item *item) {
+/***
+* Returns 1 if freeing the item means freeing a string or releasing an OBJECT value
+***/
+int item_owns_strings(Item *item) {
+    return (item->key_type == STRING) || (item->value_type == STRING) || (item->value_type == OBJECT);
+}
+
+/***
+* Frees the strings an item owns (and releases an OBJECT value), but not the item itself
+***/
+void free_item_contents(Item *item) {
     if (item->key_type == STRING) {
         free(item->key.str);
     }
     if (item->value_type == STRING) {
         free(item->value.str);
     }
-    free(item);
+    else if ((item->value_type == OBJECT) && (release_object != NULL)) {
+        release_object(item->value.object);
+    }
 }
 
 
 /***
 * Examples
+*   Programs that link hashtable.c for its functions (the Python extension,
+*   the benchmarks) build with HASHTABLE_NO_MAIN defined to leave this out.
 ***/
+#ifndef HASHTABLE_NO_MAIN
 int main() {
     /***********
     * Creating a hashtable
@@ -471,14 +1173,14 @@ int main() {
     value.i = 0;
     int key_type = INTEGER;
     int value_type = INTEGER;
-    long int hash = LONG_MAX; // pass in LONG_MAX to use pitiful default hash function
+    long int hash = LONG_MAX; // pass in LONG_MAX to use the table's built-in hash function
 
-    printf("\n~~~~~Adding %li -- %li (hash: %li)\n", key.i, value.i, calculate_hash(key, key_type));
+    printf("\n~~~~~Adding %li -- %li (hash: %li)\n", key.i, value.i, calculate_hash(key, key_type, hashtable));
     hashtable = add(hash, key, key_type, value, value_type, hashtable);
 
     key.i = 2;
     value.i = 10;
-    printf("\n~~~~~Adding %li -- %li (hash: %li)\n", key.i, value.i, calculate_hash(key, key_type));
+    printf("\n~~~~~Adding %li -- %li (hash: %li)\n", key.i, value.i, calculate_hash(key, key_type, hashtable));
     hashtable = add(hash, key, key_type, value, value_type, hashtable);
 
     // We can use this handy "print_table" function to print the table.
@@ -492,7 +1194,7 @@ int main() {
     key.f = 2.85;
     key_type = DOUBLE;
 
-    printf("\n~~~~~Adding %f -- %li (hash: %li)\n", key.f, value.i, calculate_hash(key, key_type));
+    printf("\n~~~~~Adding %f -- %li (hash: %li)\n", key.f, value.i, calculate_hash(key, key_type, hashtable));
     hashtable = add(hash, key, key_type, value, value_type, hashtable);
 
     // We can use this handy "print_table" function to print the table.
@@ -505,19 +1207,19 @@ int main() {
     //      the old value will be overwritten with the new value.
     value.str = malloc(10);
     value_type = STRING;
-    sprintf(value.str, "%s", "hello!");
-    printf("\n~~~~~Adding %f -- %s (hash: %li)\n", key.f, value.str, calculate_hash(key, key_type));
+    value.len = sprintf(value.str, "%s", "hello!");
+    printf("\n~~~~~Adding %f -- %s (hash: %li)\n", key.f, value.str, calculate_hash(key, key_type, hashtable));
     hashtable = add(hash, key, key_type, value, STRING, hashtable);
 
     union Hashable str_key2;
     union Hashable str_value2;
 
     str_key2.str = malloc(50);
-    snprintf(str_key2.str, 50, "чебурашка");
+    str_key2.len = snprintf(str_key2.str, 50, "чебурашка");
     str_value2.str = malloc(50);
-    snprintf(str_value2.str, 50, "крокодил гена");
+    str_value2.len = snprintf(str_value2.str, 50, "крокодил гена");
 
-    printf("\n~~~~~Adding %s -- %s (hash: %li)\n", str_key2.str, str_value2.str, calculate_hash(str_key2, 2));
+    printf("\n~~~~~Adding %s -- %s (hash: %li)\n", str_key2.str, str_value2.str, calculate_hash(str_key2, 2, hashtable));
     hashtable = add(LONG_MAX, str_key2, STRING, str_value2, STRING, hashtable);
 
     // We can write the results of print_hashtable to a string.
@@ -554,26 +1256,28 @@ int main() {
     key.i = 0;
     Item *removed = remove_item_from_table(key, key_type, hashtable);
     print_item(removed);
-    free_item(removed);
+    free_item(removed, hashtable);
 
     key.i = 2;
     removed = remove_item_from_table(key, key_type, hashtable);
     print_item(removed);
-    free_item(removed);
+    free_item(removed, hashtable);
 
     key.f = 2.85;
     key_type = DOUBLE;
     removed = remove_item_from_table(key, key_type, hashtable);
     print_item(removed);
-    free_item(removed);
+    free_item(removed, hashtable);
 
     key.str = "чебурашка";
+    key.len = strlen(key.str);
     key_type = STRING;
     removed = remove_item_from_table(key, key_type, hashtable);
     print_item(removed);
-    free_item(removed);
+    free_item(removed, hashtable);
 
     // And don't forget to
     free_table(hashtable);
     return 0;
 }
+#endif
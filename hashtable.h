@@ -1,3 +1,6 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,14 +12,37 @@
 ***/
 
 // For keeping track of Item key and value types
-typedef enum {INTEGER, DOUBLE, STRING} hash_type;
+//   OBJECT values are pointers to objects the program embedding the table manages
+//   (the Python extension stores PyObject references). The table passes each one to
+//   release_object when it lets go of it. They can't be keys, and tables holding them
+//   can't be written to snapshots, streams or frozen tables.
+typedef enum {INTEGER, DOUBLE, STRING, OBJECT} hash_type;
+
+// Storage layouts a hashtable can be created with
+//   CHAINED:         array of bins, each holding a linked list of Nodes
+//   OPEN_ADDRESSING: one flat array of Slots, Robin Hood linear probing
+//   SWISS_TABLE:     flat array of Items plus one control byte per slot,
+//                    probed a group of SWISS_GROUP_WIDTH slots at a time
+typedef enum {CHAINED, OPEN_ADDRESSING, SWISS_TABLE} storage_type;
 
+// Built-in hash functions, used when no hash is passed in (see hash_functions.c)
+typedef enum {WYHASH, FNV1A, IDENTITY} hash_family;
+
+// Strings are length-counted (so they may contain NULs) and NUL-terminated;
+//   len must always be set along with str
 union Hashable {
    long int i;
    double f;
-   char *str;
+   struct {
+       char *str;
+       size_t len;
+   };
+   void *object;
 };
 
+// Called with every OBJECT value a table frees or replaces (NULL: objects are left alone)
+extern void (*release_object)(void *object);
+
 typedef struct item {
     long int hash;
     union Hashable key;
@@ -25,22 +51,193 @@ typedef struct item {
     hash_type value_type;
 } Item;
 
+// Chained tables store each Item inline in its Node -- one allocation per key-value pair
 typedef struct node {
-    Item *item;
+    Item item;
     struct node *next;
 } Node;
 
+// Nodes are carved out of large chunks, owned by the hashtable (see node_pool.c)
+typedef struct node_chunk {
+    struct node_chunk *next;
+    long int count;
+    Node nodes[];
+} NodeChunk;
+
+#define NODE_CHUNK_MIN 64
+#define NODE_CHUNK_MAX 65536
+
+// How much of an incremental resize each add, lookup or remove performs
+#define REHASH_STEP_BINS 1
+#define REHASH_EMPTY_VISITS 10
+
+// Shrinking (see min_load_proportion) and compact never take a table below this many bins
+#define SHRINK_MIN_SIZE 8
+
+// How many keys lookup_many and remove_many prefetch ahead
+#define BATCH_WINDOW 16
+
+// Marks an unused Slot in an open-addressing table
+#define EMPTY_SLOT -1
+
+// Swiss table control bytes: a full slot stores the low 7 bits of its hash (0..127)
+#define SWISS_EMPTY ((signed char)-128)
+#define SWISS_DELETED ((signed char)-2)
+#define SWISS_GROUP_WIDTH 16
+
+// Probe lengths past the last histogram bucket are all counted in it
+#define STATS_HISTOGRAM_BUCKETS 16
+
+// Statistics for one hashtable (see stats.c)
+typedef struct table_stats {
+    // counted on every operation, while stats are enabled
+    long int adds;
+    long int updates;        // adds that replaced the value of a key already stored
+    long int lookups;
+    long int lookup_hits;
+    long int removes;
+    long int remove_hits;
+    long int resizes;
+    double resize_seconds;   // time spent moving items into resized storage
+    // measured from the table's current layout by table_stats
+    long int probe_histogram[STATS_HISTOGRAM_BUCKETS]; // items by the probe length that finds them
+    long int max_probe;
+    long int bytes_allocated;
+} TableStats;
+
+typedef struct slot {
+    Item item;
+    long int distance; // how far the item sits from its home bin, or EMPTY_SLOT
+} Slot;
+
 typedef struct hashtable {
     long int size;
     long int load;
     double max_load_proportion;
-    Node **bin_list;
+    double min_load_proportion; // a remove that leaves the load proportion below this shrinks the table (0: never)
+    storage_type storage;
+    Node **bin_list;      // CHAINED only
+    Slot *slots;          // OPEN_ADDRESSING only
+    signed char *control; // SWISS_TABLE only
+    Item *items;          // SWISS_TABLE only
+    long int tombstones;  // SWISS_TABLE only -- slots marked SWISS_DELETED
+    hash_family hash_family;
+    unsigned long int seed;
+    int power_of_two_size;
+    int bin_shift;        // for Fibonacci bin indexes; 0 when using modulo
+    int incremental_resize;
+    Node **old_bin_list;  // CHAINED only -- previous bins while a resize is in progress
+    long int old_size;
+    int old_bin_shift;
+    long int rehash_index; // next bin of old_bin_list to move
+    NodeChunk *chunks;     // node pool
+    Node *free_nodes;
+    long int next_chunk_size;
+    long int string_items; // CHAINED only -- items with a string key or value (or an OBJECT value), which free_table must visit
+    TableStats *stats;     // operation counters, or NULL while stats are disabled
 } HashTable;
 
+// Optional settings for init_with_options -- start from default_table_options()
+typedef struct table_options {
+    storage_type storage;
+    hash_family hash_family;
+    unsigned long int seed; // 0 picks a random seed for each table
+    int power_of_two_size;  // round sizes up to a power of two, map hashes with a multiply-shift
+    int incremental_resize; // CHAINED only -- move items to the resized bin array a few bins per operation
+    int collect_stats;      // count operations and resizes from the start (see enable_stats)
+    double min_load_proportion; // shrink when removes leave the table emptier than this; 0 never shrinks
+} TableOptions;
+
+// Snapshot files (see snapshot.c): a header, then bin offsets, entries and a string pool.
+//   All offsets are from the start of the file, so it can be mapped anywhere.
+#define SNAPSHOT_MAGIC "HTSNAP\0\0"
+#define SNAPSHOT_VERSION 1
+
+typedef struct snapshot_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int hash_family;
+    unsigned long int seed;
+    unsigned long int item_count;
+    unsigned long int bin_count;      // a power of two
+    unsigned long int bins_offset;    // bin_count + 1 entry indexes -- bin i holds entries [bins[i], bins[i + 1])
+    unsigned long int entries_offset; // item_count SnapshotEntries, grouped by bin
+    unsigned long int strings_offset; // NUL-terminated strings, referenced by offset
+    unsigned long int file_size;
+} SnapshotHeader;
+
+typedef struct snapshot_entry {
+    long int hash;
+    unsigned long int key;       // an integer, a double's bits, or a string's offset
+    unsigned long int key_len;   // strings only
+    unsigned long int value;
+    unsigned long int value_len;
+    int key_type;
+    int value_type;
+} SnapshotEntry;
+
+// A snapshot file mapped into memory -- read-only, and looked up in place
+typedef struct snapshot {
+    const char *base;
+    size_t size;
+    const SnapshotHeader *header;
+    const unsigned long int *bins;
+    const SnapshotEntry *entries;
+    int bin_shift;
+} Snapshot;
+
+// Streams (see stream.c): a header, then chunks of encoded entries, then an empty chunk.
+#define STREAM_MAGIC "HTSTRM\0\0"
+#define STREAM_VERSION 1
+#define STREAM_CHUNK_ITEMS 4096 // default number of entries per chunk
+#define STREAM_RESERVE_LIMIT (1L << 20) // most pairs a loader makes room for before reading them
+
+typedef struct stream_header {
+    char magic[8];
+    unsigned int version;
+    unsigned int hash_family;
+    unsigned long int seed;
+    unsigned long int item_count; // a sizing hint for the loader
+} StreamHeader;
+
+typedef struct stream_chunk_header {
+    unsigned long int entry_count; // 0 ends the stream
+    unsigned long int byte_count;  // of the encoded entries that follow
+} StreamChunkHeader;
+
+// Writes size bytes, returning 0, or -1 on error
+typedef int (*stream_writer)(const void *data, size_t size, void *arg);
+// Reads up to size bytes, returning how many were read (0 at the end), or -1 on error
+typedef long int (*stream_reader)(void *buffer, size_t size, void *arg);
+
+/***
+* Returns 1 if item holds the given key (whose hash is hash), 0 otherwise.
+*   Cheapest test first: the stored hash rules out almost every other key without
+*   touching key memory, then a string's length, and only then its bytes.
+*   Inline, since every probe of every lookup, add and remove goes through it.
+***/
+static inline int item_has_key(const Item *item, long int hash, union Hashable key, hash_type key_type) {
+    if ((item->hash != hash) || (item->key_type != key_type)) {
+        return 0;
+    }
+    switch (key_type) {
+        case INTEGER:
+            return (item->key.i == key.i);
+        case DOUBLE:
+            return (item->key.f == key.f);
+        case STRING:
+            return (item->key.len == key.len) && (memcmp(item->key.str, key.str, key.len) == 0);
+        default:
+            return 0;
+    }
+}
+
 /***
 * Function declarations
 ***/
 HashTable *init(long int size, double max_load_proportion);
+HashTable *init_with_options(long int size, double max_load_proportion, TableOptions options);
+TableOptions default_table_options(void);
 void print_table_simple(HashTable *hashtable);
 void print_table(HashTable *hashtable);
 void print_item(Item *item);
@@ -48,10 +245,19 @@ char *stringify_table_simple(HashTable *hashtable);
 char *stringify_table(HashTable *hashtable);
 char *stringify_item(Item *item);
 void free_table(HashTable *hashtable);
-void free_item(Item *item);
+void clear_table(HashTable *hashtable);
+void free_item(Item *item, HashTable *hashtable);
+void free_item_contents(Item *item);
+int item_owns_strings(Item *item);
+Item *item_in_slot(long int index, HashTable *hashtable);
+void for_each_item(HashTable *hashtable, void (*fn)(Item *item, void *arg), void *arg);
+int table_holds_objects(HashTable *hashtable);
 
-long int calculate_hash(union Hashable key, hash_type key_type);
-long int calculate_bin_index(long int hash, long int size);
+long int calculate_hash(union Hashable key, hash_type key_type, HashTable *hashtable);
+long int calculate_bin_index(long int hash, HashTable *hashtable);
+long int bin_index_for_size(long int hash, long int size, int bin_shift);
+long int round_up_to_power_of_two(long int size);
+int bin_shift_for_size(HashTable *hashtable);
 int max_load_reached(HashTable *hashtable);
 int hashable_equal(union Hashable h1, hash_type type1, union Hashable h2, hash_type type2);
 
@@ -61,9 +267,103 @@ Node *add_item_to_bin(Item *item, Node *bin_list, HashTable *hashtable);
 
 Item *lookup_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
 Item *lookup(union Hashable key, hash_type key_type, HashTable *hashtable);
+Item *lookup_in_bin(long int hash, union Hashable key, hash_type key_type, Node *bin_list);
 
 Item *remove_item_from_table_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
 Item *remove_item_from_table(union Hashable key, hash_type key_type, HashTable *hashtable);
-Node *remove_item_from_bin(union Hashable key, hash_type key_type, Node *bin_list);
+Item *remove_item_from_bin(long int hash, union Hashable key, hash_type key_type, Node **bin);
+int discard_by_hash(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
+int discard(union Hashable key, hash_type key_type, HashTable *hashtable);
 
 HashTable *resize(HashTable *hashtable);
+HashTable *resize_to(long int size, HashTable *hashtable);
+void begin_rehash(long int size, HashTable *hashtable);
+void migrate_bin(long int old_index, HashTable *hashtable);
+void rehash_step(HashTable *hashtable);
+void finish_rehash(HashTable *hashtable);
+
+HashTable *reserve(long int count, HashTable *hashtable);
+HashTable *compact(HashTable *hashtable);
+void shrink_if_sparse(HashTable *hashtable);
+HashTable *add_many(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                    union Hashable *values, hash_type *value_types, HashTable *hashtable);
+HashTable *build_table(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                       union Hashable *values, hash_type *value_types,
+                       double max_load_proportion, TableOptions options);
+
+void prefetch_bin(long int hash, HashTable *hashtable);
+void lookup_many(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                 Item **found, HashTable *hashtable);
+void remove_many(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                 Item **removed, HashTable *hashtable);
+
+/***
+* Node pool (node_pool.c)
+***/
+Node *allocate_node(HashTable *hashtable);
+void release_node(Node *node, HashTable *hashtable);
+void free_node_pool(HashTable *hashtable);
+long int nodes_in_use(HashTable *hashtable);
+
+/***
+* Open-addressing storage (open_addressing.c)
+***/
+Slot *allocate_slots(long int size);
+void open_addressing_add(Item *item, HashTable *hashtable);
+Item *open_addressing_lookup(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
+Item *open_addressing_remove(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
+int open_addressing_discard(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
+HashTable *open_addressing_resize(long int size, HashTable *hashtable);
+void open_addressing_free(HashTable *hashtable);
+
+/***
+* Swiss table storage (swiss_table.c)
+***/
+void swiss_table_allocate(long int size, HashTable *hashtable);
+void swiss_table_add(Item *item, HashTable *hashtable);
+Item *swiss_table_lookup(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
+Item *swiss_table_remove(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
+int swiss_table_discard(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable);
+HashTable *swiss_table_resize(long int size, HashTable *hashtable);
+void swiss_table_free(HashTable *hashtable);
+void swiss_table_prefetch(long int hash, HashTable *hashtable);
+long int swiss_table_probe_length(long int index, HashTable *hashtable);
+
+/***
+* Stats (stats.c)
+***/
+void enable_stats(HashTable *hashtable);
+void disable_stats(HashTable *hashtable);
+void table_stats(HashTable *hashtable, TableStats *stats);
+double stats_clock(void);
+void record_resize(double start, HashTable *hashtable);
+
+/***
+* Snapshots (snapshot.c)
+***/
+int save_snapshot(HashTable *hashtable, const char *path);
+int write_snapshot(long int count, Item **items, hash_family family, unsigned long int seed, const char *path);
+Snapshot *open_snapshot(const char *path);
+void close_snapshot(Snapshot *snapshot);
+int snapshot_lookup(long int hash, union Hashable key, hash_type key_type, Snapshot *snapshot, Item *found);
+void snapshot_item(long int index, Snapshot *snapshot, Item *item);
+HashTable *snapshot_to_table(Snapshot *snapshot, double max_load_proportion, TableOptions options);
+
+/***
+* Streams (stream.c)
+***/
+int dump_table(stream_writer write, void *arg, long int chunk_items, HashTable *hashtable);
+int dump_table_to_fd(int fd, long int chunk_items, HashTable *hashtable);
+HashTable *load_table(stream_reader read, void *arg, double max_load_proportion, TableOptions options);
+HashTable *load_table_from_fd(int fd, double max_load_proportion, TableOptions options);
+
+/***
+* Built-in hash functions (hash_functions.c)
+***/
+long int hash_with_family(union Hashable key, hash_type key_type, hash_family family, unsigned long int seed);
+unsigned long int hash_string_wyhash(const char *str, size_t len, unsigned long int seed);
+unsigned long int hash_integer_mix(unsigned long int i, unsigned long int seed);
+unsigned long int hash_bytes_fnv1a(const void *data, size_t len, unsigned long int seed);
+unsigned long int random_seed(void);
+
+#endif
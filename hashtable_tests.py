@@ -1,7 +1,16 @@
 import hashtable
 
+import cPickle
+import gc
+import os
 import string
+import StringIO
+import struct
+import sys
+import tempfile
+import threading
 import unittest
+import weakref
 
 def my_hash(obj):
     print "---------> now hashing " + str(obj)
@@ -104,6 +113,12 @@ class TestHashTable(unittest.TestCase):
             self.assertEqual(self.h.pop(c), c)
             self.assertEqual(self.h.load, 26 - (string.ascii_lowercase.find(c) + 1))
 
+    def test_pop_missing_key(self):
+        self.h.set(1, 2)
+        self.assertEqual(self.h.pop(2), None)
+        self.assertEqual(self.h.pop("missing"), None)
+        self.assertEqual(self.h.load, 1)
+
     def test_updating_values(self):
         self.h.set(1, 2)
         self.h.set(1, "hello")
@@ -119,5 +134,551 @@ class TestHashTable(unittest.TestCase):
         self.h.set("astring", 3.3)
         self.assertEqual(self.h.get("astring"), 3.3)
 
+    def test_open_addressing_storage(self):
+        self.check_flat_storage(hashtable.HashTable(storage = "open"))
+
+    def test_swiss_table_storage(self):
+        h = hashtable.HashTable(storage = "swiss")
+        self.assertEqual(h.size, 16) # rounded up to a whole group of slots
+        self.check_flat_storage(h)
+
+    def check_flat_storage(self, h):
+        for i in range(100):
+            h.set(i, str(i))
+            self.assertEqual(h.load, i + 1)
+        for c in string.ascii_lowercase:
+            h.set(c, c)
+        self.assertEqual(h.load, 126)
+
+        h.set(5, 5.5)
+        self.assertEqual(h.get(5), 5.5)
+        self.assertEqual(h.load, 126)
+
+        for i in range(0, 100, 2):
+            self.assertEqual(h.pop(i), 5.5 if i == 5 else str(i))
+        self.assertEqual(h.load, 76)
+        for i in range(100):
+            self.assertEqual(h.get(i), None if i % 2 == 0 else (5.5 if i == 5 else str(i)))
+        for c in string.ascii_lowercase:
+            self.assertEqual(h.get(c), c)
+
+    def test_power_of_two_size(self):
+        for storage in ["chained", "open"]:
+            h = hashtable.HashTable(size = 5, power_of_two = True, storage = storage)
+            self.assertEqual(h.size, 8)
+            for i in range(0, 1000, 8):
+                h.set(i, i)
+            for i in range(0, 1000, 8):
+                self.assertEqual(h.get(i), i)
+                self.assertEqual(h.pop(i), i)
+            self.assertEqual(h.load, 0)
+
+    def test_incremental_resize(self):
+        h = hashtable.HashTable(incremental_resize = True)
+        for i in range(1000):
+            h.set(i, i)
+            h.set(str(i), i)
+        self.assertEqual(h.load, 2000)
+        self.assertEqual(h.size, 4096)
+        for i in range(1000):
+            self.assertEqual(h.get(i), i)
+            self.assertEqual(h.pop(str(i)), i)
+        self.assertEqual(h.load, 1000)
+
+    def test_bulk_set(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(storage = storage)
+            h.bulk_set([(i, str(i)) for i in range(1000)])
+            self.assertEqual(h.load, 1000)
+            h.bulk_set({"a": 1, 2.5: "b", 7: 7})
+            self.assertEqual(h.load, 1002)
+            self.assertEqual(h.get(7), 7)
+            self.assertEqual(h.get(999), "999")
+            self.assertEqual(h.get("a"), 1)
+            self.assertEqual(h.get(2.5), "b")
+
+    def test_bulk_set_with_invalid_pairs(self):
+        with self.assertRaisesRegexp(ValueError, "exactly two elements"):
+            self.h.bulk_set([(1, 2), (3, 4, 5)])
+        with self.assertRaises(TypeError):
+            self.h.bulk_set([(1, 2), (object(), 4)])
+        self.assertEqual(self.h.load, 0)
+
+    def test_bulk_set_with_a_hash_func_that_changes_the_pairs(self):
+        pairs = [(i, str(i)) for i in range(100)]
+        def emptying_hash(key):
+            del pairs[:]
+            return hash(key)
+        h = hashtable.HashTable(hash_func = emptying_hash)
+        h.bulk_set(pairs)
+        self.assertEqual(h.load, 100)
+        self.assertEqual(h.get(99), "99")
+
+        pair = ["k%d" % 1, "v%d" % 1]
+        def emptying_pair_hash(key):
+            del pair[:]
+            return hash(key)
+        h = hashtable.HashTable(hash_func = emptying_pair_hash)
+        h.update([pair])
+        self.assertEqual(h.get("k1"), "v1")
+
+    def test_get_set_and_pop_many(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(storage = storage)
+            keys = range(100) + [str(i) for i in range(100)] + [i / 4.0 for i in range(100)]
+            h.set_many(keys, [str(k) for k in keys])
+            self.assertEqual(h.load, 300) # floats are never equal to integer keys
+            self.assertEqual(h.get_many(keys + ["missing"]), [str(k) for k in keys] + [None])
+            self.assertEqual(h.pop_many([1, "1", "missing"]), ["1", "1", None])
+            self.assertEqual(h.get_many([1, "1", 2]), [None, None, "2"])
+
+    def test_set_many_with_mismatched_lengths(self):
+        with self.assertRaisesRegexp(ValueError, "as many values as keys"):
+            self.h.set_many([1, 2], [1])
+        self.assertEqual(self.h.load, 0)
+
+    def test_binary_string_keys(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(storage = storage)
+            h.set("a\0b", "x\0y")
+            h.set("a\0c", "z")
+            h.set("a", "w")
+            self.assertEqual(h.load, 3)
+            self.assertEqual(h.get("a\0b"), "x\0y")
+            self.assertEqual(h.get("a\0c"), "z")
+            self.assertEqual(h.get("a"), "w")
+            self.assertEqual(h.get_many(["a\0b", "a\0"]), ["x\0y", None])
+            self.assertEqual(h.pop("a\0b"), "x\0y")
+            self.assertEqual(h.get("a\0b"), None)
+            self.assertEqual(h.get("a"), "w")
+
+    def test_clear(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(storage = storage)
+            h.bulk_set((i, str(i)) for i in range(5000))
+            size = h.size
+            h.clear()
+            self.assertEqual(h.load, 0)
+            self.assertEqual(h.size, size)
+            self.assertEqual(h.get(1), None)
+            h.set("a", 1)
+            self.assertEqual(h.get("a"), 1)
+
+    def test_threads(self):
+        shared = hashtable.HashTable(hash_func = "native")
+        tables = [hashtable.HashTable(hash_func = "native") for i in range(4)]
+        def work(n):
+            keys = range(n * 10000, (n + 1) * 10000)
+            tables[n].set_many(keys, keys)
+            shared.bulk_set((key, -key) for key in keys)
+            self.assertEqual(shared.get_many(keys[:2000]), [-key for key in keys[:2000]])
+            shared.pop_many(keys[:5000])
+            shared.set(-1 - n, n)
+        threads = [threading.Thread(target = work, args = (n,)) for n in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual([table.load for table in tables], [10000] * 4)
+        self.assertEqual(shared.load, 4 * 5000 + 4)
+        self.assertEqual(shared.get(39999), -39999)
+
+    def test_discard(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(storage = storage)
+            for i in range(100):
+                h.set(i, str(i))
+                h.set(str(i), i)
+            self.assertTrue(h.discard(5))
+            self.assertTrue(h.discard("5"))
+            self.assertFalse(h.discard(5))
+            self.assertFalse(h.discard("not there"))
+            self.assertEqual(h.load, 198)
+            self.assertEqual(h.get(5), None)
+            self.assertEqual(h.get(6), "6")
+
+    def test_colliding_hashes(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(hash_func = lambda key: 7, storage = storage)
+            keys = ["aa", "ab", "ba", "a", "aaa", 7, 7.0]
+            for i, key in enumerate(keys):
+                h.set(key, i)
+            self.assertEqual(h.load, len(keys))
+            for i, key in enumerate(keys):
+                self.assertEqual(h.get(key), i)
+            self.assertEqual(h.pop("ab"), 1)
+            self.assertEqual(h.get("ab"), None)
+            self.assertEqual(h.get("aa"), 0)
+
+    def test_native_hash(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(hash_func = "native", storage = storage)
+            self.assertEqual(h.hash_func, "native")
+            for i in range(200):
+                h.set(i, i)
+                h.set(str(i), i)
+                h.set(i + 0.5, i)
+            self.assertEqual(h.load, 600)
+            for i in range(200):
+                self.assertEqual(h.get(i), i)
+                self.assertEqual(h.get(str(i)), i)
+                self.assertEqual(h.pop(i + 0.5), i)
+            self.assertEqual(h.get_many([0, "1", 2.5]), [0, 1, None])
+
+    def test_key_hashing_to_sys_maxint(self):
+        for hash_func in [None, lambda key: sys.maxint]:
+            h = hashtable.HashTable() if hash_func is None else hashtable.HashTable(hash_func = hash_func)
+            h.set(sys.maxint, "max")
+            h.set(1, "one")
+            self.assertEqual(h.get(sys.maxint), "max")
+            self.assertEqual(h.get_many([sys.maxint, 1]), ["max", "one"])
+            self.assertIn(sys.maxint, h)
+            self.assertEqual(h.pop(sys.maxint), "max")
+            self.assertEqual(h.load, 1)
+
+    def test_dump_and_load(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(hash_func = "native", storage = storage)
+            h.bulk_set((i, "v\x00%d" % i) for i in range(5000))
+            h.set("a", 1.5)
+            f = StringIO.StringIO()
+            h.dump(f, 100)
+            f.seek(0)
+            loaded = hashtable.HashTable(hash_func = "native", storage = storage)
+            loaded.set("gone", 1)
+            loaded.load_from(f)
+            self.assertEqual(loaded.load, 5001)
+            self.assertEqual(loaded.get("gone"), None)
+            self.assertEqual(loaded.get(4999), "v\x004999")
+            self.assertEqual(loaded.get("a"), 1.5)
+            self.assertRaises(ValueError, loaded.load_from, StringIO.StringIO("not a stream"))
+            self.assertEqual(loaded.load, 5001)
+
+    def test_load_from_a_tampered_stream(self):
+        h = hashtable.HashTable(hash_func = "native")
+        h.bulk_set((i, str(i)) for i in range(100))
+        f = StringIO.StringIO()
+        h.dump(f)
+        dumped = f.getvalue()
+        # the header's item_count is only a hint -- a huge one isn't reserved up front
+        huge_count = dumped[:24] + struct.pack("=Q", 1 << 62) + dumped[32:]
+        loaded = hashtable.HashTable(hash_func = "native")
+        loaded.load_from(StringIO.StringIO(huge_count))
+        self.assertEqual(loaded.load, 100)
+        self.assertEqual(loaded.get(99), "99")
+        unknown_family = dumped[:12] + struct.pack("=I", 99) + dumped[16:]
+        self.assertRaises(ValueError, loaded.load_from, StringIO.StringIO(unknown_family))
+        self.assertEqual(loaded.load, 100)
+
+    def test_pickle(self):
+        for storage in ["chained", "open", "swiss"]:
+            for hash_func in ["native", hash]:
+                h = hashtable.HashTable(max_load = 0.75, hash_func = hash_func, storage = storage)
+                h.bulk_set((str(i), i) for i in range(3000))
+                for protocol in [0, 2]:
+                    copy = cPickle.loads(cPickle.dumps(h, protocol))
+                    self.assertEqual(copy.load, 3000)
+                    self.assertEqual(copy.max_load, 0.75)
+                    self.assertEqual(copy.hash_func, hash_func)
+                    self.assertEqual(copy.get_many(["0", "2999", "3000"]), [0, 2999, None])
+                    copy.set("new", 1)
+                    self.assertEqual(copy.get("new"), 1)
+
+    def test_freeze(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(storage = storage)
+            h.bulk_set((i, "v%d" % i) for i in range(3000))
+            h.set("a\x00b", 1.5)
+            h.set(2.5, 7)
+            frozen = h.freeze()
+            h.set("later", 1)
+            self.assertEqual(frozen.load, 3002)
+            self.assertEqual(frozen.get(2999), "v2999")
+            self.assertEqual(frozen.get("a\x00b"), 1.5)
+            self.assertEqual(frozen.get("a"), None)
+            self.assertEqual(frozen.get("later"), None)
+            self.assertEqual(frozen.get_many([0, 2.5, 3000, "x"]), ["v0", 7, None, None])
+            self.assertFalse(hasattr(frozen, "set"))
+
+    def test_frozen_snapshot(self):
+        path = tempfile.mktemp()
+        try:
+            h = hashtable.HashTable()
+            h.bulk_set((str(i), i) for i in range(1000))
+            h.freeze().save_snapshot(path)
+            frozen = hashtable.FrozenHashTable(path)
+            self.assertEqual(frozen.load, 1000)
+            self.assertEqual(frozen.get_many(["0", "999", "1000"]), [0, 999, None])
+        finally:
+            os.remove(path)
+        self.assertRaises(IOError, hashtable.FrozenHashTable, path)
+
+    def test_typed_tables(self):
+        counts = hashtable.IntIntTable()
+        for i in range(10000):
+            counts.increment(i % 100)
+        self.assertEqual(counts.load, 100)
+        self.assertEqual(counts.get(7), 100)
+        self.assertEqual(counts.increment(7, -50), 50)
+        counts.set(-1, 2**40)
+        self.assertEqual(counts.get(-1), 2**40)
+        self.assertEqual(counts.pop(-1), 2**40)
+        self.assertEqual(counts.pop(-1), None)
+        self.assertEqual(counts.get(1000), None)
+        self.assertRaises(TypeError, counts.set, "a", 1)
+        self.assertRaises(TypeError, counts.set, 1.5, 1)
+
+        weights = hashtable.IntDoubleTable(size = 2, max_load = 0.9)
+        for i in range(1000):
+            weights.set(i, i / 4.0)
+        self.assertEqual(weights.get(999), 249.75)
+        self.assertEqual(weights.increment(999, 0.25), 250.0)
+        self.assertTrue(weights.size >= 1000)
+
+        words = hashtable.StrIntTable()
+        for word in "the cat and the hat and the bat".split():
+            words.increment(word)
+        words.set("a\x00b", 3)
+        self.assertEqual(words.get("the"), 3)
+        self.assertEqual(words.get("a"), None)
+        self.assertEqual(words.get("a\x00b"), 3)
+        self.assertEqual(words.pop("and"), 2)
+        self.assertEqual(words.load, 5)
+        self.assertRaises(TypeError, words.get, 1)
+
+    def test_stats(self):
+        for storage in ("chained", "open", "swiss"):
+            h = hashtable.HashTable(size = 4, storage = storage, collect_stats = True)
+            for i in range(1000):
+                h.set(i, i)
+            h.set(0, "zero")
+            self.assertEqual(h.get(5), 5)
+            self.assertEqual(h.get(5000), None)
+            h.get_many([1, 2, -1])
+            self.assertEqual(h.pop(1), 1)
+            self.assertEqual(h.discard(1), False)
+            stats = h.stats()
+            self.assertEqual(stats["adds"], 1001)
+            self.assertEqual(stats["updates"], 1)
+            self.assertEqual((stats["lookups"], stats["hits"], stats["misses"]), (5, 3, 2))
+            self.assertEqual((stats["removes"], stats["remove_hits"], stats["remove_misses"]), (2, 1, 1))
+            self.assertTrue(stats["resizes"] > 0)
+            self.assertTrue(stats["resize_seconds"] >= 0)
+            self.assertEqual(sum(stats["probe_histogram"]), 999)
+            self.assertTrue(stats["max_probe"] >= 1)
+            self.assertTrue(stats["mean_probe"] >= 1)
+            self.assertTrue(stats["bytes_allocated"] > 999 * 16)
+
+        plain = hashtable.HashTable()
+        plain.set("a", 1)
+        stats = plain.stats()
+        self.assertFalse("lookups" in stats)
+        self.assertEqual(stats["probe_histogram"][0], 1)
+
+    def test_shrink_on_delete(self):
+        for storage in ("chained", "open", "swiss"):
+            h = hashtable.HashTable(size = 4, max_load = 0.75, storage = storage, min_load = 0.2)
+            self.assertEqual(h.min_load, 0.2)
+            for i in range(4096):
+                h.set(i, str(i))
+            peak = h.size
+            for i in range(4000):
+                self.assertEqual(h.pop(i), str(i))
+            self.assertTrue(h.size < peak / 16)
+            self.assertEqual(h.load, 96)
+            for i in range(4000, 4096):
+                self.assertEqual(h.get(i), str(i))
+
+            never = hashtable.HashTable(size = 4, storage = storage)
+            never.bulk_set((i, i) for i in range(1000))
+            never.pop_many(range(1000))
+            self.assertTrue(never.size >= 1000)
+
+        self.assertRaises(TypeError, hashtable.HashTable, max_load = 0.5, min_load = 0.5)
+
+    def test_reserve_and_compact(self):
+        for storage in ("chained", "open", "swiss"):
+            h = hashtable.HashTable(size = 4, storage = storage)
+            h.reserve(1000)
+            size = h.size
+            self.assertTrue(size >= 2000)
+            for i in range(1000):
+                h.set(i, i)
+            self.assertEqual(h.size, size)
+            for i in range(0, 1000, 2):
+                h.discard(i)
+            h.compact()
+            self.assertTrue(h.size < size)
+            self.assertEqual(h.load, 500)
+            for i in range(1000):
+                self.assertEqual(h.get(i), None if i % 2 == 0 else i)
+            h.set("after", 1)
+            self.assertEqual(h.get("after"), 1)
+
+    def test_repr_of_long_strings(self):
+        h = hashtable.HashTable(size = 2)
+        h.set("k" * 10000, "v" * 10000)
+        self.assertEqual(repr(h).count("*"), 1)
+
+    def test_mapping_protocol(self):
+        h = hashtable.HashTable()
+        h["a"] = 1
+        h[2] = "two"
+        h[3.5] = 3.5
+        self.assertEqual(len(h), 3)
+        self.assertEqual(h["a"], 1)
+        self.assertTrue(2 in h)
+        self.assertFalse("b" in h)
+        self.assertRaises(KeyError, lambda: h["b"])
+        del h["a"]
+        self.assertEqual(len(h), 2)
+        with self.assertRaises(KeyError):
+            del h["a"]
+
+    def test_iteration(self):
+        for storage in ("chained", "open", "swiss"):
+            h = hashtable.HashTable(storage = storage, incremental_resize = True)
+            expected = dict((i, str(i)) for i in range(500))
+            expected["key"] = 1.5
+            h.update(expected)
+            self.assertEqual(sorted(h), sorted(expected))
+            self.assertEqual(sorted(h.keys()), sorted(expected.keys()))
+            self.assertEqual(sorted(h.itervalues()), sorted(expected.values()))
+            self.assertEqual(dict(h.iteritems()), expected)
+            self.assertEqual(dict(h.items()), expected)
+
+            iterator = iter(h)
+            next(iterator)
+            h.get(0) # lookups don't count as changes
+            next(iterator)
+            h["new"] = 1
+            self.assertRaises(RuntimeError, next, iterator)
+            self.assertEqual(list(hashtable.HashTable(storage = storage)), [])
+
+    def test_set_many_with_a_hash_func_that_changes_the_keys(self):
+        keys = range(10)
+        def emptying_hash(key):
+            del keys[:]
+            return hash(key)
+        h = hashtable.HashTable(hash_func = emptying_hash)
+        h.set_many(keys, range(10))
+        self.assertEqual(h.load, 10)
+        self.assertEqual(h.get(9), 9)
+
+    def test_update(self):
+        h = hashtable.HashTable(hash_func = "native")
+        h.update({"a": 1}, b = 2)
+        h.update([("c", 3)])
+        other = hashtable.HashTable()
+        other["d"] = 4
+        h.update(other)
+        self.assertEqual(dict(h.items()), {"a": 1, "b": 2, "c": 3, "d": 4})
+        self.assertRaises(TypeError, h.update, [1, 2])
+
+    def test_object_values(self):
+        for storage in ["chained", "open", "swiss"]:
+            h = hashtable.HashTable(storage = storage)
+            value = [1, 2]
+            h.set("list", value)
+            h.set("big", 2**70)
+            h.set_many(["dict"], [{"a": 1}])
+            self.assertIs(h.get("list"), value)
+            self.assertEqual(h.get("big"), 2**70)
+            self.assertEqual(h["dict"], {"a": 1})
+            self.assertEqual(h.get_many(["list", "big"]), [value, 2**70])
+
+            refs = sys.getrefcount(value)
+            h.set("list", 1)
+            self.assertEqual(sys.getrefcount(value), refs - 1)
+            h["list"] = value
+            self.assertIs(h.pop("list"), value)
+            self.assertEqual(sys.getrefcount(value), refs - 1)
+
+            self.assertRaises(TypeError, h.dump, StringIO.StringIO())
+            self.assertRaises(TypeError, cPickle.dumps, h)
+            self.assertRaises(TypeError, h.freeze)
+
+        h = hashtable.HashTable(object_values = True)
+        value = 5
+        h.set(1, value)
+        self.assertIs(h.get(1), value)
+        self.assertTrue(h.object_values)
+
+    def test_object_value_cycles_are_collected(self):
+        class Value(object):
+            pass
+        h = hashtable.HashTable()
+        value = Value()
+        value.table = h
+        h.set("self", value)
+        h.set("table", h)
+        dead = weakref.ref(value)
+        del h, value
+        gc.collect()
+        self.assertIsNone(dead())
+
+    def test_cache_eviction(self):
+        for storage in ["chained", "open", "swiss"]:
+            cache = hashtable.Cache(3, storage = storage)
+            for key in ["a", "b", "c"]:
+                cache[key] = [key]
+            self.assertEqual(cache.get("a"), ["a"])
+            cache["d"] = 4 # "a" was used since the clock hand last passed, so "b" goes
+            self.assertEqual(len(cache), 3)
+            self.assertIn("a", cache)
+            self.assertNotIn("b", cache)
+            self.assertIsNone(cache.get("b"))
+            self.assertRaises(KeyError, lambda: cache["b"])
+            self.assertEqual(cache.stats(), {"hits": 1, "misses": 2, "evictions": 1})
+
+            self.assertEqual(cache.pop("a"), ["a"])
+            self.assertFalse(cache.discard("a"))
+            del cache["c"]
+            self.assertEqual(len(cache), 1)
+            cache.clear()
+            self.assertEqual(cache.load, 0)
+            self.assertEqual(cache.capacity, 3)
+
+        cache = hashtable.Cache(10)
+        for i in range(1000):
+            cache[i] = i
+            cache.get(0)
+        self.assertEqual(len(cache), 10)
+        self.assertEqual(cache[0], 0)
+        self.assertRaises(TypeError, hashtable.Cache, 0)
+
+    def test_cache_on_evict(self):
+        evicted = []
+        cache = hashtable.Cache(2, on_evict = lambda key, value: evicted.append((key, value)))
+        cache.set(1, "one")
+        cache.set(2, "two")
+        cache.set(2, "TWO") # an update doesn't evict
+        cache.set(3, "three")
+        self.assertEqual(evicted, [(1, "one")])
+
+        def refill(key, value):
+            if key < 100:
+                cache.set(key + 100, value)
+        cache = hashtable.Cache(2, on_evict = refill)
+        for i in range(5):
+            cache.set(i, i)
+        self.assertEqual(len(cache), 2)
+
+        def fail(key, value):
+            raise ValueError(key)
+        cache = hashtable.Cache(1, on_evict = fail)
+        cache.set(1, 1)
+        self.assertRaises(ValueError, cache.set, 2, 2)
+        self.assertEqual(cache.get(2), 2)
+        self.assertRaises(TypeError, hashtable.Cache, 1, on_evict = 1)
+
+    def test_initialization_with_invalid_hash_func(self):
+        with self.assertRaisesRegexp(TypeError, "hash_func must be callable"):
+            h = hashtable.HashTable(hash_func = "bogus")
+
+    def test_initialization_with_invalid_storage(self):
+        with self.assertRaisesRegexp(ValueError, "storage parameter must be"):
+            h = hashtable.HashTable(storage = "bogus")
+
 if __name__ == '__main__':
     unittest.main()
@@ -1,6 +1,14 @@
 #include <Python.h>
 #include "structmember.h"
+#include "pythread.h"
 #include "hashtablemodule_helpers.h"
+#include "frozen_hashtable.h"
+#include "cache.h"
+#include "typed_hashtable.h"
+
+// Batch operations on at least this many keys (and resizes of tables with at
+//   least this many items) run with the GIL released
+#define GIL_RELEASE_THRESHOLD 1024
 
 typedef struct {
     PyObject_HEAD
@@ -8,21 +16,129 @@ typedef struct {
     long int size;
     long int load;
     double max_load;
+    double min_load;
     PyObject *hash_func;
+    PyObject *hash_callable; // hash_func, or NULL to hash natively in C
+    unsigned long int version; // changed by everything that adds, removes or moves pairs, so iterators can tell
+    int object_values; // store every value as the object itself, not just those that aren't an int, float or str
+    PyThread_type_lock lock; // held while using hashtable, which other threads may be changing without the GIL
 } HashTablePyObject;
 
+/***
+* Takes the table's lock. Another thread may be holding it with the GIL released,
+*   so if it isn't free straight away, wait for it without the GIL.
+***/
+static void
+lock_table(HashTablePyObject *self)
+{
+    if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+/***
+* Values that tables have let go of, waiting to be DECREF'd
+*   A table can free values while its lock is held, and even with the GIL released.
+*   Dropping the last reference there could run a __del__ that uses the same table
+*   (and deadlocks on its lock), so release_object only moves each reference in here --
+*   and the values really go once the lock is released.
+***/
+static PyObject *released_objects = NULL;
+
+static void
+queue_released_object(void *object)
+{
+    PyGILState_STATE gil = PyGILState_Ensure();
+    if (PyList_Append(released_objects, (PyObject *)object) < 0) {
+        PyErr_Clear(); // out of memory -- let it go now rather than leak it
+    }
+    Py_DECREF((PyObject *)object);
+    PyGILState_Release(gil);
+}
+
+static void
+release_queued_objects(void)
+{
+    if (PyList_GET_SIZE(released_objects) > 0) {
+        // the list is emptied before any value is DECREF'd, so a __del__ can queue more safely
+        PyList_SetSlice(released_objects, 0, PyList_GET_SIZE(released_objects), NULL);
+    }
+}
+
+static void
+unlock_table(HashTablePyObject *self)
+{
+    PyThread_release_lock(self->lock);
+    release_queued_objects();
+}
+
+/***
+* Releases the GIL if there is enough work to be worth it (see GIL_RELEASE_THRESHOLD),
+*   returning what end_allow_threads needs to take it back.
+*   Only pure C work on the locked hashtable may happen in between -- no Python objects.
+***/
+static PyThreadState *
+begin_allow_threads(long int work)
+{
+    return (work >= GIL_RELEASE_THRESHOLD) ? PyEval_SaveThread() : NULL;
+}
+
+static void
+end_allow_threads(PyThreadState *state)
+{
+    if (state != NULL) {
+        PyEval_RestoreThread(state);
+    }
+}
+
+/***
+* Sets *storage from its name. Returns 0, or -1 with an exception set if there's no such storage.
+***/
+static int
+storage_from_name(const char *name, storage_type *storage)
+{
+    if (strcmp(name, "chained") == 0) {
+        *storage = CHAINED;
+    }
+    else if (strcmp(name, "open") == 0) {
+        *storage = OPEN_ADDRESSING;
+    }
+    else if (strcmp(name, "swiss") == 0) {
+        *storage = SWISS_TABLE;
+    }
+    else {
+        PyErr_SetString(PyExc_ValueError, "storage parameter must be 'chained', 'open' or 'swiss'.");
+        return -1;
+    }
+    return 0;
+}
+
 static int
 HashTablePyObject_init(HashTablePyObject *self, PyObject *args, PyObject *kwds)
 {
     self->hashtable = NULL;
+    self->lock = NULL;
+    self->version = 0;
+    self->object_values = 0;
 
     long int size = 4;
     double max_load = 0.5;
     PyObject *hash_func = NULL;
+    char *storage = "chained";
+    int power_of_two = 0;
+    int incremental_resize = 0;
+    int collect_stats = 0;
+    double min_load = 0;
+    int object_values = 0;
 
-    static char *kwlist[] = {"size", "max_load", "hash_func", NULL};
+    static char *kwlist[] = {"size", "max_load", "hash_func", "storage", "power_of_two", "incremental_resize",
+                             "collect_stats", "min_load", "object_values", NULL};
 
-    if (! PyArg_ParseTupleAndKeywords(args, kwds, "|ldO", kwlist, &size, &max_load, &hash_func)) {
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "|ldOsiiidi", kwlist, &size, &max_load, &hash_func, &storage,
+                                      &power_of_two, &incremental_resize, &collect_stats, &min_load,
+                                      &object_values)) {
         PyErr_SetString(PyExc_TypeError, "Invalid parameters.");
         return -1;
     }
@@ -34,15 +150,37 @@ HashTablePyObject_init(HashTablePyObject *self, PyObject *args, PyObject *kwds)
         PyErr_SetString(PyExc_TypeError, "max_load parameter must be a float between 0.0 and 1.0.");
         return -1;
     }
-    if ((hash_func != NULL) && (!PyCallable_Check(hash_func))) {
-        PyErr_SetString(PyExc_TypeError, "hash_func must be callable.");
+    if ((min_load < 0) || (min_load >= max_load)) {
+        PyErr_SetString(PyExc_TypeError, "min_load parameter must be a float from 0.0 up to max_load.");
         return -1;
     }
+    int native_hash = (hash_func != NULL) && PyString_Check(hash_func) &&
+                      (strcmp(PyString_AsString(hash_func), "native") == 0);
+    if ((hash_func != NULL) && !native_hash && (!PyCallable_Check(hash_func))) {
+        PyErr_SetString(PyExc_TypeError, "hash_func must be callable, or \"native\".");
+        return -1;
+    }
+
+    TableOptions options = default_table_options();
+    if (storage_from_name(storage, &options.storage) < 0) {
+        return -1;
+    }
+    options.power_of_two_size = power_of_two;
+    options.incremental_resize = incremental_resize;
+    options.collect_stats = collect_stats;
+    options.min_load_proportion = min_load;
 
-    self->hashtable = init(size, max_load);
-    self->size = size;
+    self->lock = PyThread_allocate_lock();
+    if (self->lock == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->hashtable = init_with_options(size, max_load, options);
+    self->size = self->hashtable->size;
     self->max_load = max_load;
+    self->min_load = min_load;
     self->load = self->hashtable->load;
+    self->object_values = object_values;
 
     if (hash_func == NULL) {
         self->hash_func = default_py_hash_func();
@@ -52,6 +190,7 @@ HashTablePyObject_init(HashTablePyObject *self, PyObject *args, PyObject *kwds)
     }
 
     Py_INCREF(self->hash_func);
+    self->hash_callable = native_hash ? NULL : self->hash_func;
 
     return 0;
 }
@@ -59,7 +198,11 @@ HashTablePyObject_init(HashTablePyObject *self, PyObject *args, PyObject *kwds)
 char size_attr__doc__[] = "Current number of bins in hashtable.";
 char load_attr__doc__[] = "Current number of key-value pairs stored in hashtable.";
 char max_load_attr__doc__[] = "Maximum proportion of load to size before resizing.";
-char hash_func_attr__doc__[] = "Hash function used to determine which bin a key-value pair should be stored in.";
+char min_load_attr__doc__[] = "Proportion of load to size below which deletes shrink the hashtable (0.0: never).";
+char object_values_attr__doc__[] = "Whether every value is stored as the object itself "
+                                   "(otherwise only values that aren't an int, float or str are).";
+char hash_func_attr__doc__[] = "Hash function used to determine which bin a key-value pair should be stored in "
+                               "(\"native\" for the hashtable's built-in C hash function).";
 
 static PyMemberDef Hashtable_members[] = {
     {"size",
@@ -71,94 +214,215 @@ static PyMemberDef Hashtable_members[] = {
     {"max_load",
         T_DOUBLE, offsetof(HashTablePyObject, max_load), READONLY,
         max_load_attr__doc__},
+    {"min_load",
+        T_DOUBLE, offsetof(HashTablePyObject, min_load), READONLY,
+        min_load_attr__doc__},
     {"hash_func",
         T_OBJECT, offsetof(HashTablePyObject, hash_func), READONLY,
         hash_func_attr__doc__},
+    {"object_values",
+        T_INT, offsetof(HashTablePyObject, object_values), READONLY,
+        object_values_attr__doc__},
     {NULL}  /* Sentinel */
 };
 
 static void
 HashTablePyObject_dealloc(HashTablePyObject* self)
 {
-    // DECREF DEMO
+    PyObject_GC_UnTrack(self);
     Py_XDECREF(self->hash_func);
-    printf("C: ---------> Dealloc-ing\n");
     if (self->hashtable != NULL) {
-        self->ob_type->tp_free((PyObject*)self);
+        free_table(self->hashtable);
+        release_queued_objects();
+    }
+    if (self->lock != NULL) {
+        PyThread_free_lock(self->lock);
     }
+    self->ob_type->tp_free((PyObject*)self);
 }
 
+/***
+* Garbage collection
+*   A value can refer back to its table, so the collector is shown every OBJECT value.
+*   If another thread holds the lock (or this one does, and allocating set off a
+*   collection), the values are skipped: a reference the collector isn't shown only
+*   keeps objects alive for longer, which is safe, where walking a table that is
+*   changing is not.
+***/
+typedef struct {
+    visitproc visit;
+    void *arg;
+    int result;
+} ObjectVisit;
+
 static void
-HashTablePyObject_free(HashTablePyObject* self)
+visit_object_value(Item *item, void *arg)
 {
-    printf("C: ---------> Free-ing\n");
-    free_table(self->hashtable);
+    ObjectVisit *visit = (ObjectVisit *)arg;
+    if ((item->value_type == OBJECT) && (visit->result == 0)) {
+        visit->result = visit->visit((PyObject *)item->value.object, visit->arg);
+    }
 }
 
+static int
+HashTablePyObject_traverse(HashTablePyObject *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->hash_func);
+    if ((self->hashtable == NULL) || !PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+        return 0;
+    }
+    ObjectVisit walk = {visit, arg, 0};
+    for_each_item(self->hashtable, visit_object_value, &walk);
+    PyThread_release_lock(self->lock);
+    return walk.result;
+}
 
-char HashTablePy_set__doc__[] = "Add a key-value pair to the hashtable.";
-
-static PyObject *
-HashTablePy_set(HashTablePyObject *self, PyObject *args)
+static int
+HashTablePyObject_clear(HashTablePyObject *self)
 {
-    PyObject* key_input = NULL;
-    PyObject* value_input = NULL;
+    if ((self->hashtable != NULL) && PyThread_acquire_lock(self->lock, NOWAIT_LOCK)) {
+        clear_table(self->hashtable);
+        self->load = self->hashtable->load;
+        self->version++;
+        unlock_table(self);
+    }
+    self->hash_callable = NULL;
+    Py_CLEAR(self->hash_func);
+    return 0;
+}
 
-    if (!PyArg_ParseTuple(args, "OO", &key_input, &value_input))
-        return NULL;
 
+/***
+* Adds key_input and value_input to the hashtable. Returns 0, or -1 with an exception set.
+***/
+static int
+set_item(HashTablePyObject *self, PyObject *key_input, PyObject *value_input)
+{
     union Hashable key;
     hash_type key_type = INTEGER; // default
     union Hashable value;
     hash_type value_type = INTEGER;
 
-    if ((set_hashable_from_user_input(&key, &key_type, key_input) < 0) ||
-        (set_hashable_from_user_input(&value, &value_type, value_input) < 0)) {
-            return NULL;
+    if (set_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+            return -1;
+    }
+    if (set_value_from_user_input(&value, &value_type, value_input, self->object_values) < 0) {
+            free_hashable(key, key_type);
+            return -1;
     }
 
-    long int hash = get_hash(key, key_type, self->hash_func);
+    long int hash = get_hash(key_input, key, key_type, self->hash_callable, self->hashtable);
     if (hash == LONG_MAX) { // error
         free_hashable(key, key_type);
         free_hashable(value, value_type);
-        return NULL;
+        return -1;
     }
 
+    lock_table(self);
+    // only resizing a big table is worth giving up the GIL for
+    PyThreadState *state = begin_allow_threads(max_load_reached(self->hashtable) ? self->hashtable->load : 0);
     self->hashtable = add(hash, key, key_type, value, value_type, self->hashtable);
+    end_allow_threads(state);
     self->load = self->hashtable->load;
-    Py_RETURN_NONE;
+    self->size = self->hashtable->size;
+    self->version++;
+    unlock_table(self);
+    return 0;
 }
 
-char HashTablePy_get__doc__[] = "Lookup the value associated with the given key in the hashtable.";
-
-static PyObject *
-HashTablePy_get(HashTablePyObject *self, PyObject *args)
+/***
+* Looks up key_input. Returns 1 and sets *value to a new reference if it's there,
+*   0 if it isn't, or -1 with an exception set.
+***/
+static int
+find_value(HashTablePyObject *self, PyObject *key_input, PyObject **value)
 {
-    PyObject* key_input = NULL;
+    union Hashable key;
+    hash_type key_type = INTEGER; // default
 
-    if (!PyArg_ParseTuple(args, "O", &key_input))
-        return NULL;
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+            return -1;
+    }
+
+    long int hash = get_hash(key_input, key, key_type, self->hash_callable, self->hashtable);
+    if (hash == LONG_MAX) { // error
+        return -1;
+    }
+
+    lock_table(self);
+    Item *item = lookup_by_hash(hash, key, key_type, self->hashtable);
+    *value = (item == NULL) ? NULL : format_python_return_val_from_item(item);
+    unlock_table(self);
+
+    if (item == NULL) {
+        return 0;
+    }
+    return (*value == NULL) ? -1 : 1;
+}
 
+/***
+* Deletes key_input's pair, if there is one. Returns 1 if it was deleted, 0 if there
+*   was none, or -1 with an exception set.
+***/
+static int
+discard_key(HashTablePyObject *self, PyObject *key_input)
+{
     union Hashable key;
     hash_type key_type = INTEGER; // default
 
-    if (set_hashable_from_user_input(&key, &key_type, key_input) < 0) {
-            return NULL;
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+            return -1;
     }
 
-    long int hash = get_hash(key, key_type, self->hash_func);
+    long int hash = get_hash(key_input, key, key_type, self->hash_callable, self->hashtable);
     if (hash == LONG_MAX) { // error
-        free_hashable(key, key_type);
-        return NULL;
+        return -1;
     }
 
-    Item *item = lookup_by_hash(hash, key, key_type, self->hashtable);
-    PyObject* return_val = format_python_return_val_from_item(item);
+    lock_table(self);
+    int discarded = discard_by_hash(hash, key, key_type, self->hashtable);
+    self->load = self->hashtable->load;
+    self->size = self->hashtable->size;
+    self->version += discarded;
+    unlock_table(self);
+    return discarded;
+}
+
+char HashTablePy_set__doc__[] = "Add a key-value pair to the hashtable.";
+
+static PyObject *
+HashTablePy_set(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
+    PyObject* value_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "OO", &key_input, &value_input))
+        return NULL;
 
-    if (key_type == STRING) {
-        free(key.str);
+    if (set_item(self, key_input, value_input) < 0) {
+        return NULL;
     }
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_get__doc__[] = "Lookup the value associated with the given key in the hashtable.";
+
+static PyObject *
+HashTablePy_get(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
 
+    if (!PyArg_ParseTuple(args, "O", &key_input))
+        return NULL;
+
+    PyObject* return_val = NULL;
+    int found = find_value(self, key_input, &return_val);
+    if (found < 0) {
+        return NULL;
+    }
+    if (found == 0) {
+        Py_RETURN_NONE;
+    }
     return return_val;
 }
 
@@ -175,104 +439,1969 @@ HashTablePy_pop(HashTablePyObject *self, PyObject *args)
     union Hashable key;
     hash_type key_type = INTEGER; // default
 
-    if (set_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
             return NULL;
     }
 
-    long int hash = get_hash(key, key_type, self->hash_func);
+    long int hash = get_hash(key_input, key, key_type, self->hash_callable, self->hashtable);
     if (hash == LONG_MAX) { // error
-        free_hashable(key, key_type);
         return NULL;
     }
 
+    lock_table(self);
     Item *item = remove_item_from_table_by_hash(hash, key, key_type, self->hashtable);
     PyObject* return_val = format_python_return_val_from_item(item);
-
-    if (key_type == STRING) {
-        free(key.str);
-    }
-    free_item(item);
+    free_item(item, self->hashtable);
 
     self->load = self->hashtable->load;
+    self->version += (item != NULL);
+    self->size = self->hashtable->size;
+    unlock_table(self);
     return return_val;
 }
 
+char HashTablePy_discard__doc__[] = "Delete the key-value pair associated with given key from the hashtable, if there is one. "
+                                   "Returns True if a pair was deleted.";
+
+static PyObject *
+HashTablePy_discard(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &key_input))
+        return NULL;
+
+    int discarded = discard_key(self, key_input);
+    if (discarded < 0) {
+        return NULL;
+    }
+    return PyBool_FromLong(discarded);
+}
+
+char HashTablePy_bulk_set__doc__[] = "Add every key-value pair from a dict or an iterable of (key, value) pairs. "
+                                     "The hashtable is resized at most once, up front.";
+
+/***
+* Converts and hashes one (key, value) pair for set_pairs.
+*   Returns 0, or -1 with an exception set (in which case nothing is left to free).
+***/
 static int
-HashTablePy_print(HashTablePyObject *self, PyObject *args)
+set_pair(HashTablePyObject *self, PyObject *pair_input, long int *hash,
+         union Hashable *key, hash_type *key_type, union Hashable *value, hash_type *value_type)
 {
-    print_table_simple(self->hashtable);
-    return 0;
+    if (!PyTuple_Check(pair_input) && !PyList_Check(pair_input)) {
+        PyErr_SetString(PyExc_TypeError, "Expected a dict or an iterable of (key, value) pairs.");
+        return -1;
+    }
+    // a list pair is copied too, as the hash_func callback could empty it
+    PyObject* pair = PySequence_Tuple(pair_input);
+    if (pair == NULL) {
+        return -1;
+    }
+    if (PyTuple_GET_SIZE(pair) != 2) {
+        PyErr_SetString(PyExc_ValueError, "Each pair must have exactly two elements.");
+        Py_DECREF(pair);
+        return -1;
+    }
+
+    int result = -1;
+    *key_type = INTEGER; // default
+    *value_type = INTEGER;
+    if (set_hashable_from_user_input(key, key_type, PyTuple_GET_ITEM(pair, 0)) == 0) {
+        if (set_value_from_user_input(value, value_type, PyTuple_GET_ITEM(pair, 1), self->object_values) < 0) {
+            free_hashable(*key, *key_type);
+        }
+        else {
+            *hash = get_hash(PyTuple_GET_ITEM(pair, 0), *key, *key_type, self->hash_callable, self->hashtable);
+            if (*hash == LONG_MAX) { // error
+                free_hashable(*key, *key_type);
+                free_hashable(*value, *value_type);
+            }
+            else {
+                result = 0;
+            }
+        }
+    }
+    Py_DECREF(pair);
+    return result;
 }
 
-static PyObject *
-HashTablePy_repr(HashTablePyObject *self, PyObject *args)
+/***
+* Adds every pair from a dict, a mapping with an items() method (such as another HashTable),
+*   or an iterable of (key, value) pairs, with a single add_many.
+*   Returns 0, or -1 with an exception set (in which case nothing was added).
+***/
+static int
+set_pairs(HashTablePyObject *self, PyObject *pairs_input)
 {
-    char *repr = stringify_table_simple(self->hashtable);
-    PyObject* py_repr = Py_BuildValue("s", repr);
-    free(repr);
-    return py_repr;
+    // tuples of our own, so a hash_func callback can't change the pairs under us
+    PyObject* pairs;
+    if (PyDict_Check(pairs_input) || PyObject_HasAttrString(pairs_input, "keys")) {
+        PyObject* items = PyDict_Check(pairs_input) ? PyDict_Items(pairs_input) : PyMapping_Items(pairs_input);
+        pairs = (items == NULL) ? NULL : PySequence_Tuple(items);
+        Py_XDECREF(items);
+    }
+    else {
+        pairs = PySequence_Tuple(pairs_input);
+    }
+    if (pairs == NULL) {
+        return -1;
+    }
+
+    Py_ssize_t count = PyTuple_GET_SIZE(pairs);
+    long int *hashes = malloc(count*sizeof(long int));
+    union Hashable *keys = malloc(count*sizeof(union Hashable));
+    hash_type *key_types = malloc(count*sizeof(hash_type));
+    union Hashable *values = malloc(count*sizeof(union Hashable));
+    hash_type *value_types = malloc(count*sizeof(hash_type));
+
+    Py_ssize_t i;
+    for (i = 0; i < count; i++) {
+        if (set_pair(self, PyTuple_GET_ITEM(pairs, i), &hashes[i], &keys[i], &key_types[i],
+                     &values[i], &value_types[i]) < 0) {
+            break;
+        }
+    }
+
+    if (i == count) {
+        lock_table(self);
+        PyThreadState *state = begin_allow_threads(count);
+        self->hashtable = add_many(count, hashes, keys, key_types, values, value_types, self->hashtable);
+        end_allow_threads(state);
+        self->load = self->hashtable->load;
+        self->version++;
+        self->size = self->hashtable->size;
+        unlock_table(self);
+    }
+    else {
+        Py_ssize_t j;
+        for (j = 0; j < i; j++) {
+            free_hashable(keys[j], key_types[j]);
+            free_hashable(values[j], value_types[j]);
+        }
+    }
+
+    free(hashes);
+    free(keys);
+    free(key_types);
+    free(values);
+    free(value_types);
+    Py_DECREF(pairs);
+
+    return (i < count) ? -1 : 0;
 }
 
-static PyMethodDef HashTablePy_methods[] = {
-    {"set", (PyCFunction)HashTablePy_set, METH_VARARGS, HashTablePy_set__doc__},
-    {"get", (PyCFunction)HashTablePy_get, METH_VARARGS, HashTablePy_get__doc__},
-    {"pop", (PyCFunction)HashTablePy_pop, METH_VARARGS, HashTablePy_pop__doc__},
-    {NULL}  /* Sentinel */
-};
+static PyObject *
+HashTablePy_bulk_set(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* pairs_input = NULL;
 
-static PyTypeObject HashTablePyType = {
-    PyObject_HEAD_INIT(NULL)
-    0,                                           /* ob_size */
-    "hashtable.HashTable",                       /* tp_name */
-    sizeof(HashTablePyObject),                   /* tp_basicsize */
-    0,                                           /* tp_itemsize */
-    (destructor)HashTablePyObject_dealloc,       /* tp_dealloc */
-    (printfunc)HashTablePy_print,                /* tp_print */
-    0,                                           /* tp_getattr */
-    0,                                           /* tp_setattr */
-    0,                                           /* tp_compare */
-    (reprfunc)HashTablePy_repr,                  /* tp_repr */
-    0,                                           /* tp_as_number */
-    0,                                           /* tp_as_sequence */
-    0,                                           /* tp_as_mapping */
-    0,                                           /* tp_hash */
-    0,                                           /* tp_call */
-    0,                                           /* tp_str */
-    0,                                           /* tp_getattro */
-    0,                                           /* tp_setattro */
-    0,                                           /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT,                          /* tp_flags */
-    "Customizeable HashTable!",                  /* tp_doc */
-    0,                                           /* tp_traverse */
-    0,                                           /* tp_clear */
-    0,                                           /* tp_richcompare */
-    0,                                           /* tp_weaklistoffset */
-    0,                                           /* tp_iter */
-    0,                                           /* tp_iternext */
-    HashTablePy_methods,                         /* tp_methods */
-    Hashtable_members,                           /* tp_members */
-    0,                                           /* tp_getset */
-    0,                                           /* tp_base */
-    0,                                           /* tp_dict */
-    0,                                           /* tp_descr_get */
-    0,                                           /* tp_descr_set */
-    0,                                           /* tp_dictoffset */
-    (initproc)HashTablePyObject_init,            /* tp_init */
-    0,                                           /* tp_alloc */
-    0,                                           /* tp_new */
-    (freefunc)HashTablePyObject_free,            /* tp_free */
-};
+    if (!PyArg_ParseTuple(args, "O", &pairs_input))
+        return NULL;
 
-#ifndef PyMODINIT_FUNC	/* declarations for DLL import/export */
-#define PyMODINIT_FUNC void
-#endif
-PyMODINIT_FUNC
-inithashtable(void)
+    if (set_pairs(self, pairs_input) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_update__doc__[] = "Add every key-value pair from a dict, a mapping or an iterable of (key, value) pairs, "
+                                   "then any keyword arguments, like dict.update. Each source is added in one bulk_set.";
+
+static PyObject *
+HashTablePy_update(HashTablePyObject *self, PyObject *args, PyObject *kwds)
 {
-    PyObject* m;
+    PyObject* pairs_input = NULL;
 
-    HashTablePyType.tp_new = PyType_GenericNew;
-    if (PyType_Ready(&HashTablePyType) < 0)
+    if (!PyArg_ParseTuple(args, "|O:update", &pairs_input))
+        return NULL;
+
+    if ((pairs_input != NULL) && (set_pairs(self, pairs_input) < 0)) {
+        return NULL;
+    }
+    if ((kwds != NULL) && (PyDict_Size(kwds) > 0) && (set_pairs(self, kwds) < 0)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_get_many__doc__[] = "Lookup the values associated with a sequence of keys. "
+                                     "Returns a list, with None for missing keys.";
+
+static PyObject *
+HashTablePy_get_many(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* keys_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &keys_input))
+        return NULL;
+
+    // a tuple, so a hash_func callback can't drop the key strings we borrow
+    PyObject* keys_seq = PySequence_Tuple(keys_input);
+    if (keys_seq == NULL) {
+        return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(keys_seq);
+    union Hashable *keys = malloc(count*sizeof(union Hashable));
+    hash_type *key_types = malloc(count*sizeof(hash_type));
+    long int *hashes = malloc(count*sizeof(long int));
+    Item **found = malloc(count*sizeof(Item*));
+    PyObject* return_val = NULL;
+
+    if (set_hashables_from_sequence(keys_seq, keys, key_types, hashes, self->hash_callable, self->hashtable, 1) == 0) {
+        lock_table(self);
+        PyThreadState *state = begin_allow_threads(count);
+        lookup_many(count, hashes, keys, key_types, found, self->hashtable);
+        end_allow_threads(state);
+
+        return_val = PyList_New(count);
+        Py_ssize_t i;
+        for (i = 0; (return_val != NULL) && (i < count); i++) {
+            PyObject* value = format_python_return_val_from_item(found[i]);
+            if (value == NULL) {
+                Py_CLEAR(return_val);
+                break;
+            }
+            PyList_SET_ITEM(return_val, i, value);
+        }
+        unlock_table(self);
+    }
+
+    free(keys);
+    free(key_types);
+    free(hashes);
+    free(found);
+    Py_DECREF(keys_seq);
+    return return_val;
+}
+
+char HashTablePy_set_many__doc__[] = "Add a key-value pair for each key in one sequence and value in another.";
+
+static PyObject *
+HashTablePy_set_many(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* keys_input = NULL;
+    PyObject* values_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "OO", &keys_input, &values_input))
+        return NULL;
+
+    // tuples, so a hash_func callback can't change either sequence under us
+    PyObject* keys_seq = PySequence_Tuple(keys_input);
+    if (keys_seq == NULL) {
+        return NULL;
+    }
+    PyObject* values_seq = PySequence_Tuple(values_input);
+    if (values_seq == NULL) {
+        Py_DECREF(keys_seq);
+        return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(keys_seq);
+    if (PySequence_Fast_GET_SIZE(values_seq) != count) {
+        PyErr_SetString(PyExc_ValueError, "set_many expects as many values as keys.");
+        Py_DECREF(keys_seq);
+        Py_DECREF(values_seq);
+        return NULL;
+    }
+
+    union Hashable *keys = malloc(count*sizeof(union Hashable));
+    hash_type *key_types = malloc(count*sizeof(hash_type));
+    long int *hashes = malloc(count*sizeof(long int));
+    union Hashable *values = malloc(count*sizeof(union Hashable));
+    hash_type *value_types = malloc(count*sizeof(hash_type));
+    int ok = 0;
+
+    if (set_hashables_from_sequence(keys_seq, keys, key_types, hashes, self->hash_callable, self->hashtable, 0) == 0) {
+        if (set_values_from_sequence(values_seq, values, value_types, self->object_values) == 0) {
+            lock_table(self);
+            PyThreadState *state = begin_allow_threads(count);
+            self->hashtable = add_many(count, hashes, keys, key_types, values, value_types, self->hashtable);
+            end_allow_threads(state);
+            self->load = self->hashtable->load;
+            self->version++;
+            self->size = self->hashtable->size;
+            unlock_table(self);
+            ok = 1;
+        }
+        else {
+            free_hashables(count, keys, key_types);
+        }
+    }
+
+    free(keys);
+    free(key_types);
+    free(hashes);
+    free(values);
+    free(value_types);
+    Py_DECREF(keys_seq);
+    Py_DECREF(values_seq);
+
+    if (!ok) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_pop_many__doc__[] = "Delete the key-value pairs associated with a sequence of keys. "
+                                     "Returns a list of the values, with None for missing keys.";
+
+static PyObject *
+HashTablePy_pop_many(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* keys_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &keys_input))
+        return NULL;
+
+    // a tuple, so a hash_func callback can't drop the key strings we borrow
+    PyObject* keys_seq = PySequence_Tuple(keys_input);
+    if (keys_seq == NULL) {
+        return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(keys_seq);
+    union Hashable *keys = malloc(count*sizeof(union Hashable));
+    hash_type *key_types = malloc(count*sizeof(hash_type));
+    long int *hashes = malloc(count*sizeof(long int));
+    Item **removed = malloc(count*sizeof(Item*));
+    PyObject* return_val = NULL;
+
+    if (set_hashables_from_sequence(keys_seq, keys, key_types, hashes, self->hash_callable, self->hashtable, 1) == 0) {
+        lock_table(self);
+        PyThreadState *state = begin_allow_threads(count);
+        remove_many(count, hashes, keys, key_types, removed, self->hashtable);
+        end_allow_threads(state);
+
+        return_val = PyList_New(count);
+        Py_ssize_t i;
+        for (i = 0; i < count; i++) {
+            if (return_val != NULL) {
+                PyObject* value = format_python_return_val_from_item(removed[i]);
+                if (value == NULL) {
+                    Py_CLEAR(return_val);
+                }
+                else {
+                    PyList_SET_ITEM(return_val, i, value);
+                }
+            }
+            // the pairs are gone from the table either way
+            free_item(removed[i], self->hashtable);
+        }
+        self->load = self->hashtable->load;
+        self->version++;
+        self->size = self->hashtable->size;
+        unlock_table(self);
+    }
+
+    free(keys);
+    free(key_types);
+    free(hashes);
+    free(removed);
+    Py_DECREF(keys_seq);
+    return return_val;
+}
+
+char HashTablePy_clear__doc__[] = "Delete every key-value pair from the hashtable.";
+
+static PyObject *
+HashTablePy_clear(HashTablePyObject *self, PyObject *args)
+{
+    lock_table(self);
+    PyThreadState *state = begin_allow_threads(self->hashtable->load);
+    clear_table(self->hashtable);
+    end_allow_threads(state);
+    self->load = self->hashtable->load;
+    self->version++;
+    unlock_table(self);
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_reserve__doc__[] = "Make room for count key-value pairs in all, so adding them won't resize the hashtable.";
+
+static PyObject *
+HashTablePy_reserve(HashTablePyObject *self, PyObject *args)
+{
+    long int count = 0;
+
+    if (!PyArg_ParseTuple(args, "l", &count))
+        return NULL;
+
+    lock_table(self);
+    PyThreadState *state = begin_allow_threads(self->hashtable->load);
+    self->hashtable = reserve(count, self->hashtable);
+    end_allow_threads(state);
+    self->size = self->hashtable->size;
+    self->version++;
+    unlock_table(self);
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_compact__doc__[] = "Shrink the hashtable to the smallest size that fits its pairs within max_load, "
+                                    "rebuilding its storage contiguously and giving back memory freed by deletes.";
+
+static PyObject *
+HashTablePy_compact(HashTablePyObject *self, PyObject *args)
+{
+    lock_table(self);
+    PyThreadState *state = begin_allow_threads(self->hashtable->load);
+    self->hashtable = compact(self->hashtable);
+    end_allow_threads(state);
+    self->size = self->hashtable->size;
+    self->version++;
+    unlock_table(self);
+    Py_RETURN_NONE;
+}
+
+/***
+* Stream adapters for dump_table and load_table: Python file objects, and byte buffers for pickling
+***/
+static int
+write_to_py_file(const void *data, size_t size, void *file)
+{
+    PyObject* chunk = PyString_FromStringAndSize(data, size);
+    if (chunk == NULL) {
+        return -1;
+    }
+    PyObject* result = PyObject_CallMethod(file, "write", "O", chunk);
+    Py_DECREF(chunk);
+    if (result == NULL) {
+        return -1;
+    }
+    Py_DECREF(result);
+    return 0;
+}
+
+static long int
+read_from_py_file(void *buffer, size_t size, void *file)
+{
+    PyObject* chunk = PyObject_CallMethod(file, "read", "n", (Py_ssize_t)size);
+    if (chunk == NULL) {
+        return -1;
+    }
+    if (!PyString_Check(chunk) || ((size_t)PyString_GET_SIZE(chunk) > size)) {
+        PyErr_SetString(PyExc_TypeError, "file.read must return a string of at most the requested size.");
+        Py_DECREF(chunk);
+        return -1;
+    }
+    long int got = PyString_GET_SIZE(chunk);
+    memcpy(buffer, PyString_AS_STRING(chunk), got);
+    Py_DECREF(chunk);
+    return got;
+}
+
+typedef struct byte_buffer {
+    char *data;
+    size_t size;
+    size_t capacity; // when writing
+    size_t position; // when reading
+} ByteBuffer;
+
+static int
+write_to_buffer(const void *data, size_t size, void *arg)
+{
+    ByteBuffer *buffer = arg;
+    if (buffer->size + size > buffer->capacity) {
+        while (buffer->size + size > buffer->capacity) {
+            buffer->capacity *= 2;
+        }
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 0;
+}
+
+static long int
+read_from_buffer(void *to, size_t size, void *arg)
+{
+    ByteBuffer *buffer = arg;
+    if (size > buffer->size - buffer->position) {
+        size = buffer->size - buffer->position;
+    }
+    memcpy(to, buffer->data + buffer->position, size);
+    buffer->position += size;
+    return size;
+}
+
+static const char *
+storage_name(storage_type storage)
+{
+    switch (storage) {
+        case OPEN_ADDRESSING:
+            return "open";
+        case SWISS_TABLE:
+            return "swiss";
+        default:
+            return "chained";
+    }
+}
+
+/***
+* Replaces self's table with one read by load_table, keeping self's storage and
+*   resize settings. Returns 0, or -1 with an exception set if the stream is bad.
+***/
+static int
+load_into(HashTablePyObject *self, stream_reader read, void *arg)
+{
+    lock_table(self);
+    TableOptions options = default_table_options();
+    options.storage = self->hashtable->storage;
+    options.power_of_two_size = self->hashtable->power_of_two_size;
+    options.incremental_resize = self->hashtable->incremental_resize;
+    options.min_load_proportion = self->hashtable->min_load_proportion;
+    unlock_table(self);
+
+    // read callbacks may run Python code, so build the new table without holding the lock
+    HashTable *loaded = load_table(read, arg, self->max_load, options);
+    if (loaded == NULL) {
+        if (!PyErr_Occurred()) {
+            PyErr_SetString(PyExc_ValueError, "Not a complete hashtable stream.");
+        }
+        return -1;
+    }
+
+    lock_table(self);
+    HashTable *old = self->hashtable;
+    loaded->stats = old->stats; // the counters carry on
+    old->stats = NULL;
+    self->hashtable = loaded;
+    self->load = loaded->load;
+    self->size = loaded->size;
+    self->version++;
+    unlock_table(self);
+
+    PyThreadState *state = begin_allow_threads(old->load);
+    free_table(old);
+    end_allow_threads(state);
+    release_queued_objects();
+    return 0;
+}
+
+char HashTablePy_dump__doc__[] = "Write every key-value pair to a file object, in chunks of chunk_items pairs (default 4096). "
+                                 "The file must not use this hashtable while it is being written.";
+
+static PyObject *
+HashTablePy_dump(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* file = NULL;
+    long int chunk_items = STREAM_CHUNK_ITEMS;
+
+    if (!PyArg_ParseTuple(args, "O|l", &file, &chunk_items))
+        return NULL;
+
+    lock_table(self);
+    int result = dump_table(write_to_py_file, file, chunk_items, self->hashtable);
+    unlock_table(self);
+
+    if (result < 0) {
+        if (!PyErr_Occurred()) { // rather than file.write raising
+            PyErr_SetString(PyExc_TypeError, "Can't dump a hashtable holding object values.");
+        }
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_load_from__doc__[] = "Replace the hashtable's contents with key-value pairs read from a file object "
+                                      "written by dump, from a hashtable with the same hash_func. "
+                                      "Pairs are read and added a chunk at a time.";
+
+static PyObject *
+HashTablePy_load_from(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* file = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &file))
+        return NULL;
+
+    if (load_into(self, read_from_py_file, file) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+HashTablePy_reduce(HashTablePyObject *self, PyObject *args)
+{
+    ByteBuffer buffer;
+    buffer.capacity = 4096;
+    buffer.data = malloc(buffer.capacity);
+    buffer.size = 0;
+
+    lock_table(self);
+    PyThreadState *state = begin_allow_threads(self->hashtable->load);
+    int result = dump_table(write_to_buffer, &buffer, STREAM_CHUNK_ITEMS, self->hashtable);
+    end_allow_threads(state);
+    HashTable *hashtable = self->hashtable;
+    PyObject* return_val = NULL;
+    if (result < 0) {
+        PyErr_SetString(PyExc_TypeError, "Can't pickle a hashtable holding object values.");
+    }
+    else {
+        return_val = Py_BuildValue("O(ldOsiiidi)N", (PyObject *)Py_TYPE(self), self->size, self->max_load,
+                                   self->hash_func, storage_name(hashtable->storage),
+                                   hashtable->power_of_two_size, hashtable->incremental_resize,
+                                   hashtable->stats != NULL, hashtable->min_load_proportion, self->object_values,
+                                   PyString_FromStringAndSize(buffer.data, buffer.size));
+    }
+    unlock_table(self);
+
+    free(buffer.data);
+    return return_val;
+}
+
+static PyObject *
+HashTablePy_setstate(HashTablePyObject *self, PyObject *args)
+{
+    PyObject* stream = NULL;
+
+    if (!PyArg_ParseTuple(args, "S", &stream))
+        return NULL;
+
+    ByteBuffer buffer;
+    buffer.data = PyString_AS_STRING(stream);
+    buffer.size = PyString_GET_SIZE(stream);
+    buffer.position = 0;
+    if (load_into(self, read_from_buffer, &buffer) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+char HashTablePy_freeze__doc__[] = "Return a read-only FrozenHashTable holding the same key-value pairs, "
+                                   "indexed by a minimal perfect hash.";
+
+static PyObject *HashTablePy_freeze(HashTablePyObject *self, PyObject *args);
+
+char HashTablePy_stats__doc__[] = "Return a dict of statistics: the probe length histogram (probe_histogram[i] items are "
+                                  "found by a probe of length i + 1, the last entry counting every longer one), max_probe, "
+                                  "mean_probe and bytes_allocated, measured from the table as it is. Tables created with "
+                                  "collect_stats=True also report their adds, updates, lookups, hits, misses, removes, "
+                                  "resizes and resize_seconds so far.";
+
+static PyObject *
+HashTablePy_stats(HashTablePyObject *self, PyObject *args)
+{
+    TableStats stats;
+    lock_table(self);
+    PyThreadState *state = begin_allow_threads(self->hashtable->load);
+    table_stats(self->hashtable, &stats);
+    end_allow_threads(state);
+    int collecting = (self->hashtable->stats != NULL);
+    long int load = self->hashtable->load;
+    unlock_table(self);
+
+    PyObject *histogram = PyList_New(STATS_HISTOGRAM_BUCKETS);
+    if (histogram == NULL) {
+        return NULL;
+    }
+    long int total = 0;
+    int i;
+    for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        PyObject *bucket = PyInt_FromLong(stats.probe_histogram[i]);
+        if (bucket == NULL) {
+            Py_DECREF(histogram);
+            return NULL;
+        }
+        PyList_SET_ITEM(histogram, i, bucket);
+        total += (i + 1) * stats.probe_histogram[i];
+    }
+    // "O" rather than "N", so histogram is released here whether or not the dict gets built
+    PyObject *result = Py_BuildValue("{s:O,s:l,s:d,s:l}", "probe_histogram", histogram,
+                                     "max_probe", stats.max_probe,
+                                     "mean_probe", (load > 0) ? (double)total / (double)load : 0.0,
+                                     "bytes_allocated", stats.bytes_allocated);
+    Py_DECREF(histogram);
+    if ((result == NULL) || !collecting) {
+        return result;
+    }
+
+    PyObject *counters = Py_BuildValue("{s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:l,s:d}",
+                                       "adds", stats.adds,
+                                       "updates", stats.updates,
+                                       "lookups", stats.lookups,
+                                       "hits", stats.lookup_hits,
+                                       "misses", stats.lookups - stats.lookup_hits,
+                                       "removes", stats.removes,
+                                       "remove_hits", stats.remove_hits,
+                                       "remove_misses", stats.removes - stats.remove_hits,
+                                       "resizes", stats.resizes,
+                                       "resize_seconds", stats.resize_seconds);
+    if ((counters == NULL) || (PyDict_Update(result, counters) < 0)) {
+        Py_XDECREF(counters);
+        Py_DECREF(result);
+        return NULL;
+    }
+    Py_DECREF(counters);
+    return result;
+}
+
+/***
+* Iteration
+*   Iterators walk the bins (or slots) in place, one pair per next(), holding the
+*   table's lock only while they step. Nothing is copied up front, so a table can be
+*   iterated however big it is. Every change to the table bumps its version; an
+*   iterator that sees a different version from the one it started with raises
+*   RuntimeError rather than skip or repeat pairs.
+***/
+typedef enum {ITERATE_KEYS, ITERATE_VALUES, ITERATE_ITEMS} iteration_kind;
+
+typedef struct {
+    PyObject_HEAD
+    HashTablePyObject *table;  // NULL once the iterator is exhausted
+    iteration_kind kind;
+    unsigned long int version; // the table's version when iteration began
+    long int index;            // next bin or slot to look in
+    Node *node;                // CHAINED only -- next node of the current bin
+} HashTableIterPyObject;
+
+static PyTypeObject HashTableIterPyType;
+
+static PyObject *
+make_iterator(HashTablePyObject *table, iteration_kind kind)
+{
+    HashTableIterPyObject *iterator = PyObject_GC_New(HashTableIterPyObject, &HashTableIterPyType);
+    if (iterator == NULL) {
+        return NULL;
+    }
+    Py_INCREF(table);
+    iterator->table = table;
+    iterator->kind = kind;
+    iterator->index = 0;
+    iterator->node = NULL;
+
+    lock_table(table);
+    // a chained table moves bins between arrays during an incremental resize -- finish it,
+    // so only a change that bumps the version can move anything
+    finish_rehash(table->hashtable);
+    iterator->version = table->version;
+    unlock_table(table);
+    PyObject_GC_Track(iterator);
+    return (PyObject *)iterator;
+}
+
+static void
+HashTableIterPyObject_dealloc(HashTableIterPyObject *self)
+{
+    PyObject_GC_UnTrack(self);
+    Py_XDECREF(self->table);
+    PyObject_GC_Del(self);
+}
+
+static int
+HashTableIterPyObject_traverse(HashTableIterPyObject *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->table);
+    return 0;
+}
+
+static PyObject *
+item_to_python(Item *item, iteration_kind kind)
+{
+    if (kind == ITERATE_VALUES) {
+        return format_python_return_val_from_item(item);
+    }
+    PyObject* key = hashable_to_python(item->key, item->key_type);
+    if ((key == NULL) || (kind == ITERATE_KEYS)) {
+        return key;
+    }
+    PyObject* value = format_python_return_val_from_item(item);
+    if (value == NULL) {
+        Py_DECREF(key);
+        return NULL;
+    }
+    return Py_BuildValue("(NN)", key, value);
+}
+
+static PyObject *
+HashTableIterPy_next(HashTableIterPyObject *self)
+{
+    HashTablePyObject *table = self->table;
+    if (table == NULL) {
+        return NULL;
+    }
+
+    lock_table(table);
+    if (table->version != self->version) {
+        unlock_table(table);
+        PyErr_SetString(PyExc_RuntimeError, "HashTable changed during iteration");
+        return NULL;
+    }
+    HashTable *hashtable = table->hashtable;
+    Item *item = NULL;
+    if (hashtable->storage == CHAINED) {
+        while ((self->node == NULL) && (self->index < hashtable->size)) {
+            self->node = hashtable->bin_list[self->index++];
+        }
+        if (self->node != NULL) {
+            item = &self->node->item;
+            self->node = self->node->next;
+        }
+    }
+    else {
+        while ((item == NULL) && (self->index < hashtable->size)) {
+            item = item_in_slot(self->index++, hashtable);
+        }
+    }
+    PyObject* return_val = (item == NULL) ? NULL : item_to_python(item, self->kind);
+    unlock_table(table);
+
+    if (item == NULL) {
+        Py_CLEAR(self->table); // exhausted
+    }
+    return return_val;
+}
+
+static PyTypeObject HashTableIterPyType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                           /* ob_size */
+    "hashtable.HashTableIterator",               /* tp_name */
+    sizeof(HashTableIterPyObject),               /* tp_basicsize */
+    0,                                           /* tp_itemsize */
+    (destructor)HashTableIterPyObject_dealloc,   /* tp_dealloc */
+    0,                                           /* tp_print */
+    0,                                           /* tp_getattr */
+    0,                                           /* tp_setattr */
+    0,                                           /* tp_compare */
+    0,                                           /* tp_repr */
+    0,                                           /* tp_as_number */
+    0,                                           /* tp_as_sequence */
+    0,                                           /* tp_as_mapping */
+    0,                                           /* tp_hash */
+    0,                                           /* tp_call */
+    0,                                           /* tp_str */
+    0,                                           /* tp_getattro */
+    0,                                           /* tp_setattro */
+    0,                                           /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,     /* tp_flags */
+    "Iterator over a HashTable's keys, values or items.", /* tp_doc */
+    (traverseproc)HashTableIterPyObject_traverse, /* tp_traverse */
+    0,                                           /* tp_clear */
+    0,                                           /* tp_richcompare */
+    0,                                           /* tp_weaklistoffset */
+    PyObject_SelfIter,                           /* tp_iter */
+    (iternextfunc)HashTableIterPy_next,          /* tp_iternext */
+};
+
+static PyObject *
+HashTablePy_iter(HashTablePyObject *self)
+{
+    return make_iterator(self, ITERATE_KEYS);
+}
+
+char HashTablePy_iterkeys__doc__[] = "Return an iterator over the keys, which raises RuntimeError if the hashtable changes.";
+
+static PyObject *
+HashTablePy_iterkeys(HashTablePyObject *self, PyObject *args)
+{
+    return make_iterator(self, ITERATE_KEYS);
+}
+
+char HashTablePy_itervalues__doc__[] = "Return an iterator over the values, which raises RuntimeError if the hashtable changes.";
+
+static PyObject *
+HashTablePy_itervalues(HashTablePyObject *self, PyObject *args)
+{
+    return make_iterator(self, ITERATE_VALUES);
+}
+
+char HashTablePy_iteritems__doc__[] = "Return an iterator over (key, value) pairs, which raises RuntimeError if the "
+                                      "hashtable changes.";
+
+static PyObject *
+HashTablePy_iteritems(HashTablePyObject *self, PyObject *args)
+{
+    return make_iterator(self, ITERATE_ITEMS);
+}
+
+static PyObject *
+list_from_iterator(PyObject *iterator)
+{
+    if (iterator == NULL) {
+        return NULL;
+    }
+    PyObject* list = PySequence_List(iterator);
+    Py_DECREF(iterator);
+    return list;
+}
+
+char HashTablePy_keys__doc__[] = "Return a list of the keys.";
+
+static PyObject *
+HashTablePy_keys(HashTablePyObject *self, PyObject *args)
+{
+    return list_from_iterator(make_iterator(self, ITERATE_KEYS));
+}
+
+char HashTablePy_values__doc__[] = "Return a list of the values.";
+
+static PyObject *
+HashTablePy_values(HashTablePyObject *self, PyObject *args)
+{
+    return list_from_iterator(make_iterator(self, ITERATE_VALUES));
+}
+
+char HashTablePy_items__doc__[] = "Return a list of (key, value) pairs.";
+
+static PyObject *
+HashTablePy_items(HashTablePyObject *self, PyObject *args)
+{
+    return list_from_iterator(make_iterator(self, ITERATE_ITEMS));
+}
+
+/***
+* Mapping protocol: len(h), h[key], h[key] = value, del h[key] and key in h
+***/
+static Py_ssize_t
+HashTablePy_length(HashTablePyObject *self)
+{
+    return self->load;
+}
+
+static PyObject *
+HashTablePy_subscript(HashTablePyObject *self, PyObject *key_input)
+{
+    PyObject* value = NULL;
+    int found = find_value(self, key_input, &value);
+    if (found == 0) {
+        PyErr_SetObject(PyExc_KeyError, key_input);
+    }
+    return (found > 0) ? value : NULL;
+}
+
+static int
+HashTablePy_ass_subscript(HashTablePyObject *self, PyObject *key_input, PyObject *value_input)
+{
+    if (value_input != NULL) {
+        return set_item(self, key_input, value_input);
+    }
+    int discarded = discard_key(self, key_input);
+    if (discarded == 0) {
+        PyErr_SetObject(PyExc_KeyError, key_input);
+        return -1;
+    }
+    return (discarded > 0) ? 0 : -1;
+}
+
+static int
+HashTablePy_contains(HashTablePyObject *self, PyObject *key_input)
+{
+    union Hashable key;
+    hash_type key_type = INTEGER; // default
+
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+            return -1;
+    }
+
+    long int hash = get_hash(key_input, key, key_type, self->hash_callable, self->hashtable);
+    if (hash == LONG_MAX) { // error
+        return -1;
+    }
+
+    // no need to build the value just to throw it away
+    lock_table(self);
+    int found = (lookup_by_hash(hash, key, key_type, self->hashtable) != NULL);
+    unlock_table(self);
+    return found;
+}
+
+static PyMappingMethods HashTablePy_as_mapping = {
+    (lenfunc)HashTablePy_length,                 /* mp_length */
+    (binaryfunc)HashTablePy_subscript,           /* mp_subscript */
+    (objobjargproc)HashTablePy_ass_subscript,    /* mp_ass_subscript */
+};
+
+static PySequenceMethods HashTablePy_as_sequence = {
+    0,                                           /* sq_length */
+    0,                                           /* sq_concat */
+    0,                                           /* sq_repeat */
+    0,                                           /* sq_item */
+    0,                                           /* sq_slice */
+    0,                                           /* sq_ass_item */
+    0,                                           /* sq_ass_slice */
+    (objobjproc)HashTablePy_contains,            /* sq_contains */
+};
+
+static int
+HashTablePy_print(HashTablePyObject *self, PyObject *args)
+{
+    lock_table(self);
+    print_table_simple(self->hashtable);
+    unlock_table(self);
+    return 0;
+}
+
+static PyObject *
+HashTablePy_repr(HashTablePyObject *self, PyObject *args)
+{
+    lock_table(self);
+    char *repr = stringify_table_simple(self->hashtable);
+    unlock_table(self);
+    PyObject* py_repr = Py_BuildValue("s", repr);
+    free(repr);
+    return py_repr;
+}
+
+static PyMethodDef HashTablePy_methods[] = {
+    {"set", (PyCFunction)HashTablePy_set, METH_VARARGS, HashTablePy_set__doc__},
+    {"get", (PyCFunction)HashTablePy_get, METH_VARARGS, HashTablePy_get__doc__},
+    {"pop", (PyCFunction)HashTablePy_pop, METH_VARARGS, HashTablePy_pop__doc__},
+    {"discard", (PyCFunction)HashTablePy_discard, METH_VARARGS, HashTablePy_discard__doc__},
+    {"bulk_set", (PyCFunction)HashTablePy_bulk_set, METH_VARARGS, HashTablePy_bulk_set__doc__},
+    {"update", (PyCFunction)HashTablePy_update, METH_VARARGS | METH_KEYWORDS, HashTablePy_update__doc__},
+    {"keys", (PyCFunction)HashTablePy_keys, METH_NOARGS, HashTablePy_keys__doc__},
+    {"values", (PyCFunction)HashTablePy_values, METH_NOARGS, HashTablePy_values__doc__},
+    {"items", (PyCFunction)HashTablePy_items, METH_NOARGS, HashTablePy_items__doc__},
+    {"iterkeys", (PyCFunction)HashTablePy_iterkeys, METH_NOARGS, HashTablePy_iterkeys__doc__},
+    {"itervalues", (PyCFunction)HashTablePy_itervalues, METH_NOARGS, HashTablePy_itervalues__doc__},
+    {"iteritems", (PyCFunction)HashTablePy_iteritems, METH_NOARGS, HashTablePy_iteritems__doc__},
+    {"get_many", (PyCFunction)HashTablePy_get_many, METH_VARARGS, HashTablePy_get_many__doc__},
+    {"set_many", (PyCFunction)HashTablePy_set_many, METH_VARARGS, HashTablePy_set_many__doc__},
+    {"pop_many", (PyCFunction)HashTablePy_pop_many, METH_VARARGS, HashTablePy_pop_many__doc__},
+    {"clear", (PyCFunction)HashTablePy_clear, METH_NOARGS, HashTablePy_clear__doc__},
+    {"reserve", (PyCFunction)HashTablePy_reserve, METH_VARARGS, HashTablePy_reserve__doc__},
+    {"compact", (PyCFunction)HashTablePy_compact, METH_NOARGS, HashTablePy_compact__doc__},
+    {"dump", (PyCFunction)HashTablePy_dump, METH_VARARGS, HashTablePy_dump__doc__},
+    {"load_from", (PyCFunction)HashTablePy_load_from, METH_VARARGS, HashTablePy_load_from__doc__},
+    {"freeze", (PyCFunction)HashTablePy_freeze, METH_NOARGS, HashTablePy_freeze__doc__},
+    {"stats", (PyCFunction)HashTablePy_stats, METH_NOARGS, HashTablePy_stats__doc__},
+    {"__reduce__", (PyCFunction)HashTablePy_reduce, METH_NOARGS, "Support for pickling."},
+    {"__setstate__", (PyCFunction)HashTablePy_setstate, METH_VARARGS, "Support for unpickling."},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject HashTablePyType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                           /* ob_size */
+    "hashtable.HashTable",                       /* tp_name */
+    sizeof(HashTablePyObject),                   /* tp_basicsize */
+    0,                                           /* tp_itemsize */
+    (destructor)HashTablePyObject_dealloc,       /* tp_dealloc */
+    (printfunc)HashTablePy_print,                /* tp_print */
+    0,                                           /* tp_getattr */
+    0,                                           /* tp_setattr */
+    0,                                           /* tp_compare */
+    (reprfunc)HashTablePy_repr,                  /* tp_repr */
+    0,                                           /* tp_as_number */
+    &HashTablePy_as_sequence,                    /* tp_as_sequence */
+    &HashTablePy_as_mapping,                     /* tp_as_mapping */
+    0,                                           /* tp_hash */
+    0,                                           /* tp_call */
+    0,                                           /* tp_str */
+    0,                                           /* tp_getattro */
+    0,                                           /* tp_setattro */
+    0,                                           /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,     /* tp_flags */
+    "Customizeable HashTable!",                  /* tp_doc */
+    (traverseproc)HashTablePyObject_traverse,    /* tp_traverse */
+    (inquiry)HashTablePyObject_clear,            /* tp_clear */
+    0,                                           /* tp_richcompare */
+    0,                                           /* tp_weaklistoffset */
+    (getiterfunc)HashTablePy_iter,               /* tp_iter */
+    0,                                           /* tp_iternext */
+    HashTablePy_methods,                         /* tp_methods */
+    Hashtable_members,                           /* tp_members */
+    0,                                           /* tp_getset */
+    0,                                           /* tp_base */
+    0,                                           /* tp_dict */
+    0,                                           /* tp_descr_get */
+    0,                                           /* tp_descr_set */
+    0,                                           /* tp_dictoffset */
+    (initproc)HashTablePyObject_init,            /* tp_init */
+    0,                                           /* tp_alloc */
+    0,                                           /* tp_new */
+    0,                                           /* tp_free */
+};
+
+/***
+* FrozenHashTable: a read-only table built by HashTable.freeze, or from a snapshot file
+*   Frozen tables never change, so they have no lock, and lookups don't call hash_func:
+*   keys are found by their contents alone.
+***/
+typedef struct {
+    PyObject_HEAD
+    FrozenHashTable *table;
+    long int load;
+} FrozenHashTablePyObject;
+
+static PyTypeObject FrozenHashTablePyType;
+
+static int
+FrozenHashTablePyObject_init(FrozenHashTablePyObject *self, PyObject *args, PyObject *kwds)
+{
+    char *path = NULL;
+
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return -1;
+
+    Snapshot *snapshot = open_snapshot(path);
+    if (snapshot == NULL) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+        return -1;
+    }
+    FrozenHashTable *table = freeze_snapshot(snapshot);
+    close_snapshot(snapshot);
+    if (table == NULL) {
+        PyErr_SetString(PyExc_ValueError, "Snapshot holds the same key twice.");
+        return -1;
+    }
+
+    if (self->table != NULL) {
+        frozen_free(self->table);
+    }
+    self->table = table;
+    self->load = table->count;
+    return 0;
+}
+
+static void
+FrozenHashTablePyObject_dealloc(FrozenHashTablePyObject *self)
+{
+    if (self->table != NULL) {
+        frozen_free(self->table);
+    }
+    self->ob_type->tp_free((PyObject*)self);
+}
+
+static PyObject *
+HashTablePy_freeze(HashTablePyObject *self, PyObject *args)
+{
+    FrozenHashTablePyObject *frozen = (FrozenHashTablePyObject *)PyType_GenericAlloc(&FrozenHashTablePyType, 0);
+    if (frozen == NULL) {
+        return NULL;
+    }
+
+    lock_table(self);
+    PyThreadState *state = begin_allow_threads(self->hashtable->load);
+    frozen->table = freeze(self->hashtable);
+    end_allow_threads(state);
+    unlock_table(self);
+
+    if (frozen->table == NULL) { // a HashTable never holds a key twice, so it must hold object values
+        Py_DECREF(frozen);
+        PyErr_SetString(PyExc_TypeError, "Can't freeze a hashtable holding object values.");
+        return NULL;
+    }
+    frozen->load = frozen->table->count;
+    return (PyObject *)frozen;
+}
+
+static PyObject *
+FrozenHashTablePy_get(FrozenHashTablePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &key_input))
+        return NULL;
+
+    union Hashable key;
+    hash_type key_type = INTEGER; // default
+
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+            return NULL;
+    }
+
+    Item item;
+    int found = frozen_lookup(key, key_type, self->table, &item);
+    return format_python_return_val_from_item(found ? &item : NULL);
+}
+
+static PyObject *
+FrozenHashTablePy_get_many(FrozenHashTablePyObject *self, PyObject *args)
+{
+    PyObject* keys_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &keys_input))
+        return NULL;
+
+    PyObject* keys_seq = PySequence_Tuple(keys_input);
+    if (keys_seq == NULL) {
+        return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(keys_seq);
+    union Hashable *keys = malloc(count*sizeof(union Hashable));
+    hash_type *key_types = malloc(count*sizeof(hash_type));
+    long int *positions = malloc(count*sizeof(long int));
+    PyObject* return_val = NULL;
+
+    if (set_hashables_from_sequence(keys_seq, keys, key_types, NULL, NULL, NULL, 1) == 0) {
+        Py_ssize_t i;
+        PyThreadState *state = begin_allow_threads(count);
+        for (i = 0; i < count; i++) {
+            positions[i] = frozen_position(keys[i], key_types[i], self->table);
+        }
+        end_allow_threads(state);
+
+        return_val = PyList_New(count);
+        for (i = 0; (return_val != NULL) && (i < count); i++) {
+            Item item;
+            if (positions[i] >= 0) {
+                frozen_item(positions[i], self->table, &item);
+            }
+            PyObject* value = format_python_return_val_from_item((positions[i] >= 0) ? &item : NULL);
+            if (value == NULL) {
+                Py_CLEAR(return_val);
+                break;
+            }
+            PyList_SET_ITEM(return_val, i, value);
+        }
+    }
+
+    free(keys);
+    free(key_types);
+    free(positions);
+    Py_DECREF(keys_seq);
+    return return_val;
+}
+
+static PyObject *
+FrozenHashTablePy_save_snapshot(FrozenHashTablePyObject *self, PyObject *args)
+{
+    char *path = NULL;
+
+    if (!PyArg_ParseTuple(args, "s", &path))
+        return NULL;
+
+    if (save_frozen_snapshot(self->table, path) < 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMemberDef FrozenHashTable_members[] = {
+    {"load",
+        T_LONG, offsetof(FrozenHashTablePyObject, load), READONLY,
+        load_attr__doc__},
+    {NULL}  /* Sentinel */
+};
+
+static PyMethodDef FrozenHashTablePy_methods[] = {
+    {"get", (PyCFunction)FrozenHashTablePy_get, METH_VARARGS, HashTablePy_get__doc__},
+    {"get_many", (PyCFunction)FrozenHashTablePy_get_many, METH_VARARGS, HashTablePy_get_many__doc__},
+    {"save_snapshot", (PyCFunction)FrozenHashTablePy_save_snapshot, METH_VARARGS,
+        "Write the table to a snapshot file, which FrozenHashTable(path) reads back."},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject FrozenHashTablePyType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                           /* ob_size */
+    "hashtable.FrozenHashTable",                 /* tp_name */
+    sizeof(FrozenHashTablePyObject),             /* tp_basicsize */
+    0,                                           /* tp_itemsize */
+    (destructor)FrozenHashTablePyObject_dealloc, /* tp_dealloc */
+    0,                                           /* tp_print */
+    0,                                           /* tp_getattr */
+    0,                                           /* tp_setattr */
+    0,                                           /* tp_compare */
+    0,                                           /* tp_repr */
+    0,                                           /* tp_as_number */
+    0,                                           /* tp_as_sequence */
+    0,                                           /* tp_as_mapping */
+    0,                                           /* tp_hash */
+    0,                                           /* tp_call */
+    0,                                           /* tp_str */
+    0,                                           /* tp_getattro */
+    0,                                           /* tp_setattro */
+    0,                                           /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                          /* tp_flags */
+    "Read-only HashTable, built by HashTable.freeze() or from a snapshot file path.", /* tp_doc */
+    0,                                           /* tp_traverse */
+    0,                                           /* tp_clear */
+    0,                                           /* tp_richcompare */
+    0,                                           /* tp_weaklistoffset */
+    0,                                           /* tp_iter */
+    0,                                           /* tp_iternext */
+    FrozenHashTablePy_methods,                   /* tp_methods */
+    FrozenHashTable_members,                     /* tp_members */
+    0,                                           /* tp_getset */
+    0,                                           /* tp_base */
+    0,                                           /* tp_dict */
+    0,                                           /* tp_descr_get */
+    0,                                           /* tp_descr_set */
+    0,                                           /* tp_dictoffset */
+    (initproc)FrozenHashTablePyObject_init,      /* tp_init */
+    0,                                           /* tp_alloc */
+    0,                                           /* tp_new */
+};
+
+/***
+* Cache: a bounded table that evicts with CLOCK (see cache.c)
+*   Keys are hashed by the table's own C hash function, and values are stored as the
+*   objects themselves. Evicted pairs are collected while the cache is being changed,
+*   and passed to on_evict(key, value) once it's consistent again -- so on_evict may
+*   use the cache. An exception from on_evict is raised by the call that evicted.
+***/
+typedef struct {
+    PyObject_HEAD
+    Cache *cache;
+    long int capacity;
+    long int load;
+    PyObject *on_evict; // or NULL
+    PyObject *evicted;  // (key, value) pairs waiting for on_evict, or NULL without it
+} CachePyObject;
+
+static PyTypeObject CachePyType;
+
+static void
+queue_evicted_pair(Item *evicted, void *arg)
+{
+    CachePyObject *self = (CachePyObject *)arg;
+    PyObject* key = hashable_to_python(evicted->key, evicted->key_type);
+    PyObject* value = hashable_to_python(evicted->value, evicted->value_type);
+    PyObject* pair = ((key == NULL) || (value == NULL)) ? NULL : PyTuple_Pack(2, key, value);
+    if ((pair == NULL) || (PyList_Append(self->evicted, pair) < 0)) {
+        PyErr_Clear(); // out of memory -- the pair is evicted without telling on_evict
+    }
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    Py_XDECREF(pair);
+}
+
+/***
+* Called once the cache has been changed: drops released values, and passes any
+*   evicted pairs to on_evict. Returns 0, or -1 if on_evict raised.
+***/
+static int
+finish_cache_change(CachePyObject *self)
+{
+    self->load = self->cache->count;
+    release_queued_objects();
+    if ((self->evicted == NULL) || (PyList_GET_SIZE(self->evicted) == 0)) {
+        return 0;
+    }
+
+    // a fresh list for anything on_evict itself evicts
+    PyObject* pending = self->evicted;
+    self->evicted = PyList_New(0);
+    if (self->evicted == NULL) {
+        self->evicted = pending;
+        return -1;
+    }
+    Py_ssize_t i;
+    int result = 0;
+    for (i = 0; (result == 0) && (i < PyList_GET_SIZE(pending)); i++) {
+        PyObject* returned = PyObject_CallObject(self->on_evict, PyList_GET_ITEM(pending, i));
+        if (returned == NULL) {
+            result = -1;
+        }
+        Py_XDECREF(returned);
+    }
+    Py_DECREF(pending);
+    return result;
+}
+
+static int
+CachePyObject_init(CachePyObject *self, PyObject *args, PyObject *kwds)
+{
+    long int capacity = 0;
+    PyObject *on_evict = Py_None;
+    char *storage = "chained";
+    double max_load = 0.75;
+
+    static char *kwlist[] = {"capacity", "on_evict", "storage", "max_load", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "l|Osd", kwlist, &capacity, &on_evict, &storage, &max_load))
+        return -1;
+    if (capacity <= 0) {
+        PyErr_SetString(PyExc_TypeError, "capacity parameter must be a positive integer.");
+        return -1;
+    }
+    if ((max_load <= 0) || (max_load > 1)) {
+        PyErr_SetString(PyExc_TypeError, "max_load parameter must be a float between 0.0 and 1.0.");
+        return -1;
+    }
+    if ((on_evict != Py_None) && !PyCallable_Check(on_evict)) {
+        PyErr_SetString(PyExc_TypeError, "on_evict must be callable, or None.");
+        return -1;
+    }
+    TableOptions options = default_table_options();
+    if (storage_from_name(storage, &options.storage) < 0) {
+        return -1;
+    }
+
+    if (self->cache != NULL) {
+        cache_free(self->cache);
+        release_queued_objects();
+    }
+    self->cache = cache_init(capacity, max_load, options);
+    self->capacity = capacity;
+    self->load = 0;
+    Py_CLEAR(self->on_evict);
+    Py_CLEAR(self->evicted);
+    if (on_evict != Py_None) {
+        Py_INCREF(on_evict);
+        self->on_evict = on_evict;
+        self->evicted = PyList_New(0);
+        if (self->evicted == NULL) {
+            return -1;
+        }
+        cache_set_eviction_callback(queue_evicted_pair, self, self->cache);
+    }
+    return 0;
+}
+
+static int
+CachePyObject_traverse(CachePyObject *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->on_evict);
+    Py_VISIT(self->evicted);
+    if (self->cache != NULL) {
+        long int i;
+        for (i = 0; i < self->cache->count; i++) {
+            Item *item = &self->cache->ring[i].item;
+            if (item->value_type == OBJECT) {
+                Py_VISIT((PyObject *)item->value.object);
+            }
+        }
+    }
+    return 0;
+}
+
+static int
+CachePyObject_clear(CachePyObject *self)
+{
+    if (self->cache != NULL) {
+        cache_clear(self->cache);
+        self->load = 0;
+        release_queued_objects();
+    }
+    Py_CLEAR(self->on_evict);
+    Py_CLEAR(self->evicted);
+    return 0;
+}
+
+static void
+CachePyObject_dealloc(CachePyObject *self)
+{
+    PyObject_GC_UnTrack(self);
+    if (self->cache != NULL) {
+        cache_free(self->cache);
+        release_queued_objects();
+    }
+    Py_XDECREF(self->on_evict);
+    Py_XDECREF(self->evicted);
+    self->ob_type->tp_free((PyObject*)self);
+}
+
+/***
+* Looks up key_input, marking it as recently used. Returns 1 and sets *value to a new
+*   reference if it's cached, 0 if it isn't, or -1 with an exception set.
+***/
+static int
+cache_find_value(CachePyObject *self, PyObject *key_input, PyObject **value)
+{
+    union Hashable key;
+    hash_type key_type = INTEGER; // default
+
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+        return -1;
+    }
+    Item *item = cache_lookup(LONG_MAX, key, key_type, self->cache);
+    if (item == NULL) {
+        return 0;
+    }
+    *value = hashable_to_python(item->value, item->value_type);
+    return (*value == NULL) ? -1 : 1;
+}
+
+static int
+cache_set_item(CachePyObject *self, PyObject *key_input, PyObject *value_input)
+{
+    union Hashable key;
+    hash_type key_type = INTEGER; // default
+    union Hashable value;
+    hash_type value_type = INTEGER;
+
+    if (set_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+        return -1;
+    }
+    if (set_value_from_user_input(&value, &value_type, value_input, 1) < 0) {
+        free_hashable(key, key_type);
+        return -1;
+    }
+    cache_set(LONG_MAX, key, key_type, value, value_type, self->cache);
+    return finish_cache_change(self);
+}
+
+/***
+* Removes key_input. Returns 1 and sets *value to the removed value (if value isn't NULL)
+*   if it was cached, 0 if it wasn't, or -1 with an exception set.
+***/
+static int
+cache_remove_key(CachePyObject *self, PyObject *key_input, PyObject **value)
+{
+    union Hashable key;
+    hash_type key_type = INTEGER; // default
+    union Hashable removed;
+    hash_type removed_type;
+
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+        return -1;
+    }
+    if (!cache_remove(LONG_MAX, key, key_type, &removed, &removed_type, self->cache)) {
+        return 0;
+    }
+    self->load = self->cache->count;
+    if (value != NULL) {
+        *value = hashable_to_python(removed, removed_type);
+    }
+    free_hashable(removed, removed_type);
+    return ((value != NULL) && (*value == NULL)) ? -1 : 1;
+}
+
+static PyObject *
+CachePy_get(CachePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
+    PyObject* value = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &key_input))
+        return NULL;
+
+    int found = cache_find_value(self, key_input, &value);
+    if (found == 0) {
+        Py_RETURN_NONE;
+    }
+    return (found > 0) ? value : NULL;
+}
+
+static PyObject *
+CachePy_set(CachePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
+    PyObject* value_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "OO", &key_input, &value_input))
+        return NULL;
+
+    if (cache_set_item(self, key_input, value_input) < 0) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+CachePy_pop(CachePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
+    PyObject* value = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &key_input))
+        return NULL;
+
+    int removed = cache_remove_key(self, key_input, &value);
+    if (removed == 0) {
+        Py_RETURN_NONE;
+    }
+    return (removed > 0) ? value : NULL;
+}
+
+static PyObject *
+CachePy_discard(CachePyObject *self, PyObject *args)
+{
+    PyObject* key_input = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &key_input))
+        return NULL;
+
+    int removed = cache_remove_key(self, key_input, NULL);
+    if (removed < 0) {
+        return NULL;
+    }
+    return PyBool_FromLong(removed);
+}
+
+static PyObject *
+CachePy_clear(CachePyObject *self, PyObject *args)
+{
+    cache_clear(self->cache);
+    self->load = 0;
+    release_queued_objects();
+    Py_RETURN_NONE;
+}
+
+char CachePy_stats__doc__[] = "Return a dict of the cache's hits, misses and evictions so far.";
+
+static PyObject *
+CachePy_stats(CachePyObject *self, PyObject *args)
+{
+    return Py_BuildValue("{s:l,s:l,s:l}", "hits", self->cache->hits,
+                         "misses", self->cache->misses,
+                         "evictions", self->cache->evictions);
+}
+
+static Py_ssize_t
+CachePy_length(CachePyObject *self)
+{
+    return self->load;
+}
+
+static PyObject *
+CachePy_subscript(CachePyObject *self, PyObject *key_input)
+{
+    PyObject* value = NULL;
+    int found = cache_find_value(self, key_input, &value);
+    if (found == 0) {
+        PyErr_SetObject(PyExc_KeyError, key_input);
+    }
+    return (found > 0) ? value : NULL;
+}
+
+static int
+CachePy_ass_subscript(CachePyObject *self, PyObject *key_input, PyObject *value_input)
+{
+    if (value_input != NULL) {
+        return cache_set_item(self, key_input, value_input);
+    }
+    int removed = cache_remove_key(self, key_input, NULL);
+    if (removed == 0) {
+        PyErr_SetObject(PyExc_KeyError, key_input);
+        return -1;
+    }
+    return (removed > 0) ? 0 : -1;
+}
+
+/***
+* key in cache -- doesn't count as a hit or miss, or mark the key as used
+***/
+static int
+CachePy_contains(CachePyObject *self, PyObject *key_input)
+{
+    union Hashable key;
+    hash_type key_type = INTEGER; // default
+
+    if (borrow_hashable_from_user_input(&key, &key_type, key_input) < 0) {
+        return -1;
+    }
+    return cache_peek(LONG_MAX, key, key_type, self->cache) != NULL;
+}
+
+static PyMappingMethods CachePy_as_mapping = {
+    (lenfunc)CachePy_length,                     /* mp_length */
+    (binaryfunc)CachePy_subscript,               /* mp_subscript */
+    (objobjargproc)CachePy_ass_subscript,        /* mp_ass_subscript */
+};
+
+static PySequenceMethods CachePy_as_sequence = {
+    0,                                           /* sq_length */
+    0,                                           /* sq_concat */
+    0,                                           /* sq_repeat */
+    0,                                           /* sq_item */
+    0,                                           /* sq_slice */
+    0,                                           /* sq_ass_item */
+    0,                                           /* sq_ass_slice */
+    (objobjproc)CachePy_contains,                /* sq_contains */
+};
+
+char capacity_attr__doc__[] = "Most key-value pairs the cache holds before it evicts.";
+
+static PyMemberDef Cache_members[] = {
+    {"capacity",
+        T_LONG, offsetof(CachePyObject, capacity), READONLY,
+        capacity_attr__doc__},
+    {"load",
+        T_LONG, offsetof(CachePyObject, load), READONLY,
+        load_attr__doc__},
+    {NULL}  /* Sentinel */
+};
+
+static PyMethodDef CachePy_methods[] = {
+    {"get", (PyCFunction)CachePy_get, METH_VARARGS,
+        "Return the value cached for a key (None if it isn't), marking the key as recently used."},
+    {"set", (PyCFunction)CachePy_set, METH_VARARGS,
+        "Cache a key-value pair, evicting the least recently used pair (by CLOCK) if the cache is full."},
+    {"pop", (PyCFunction)CachePy_pop, METH_VARARGS, HashTablePy_pop__doc__},
+    {"discard", (PyCFunction)CachePy_discard, METH_VARARGS, HashTablePy_discard__doc__},
+    {"clear", (PyCFunction)CachePy_clear, METH_NOARGS, "Delete every key-value pair, without calling on_evict."},
+    {"stats", (PyCFunction)CachePy_stats, METH_NOARGS, CachePy_stats__doc__},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject CachePyType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                           /* ob_size */
+    "hashtable.Cache",                           /* tp_name */
+    sizeof(CachePyObject),                       /* tp_basicsize */
+    0,                                           /* tp_itemsize */
+    (destructor)CachePyObject_dealloc,           /* tp_dealloc */
+    0,                                           /* tp_print */
+    0,                                           /* tp_getattr */
+    0,                                           /* tp_setattr */
+    0,                                           /* tp_compare */
+    0,                                           /* tp_repr */
+    0,                                           /* tp_as_number */
+    &CachePy_as_sequence,                        /* tp_as_sequence */
+    &CachePy_as_mapping,                         /* tp_as_mapping */
+    0,                                           /* tp_hash */
+    0,                                           /* tp_call */
+    0,                                           /* tp_str */
+    0,                                           /* tp_getattro */
+    0,                                           /* tp_setattro */
+    0,                                           /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,     /* tp_flags */
+    "Table of up to capacity key-value pairs, evicting by CLOCK; on_evict(key, value) hears of each eviction.", /* tp_doc */
+    (traverseproc)CachePyObject_traverse,        /* tp_traverse */
+    (inquiry)CachePyObject_clear,                /* tp_clear */
+    0,                                           /* tp_richcompare */
+    0,                                           /* tp_weaklistoffset */
+    0,                                           /* tp_iter */
+    0,                                           /* tp_iternext */
+    CachePy_methods,                             /* tp_methods */
+    Cache_members,                               /* tp_members */
+    0,                                           /* tp_getset */
+    0,                                           /* tp_base */
+    0,                                           /* tp_dict */
+    0,                                           /* tp_descr_get */
+    0,                                           /* tp_descr_set */
+    0,                                           /* tp_dictoffset */
+    (initproc)CachePyObject_init,                /* tp_init */
+    0,                                           /* tp_alloc */
+    0,                                           /* tp_new */
+};
+
+/***
+* Typed tables: IntIntTable, IntDoubleTable and StrIntTable (see typed_hashtable.h)
+*   Each Python type is generated by TYPED_PY_TABLE from the C table's prefix and
+*   functions converting its keys and values. Keys are always hashed natively, and
+*   nothing here releases the GIL, so the GIL alone keeps each table consistent.
+***/
+static int
+int_from_py(PyObject *input, long int *to, int copy)
+{
+    if (!PyInt_Check(input) && !PyLong_Check(input)) {
+        PyErr_SetString(PyExc_TypeError, "Expected an integer.");
+        return -1;
+    }
+    *to = PyInt_AsLong(input);
+    return ((*to == -1) && PyErr_Occurred()) ? -1 : 0;
+}
+
+static int
+double_from_py(PyObject *input, double *to, int copy)
+{
+    *to = PyFloat_AsDouble(input);
+    return ((*to == -1.0) && PyErr_Occurred()) ? -1 : 0;
+}
+
+// copy is set for keys the table will own, and clear for keys it only borrows
+static int
+typed_string_from_py(PyObject *input, TypedString *to, int copy)
+{
+    char *str;
+    Py_ssize_t len;
+    if (!PyString_Check(input)) {
+        PyErr_SetString(PyExc_TypeError, "Expected a string.");
+        return -1;
+    }
+    PyString_AsStringAndSize(input, &str, &len);
+    to->len = len;
+    if (copy) {
+        to->str = malloc(len + 1);
+        memcpy(to->str, str, len + 1);
+    }
+    else {
+        to->str = str;
+    }
+    return 0;
+}
+
+#define TYPED_PY_TABLE(NAME, PREFIX, KEY_T, VALUE_T, KEY_FROM_PY, VALUE_FROM_PY, VALUE_TO_PY, DOC)     \
+typedef struct {                                                                            \
+    PyObject_HEAD                                                                           \
+    NAME *table;                                                                            \
+    long int size;                                                                          \
+    long int load;                                                                          \
+} NAME##PyObject;                                                                           \
+                                                                                            \
+static int                                                                                  \
+NAME##PyObject_init(NAME##PyObject *self, PyObject *args, PyObject *kwds)                   \
+{                                                                                           \
+    long int size = TYPED_TABLE_MIN_SIZE;                                                   \
+    double max_load = 0.5;                                                                  \
+    static char *kwlist[] = {"size", "max_load", NULL};                                     \
+                                                                                            \
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ld", kwlist, &size, &max_load))          \
+        return -1;                                                                          \
+    if (size <= 0) {                                                                        \
+        PyErr_SetString(PyExc_TypeError, "size parameter must be a positive integer.");     \
+        return -1;                                                                          \
+    }                                                                                       \
+    if ((max_load <= 0) || (max_load > 1)) {                                                \
+        PyErr_SetString(PyExc_TypeError, "max_load parameter must be a float between 0.0 and 1.0."); \
+        return -1;                                                                          \
+    }                                                                                       \
+    if (self->table != NULL) {                                                              \
+        PREFIX##_free(self->table);                                                         \
+    }                                                                                       \
+    self->table = PREFIX##_init(size, max_load);                                            \
+    self->size = self->table->size;                                                         \
+    self->load = 0;                                                                         \
+    return 0;                                                                               \
+}                                                                                           \
+                                                                                            \
+static void                                                                                 \
+NAME##PyObject_dealloc(NAME##PyObject *self)                                                \
+{                                                                                           \
+    if (self->table != NULL) {                                                              \
+        PREFIX##_free(self->table);                                                         \
+    }                                                                                       \
+    self->ob_type->tp_free((PyObject*)self);                                                \
+}                                                                                           \
+                                                                                            \
+static PyObject *                                                                           \
+NAME##Py_set(NAME##PyObject *self, PyObject *args)                                          \
+{                                                                                           \
+    PyObject* key_input = NULL;                                                             \
+    PyObject* value_input = NULL;                                                           \
+    KEY_T key;                                                                              \
+    VALUE_T value;                                                                          \
+                                                                                            \
+    if (!PyArg_ParseTuple(args, "OO", &key_input, &value_input))                            \
+        return NULL;                                                                        \
+    if (VALUE_FROM_PY(value_input, &value, 0) < 0) {                                        \
+        return NULL;                                                                        \
+    }                                                                                       \
+    if (KEY_FROM_PY(key_input, &key, 1) < 0) {                                              \
+        return NULL;                                                                        \
+    }                                                                                       \
+    PREFIX##_set(key, value, self->table);                                                  \
+    self->load = self->table->load;                                                         \
+    self->size = self->table->size;                                                         \
+    Py_RETURN_NONE;                                                                         \
+}                                                                                           \
+                                                                                            \
+static PyObject *                                                                           \
+NAME##Py_get(NAME##PyObject *self, PyObject *args)                                          \
+{                                                                                           \
+    PyObject* key_input = NULL;                                                             \
+    KEY_T key;                                                                              \
+    VALUE_T value;                                                                          \
+                                                                                            \
+    if (!PyArg_ParseTuple(args, "O", &key_input))                                           \
+        return NULL;                                                                        \
+    if (KEY_FROM_PY(key_input, &key, 0) < 0) {                                              \
+        return NULL;                                                                        \
+    }                                                                                       \
+    if (!PREFIX##_get(key, &value, self->table)) {                                          \
+        Py_RETURN_NONE;                                                                     \
+    }                                                                                       \
+    return VALUE_TO_PY(value);                                                              \
+}                                                                                           \
+                                                                                            \
+static PyObject *                                                                           \
+NAME##Py_pop(NAME##PyObject *self, PyObject *args)                                          \
+{                                                                                           \
+    PyObject* key_input = NULL;                                                             \
+    KEY_T key;                                                                              \
+    VALUE_T value;                                                                          \
+                                                                                            \
+    if (!PyArg_ParseTuple(args, "O", &key_input))                                           \
+        return NULL;                                                                        \
+    if (KEY_FROM_PY(key_input, &key, 0) < 0) {                                              \
+        return NULL;                                                                        \
+    }                                                                                       \
+    int found = PREFIX##_remove(key, &value, self->table);                                  \
+    self->load = self->table->load;                                                         \
+    if (!found) {                                                                           \
+        Py_RETURN_NONE;                                                                     \
+    }                                                                                       \
+    return VALUE_TO_PY(value);                                                              \
+}                                                                                           \
+                                                                                            \
+static PyObject *                                                                           \
+NAME##Py_increment(NAME##PyObject *self, PyObject *args)                                    \
+{                                                                                           \
+    PyObject* key_input = NULL;                                                             \
+    PyObject* delta_input = NULL;                                                           \
+    KEY_T key;                                                                              \
+    VALUE_T delta = 1;                                                                      \
+                                                                                            \
+    if (!PyArg_ParseTuple(args, "O|O", &key_input, &delta_input))                           \
+        return NULL;                                                                        \
+    if ((delta_input != NULL) && (VALUE_FROM_PY(delta_input, &delta, 0) < 0)) {             \
+        return NULL;                                                                        \
+    }                                                                                       \
+    if (KEY_FROM_PY(key_input, &key, 1) < 0) {                                              \
+        return NULL;                                                                        \
+    }                                                                                       \
+    VALUE_T value = PREFIX##_increment(key, delta, self->table);                            \
+    self->load = self->table->load;                                                         \
+    self->size = self->table->size;                                                         \
+    return VALUE_TO_PY(value);                                                              \
+}                                                                                           \
+                                                                                            \
+static PyMemberDef NAME##_members[] = {                                                     \
+    {"size", T_LONG, offsetof(NAME##PyObject, size), READONLY, size_attr__doc__},           \
+    {"load", T_LONG, offsetof(NAME##PyObject, load), READONLY, load_attr__doc__},           \
+    {NULL}  /* Sentinel */                                                                  \
+};                                                                                          \
+                                                                                            \
+static PyMethodDef NAME##Py_methods[] = {                                                   \
+    {"set", (PyCFunction)NAME##Py_set, METH_VARARGS, HashTablePy_set__doc__},               \
+    {"get", (PyCFunction)NAME##Py_get, METH_VARARGS, HashTablePy_get__doc__},               \
+    {"pop", (PyCFunction)NAME##Py_pop, METH_VARARGS, HashTablePy_pop__doc__},               \
+    {"increment", (PyCFunction)NAME##Py_increment, METH_VARARGS,                            \
+        "Add delta (default 1) to the value for key, which starts at 0. The new value is returned."}, \
+    {NULL}  /* Sentinel */                                                                  \
+};                                                                                          \
+                                                                                            \
+static PyTypeObject NAME##PyType = {                                                        \
+    PyObject_HEAD_INIT(NULL)                                                                \
+    0,                                           /* ob_size */                              \
+    "hashtable." #NAME,                          /* tp_name */                              \
+    sizeof(NAME##PyObject),                      /* tp_basicsize */                         \
+    0,                                           /* tp_itemsize */                          \
+    (destructor)NAME##PyObject_dealloc,          /* tp_dealloc */                           \
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,    /* tp_print ... tp_as_buffer */            \
+    Py_TPFLAGS_DEFAULT,                          /* tp_flags */                             \
+    DOC,                                         /* tp_doc */                               \
+    0, 0, 0, 0, 0, 0,                            /* tp_traverse ... tp_iternext */          \
+    NAME##Py_methods,                            /* tp_methods */                           \
+    NAME##_members,                              /* tp_members */                           \
+    0, 0, 0, 0, 0, 0,                            /* tp_getset ... tp_dictoffset */          \
+    (initproc)NAME##PyObject_init,               /* tp_init */                              \
+};
+
+TYPED_PY_TABLE(IntIntTable, int_int, long int, long int, int_from_py, int_from_py, PyInt_FromLong,
+               "HashTable from integers to integers, stored unboxed.")
+TYPED_PY_TABLE(IntDoubleTable, int_double, long int, double, int_from_py, double_from_py,
+               PyFloat_FromDouble, "HashTable from integers to floats, stored unboxed.")
+TYPED_PY_TABLE(StrIntTable, str_int, TypedString, long int, typed_string_from_py, int_from_py,
+               PyInt_FromLong, "HashTable from strings to integers, stored unboxed.")
+
+#ifndef PyMODINIT_FUNC	/* declarations for DLL import/export */
+#define PyMODINIT_FUNC void
+#endif
+PyMODINIT_FUNC
+inithashtable(void)
+{
+    PyObject* m;
+
+    released_objects = PyList_New(0);
+    if (released_objects == NULL)
+        return;
+    release_object = queue_released_object;
+
+    HashTablePyType.tp_new = PyType_GenericNew;
+    if (PyType_Ready(&HashTablePyType) < 0)
+        return;
+    if (PyType_Ready(&HashTableIterPyType) < 0)
+        return;
+    FrozenHashTablePyType.tp_new = PyType_GenericNew;
+    if (PyType_Ready(&FrozenHashTablePyType) < 0)
+        return;
+    CachePyType.tp_new = PyType_GenericNew;
+    if (PyType_Ready(&CachePyType) < 0)
+        return;
+    IntIntTablePyType.tp_new = PyType_GenericNew;
+    IntDoubleTablePyType.tp_new = PyType_GenericNew;
+    StrIntTablePyType.tp_new = PyType_GenericNew;
+    if ((PyType_Ready(&IntIntTablePyType) < 0) || (PyType_Ready(&IntDoubleTablePyType) < 0) ||
+        (PyType_Ready(&StrIntTablePyType) < 0))
         return;
 
     static char hashtable__doc__[] = "This module enables users to create "
@@ -283,4 +2412,14 @@ inithashtable(void)
 
     Py_INCREF(&HashTablePyType);
     PyModule_AddObject(m, "HashTable", (PyObject *)&HashTablePyType);
+    Py_INCREF(&FrozenHashTablePyType);
+    PyModule_AddObject(m, "FrozenHashTable", (PyObject *)&FrozenHashTablePyType);
+    Py_INCREF(&CachePyType);
+    PyModule_AddObject(m, "Cache", (PyObject *)&CachePyType);
+    Py_INCREF(&IntIntTablePyType);
+    PyModule_AddObject(m, "IntIntTable", (PyObject *)&IntIntTablePyType);
+    Py_INCREF(&IntDoubleTablePyType);
+    PyModule_AddObject(m, "IntDoubleTable", (PyObject *)&IntDoubleTablePyType);
+    Py_INCREF(&StrIntTablePyType);
+    PyModule_AddObject(m, "StrIntTable", (PyObject *)&StrIntTablePyType);
 }
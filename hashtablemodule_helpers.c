@@ -8,13 +8,20 @@ free_hashable(union Hashable hashable, hash_type type)
     if (type == STRING) {
         free(hashable.str);
     }
+    else if (type == OBJECT) {
+        Py_DECREF((PyObject *)hashable.object);
+    }
 }
 
-int
-set_hashable_from_user_input(union Hashable *to_set, hash_type *type, PyObject* input)
+/***
+* Converts a Python int, float or str into a Hashable.
+*   If copy is 0, a string's buffer is borrowed from the str object -- fine for a key
+*   that is only looked up, as long as the object outlives the lookup.
+*   Otherwise it is copied (including embedded NULs) for the hashtable to keep.
+***/
+static int
+convert_user_input(union Hashable *to_set, hash_type *type, PyObject* input, int copy)
 {
-    size_t str_size;
-    char *temp_str;
     if (PyInt_Check(input)) {
         to_set->i = PyInt_AsLong(input);
     }
@@ -23,10 +30,15 @@ set_hashable_from_user_input(union Hashable *to_set, hash_type *type, PyObject*
         *type = DOUBLE;
     }
     else if (PyString_Check(input)) {
-        str_size = (size_t)PyString_GET_SIZE(input) + 1;
-        to_set->str = malloc(str_size);
-        temp_str = PyString_AsString(input);
-        snprintf(to_set->str, str_size, "%s", temp_str);
+        to_set->len = (size_t)PyString_GET_SIZE(input);
+        if (copy) {
+            // str objects are always NUL-terminated, so copy that too
+            to_set->str = malloc(to_set->len + 1);
+            memcpy(to_set->str, PyString_AS_STRING(input), to_set->len + 1);
+        }
+        else {
+            to_set->str = PyString_AS_STRING(input);
+        }
         *type = STRING;
     }
     else {
@@ -36,48 +48,109 @@ set_hashable_from_user_input(union Hashable *to_set, hash_type *type, PyObject*
     return 0;
 }
 
+/***
+* For keys and values that will be stored -- strings are copied, and must be freed with free_hashable
+***/
+int
+set_hashable_from_user_input(union Hashable *to_set, hash_type *type, PyObject* input)
+{
+    return convert_user_input(to_set, type, input, 1);
+}
+
+/***
+* For values that will be stored -- like set_hashable_from_user_input, except that anything
+*   else (a long, a list, any object -- or every value, if objects is set) is stored as an
+*   OBJECT: a new reference to input itself, which get hands back as it is.
+***/
+int
+set_value_from_user_input(union Hashable *to_set, hash_type *type, PyObject* input, int objects)
+{
+    if (objects || !(PyInt_Check(input) || PyFloat_Check(input) || PyString_Check(input))) {
+        Py_INCREF(input);
+        to_set->object = input;
+        *type = OBJECT;
+        return 0;
+    }
+    return convert_user_input(to_set, type, input, 1);
+}
+
+/***
+* For keys that are only looked up -- strings are borrowed from input, and must not be freed
+***/
+int
+borrow_hashable_from_user_input(union Hashable *to_set, hash_type *type, PyObject* input)
+{
+    return convert_user_input(to_set, type, input, 0);
+}
 
 PyObject*
 format_python_return_val_from_item(Item *item)
 {
-    PyObject* return_val = NULL;
-
     if (!item) {
         Py_RETURN_NONE;
     }
+    return hashable_to_python(item->value, item->value_type);
+}
 
-    switch(item->value_type) {
+/***
+* Returns a new Python int, float or str holding hashable (or a new reference to an
+*   OBJECT), or NULL with an exception set.
+***/
+PyObject*
+hashable_to_python(union Hashable hashable, hash_type type)
+{
+    switch(type) {
+        case OBJECT:
+            Py_INCREF((PyObject *)hashable.object);
+            return (PyObject *)hashable.object;
         case INTEGER:
-            return_val = Py_BuildValue("i", item->value.i);
-            break;
+            return PyInt_FromLong(hashable.i);
         case DOUBLE:
-            return_val = Py_BuildValue("d", item->value.f);
-            break;
+            return PyFloat_FromDouble(hashable.f);
         case STRING:
-            return_val = Py_BuildValue("s", item->value.str);
-            break;
+            return PyString_FromStringAndSize(hashable.str, (Py_ssize_t)hashable.len);
         default:
             Py_RETURN_NONE;
     }
-    return return_val;
 }
 
+/***
+* Hashes a key for the hashtable.
+*   hash_func NULL:              native -- the table's built-in hash function, all in C
+*   hash_func is builtin hash(): PyObject_Hash on the key, with no call through the interpreter
+*   any other callable:          called with the key; it must return an integer
+* Returns LONG_MAX (with an exception set) on error.
+***/
 long int
-get_hash(union Hashable key, hash_type type, PyObject *hash_func)
+get_hash(PyObject *key_input, union Hashable key, hash_type type, PyObject *hash_func, HashTable *hashtable)
 {
     PyObject *py_key_arg;
     PyObject *py_hash;
     long int hash;
 
+    if (hash_func == NULL) {
+        hash = calculate_hash(key, type, hashtable);
+        // LONG_MAX means "error" here, and "not hashed yet" to add
+        return (hash == LONG_MAX) ? LONG_MAX - 1 : hash;
+    }
+
+    if (hash_func == default_py_hash_func()) {
+        hash = PyObject_Hash(key_input);
+        if (hash == -1) {
+            return LONG_MAX;
+        }
+        return (hash == LONG_MAX) ? LONG_MAX - 1 : hash; // hash(sys.maxint) is sys.maxint
+    }
+
     switch(type) {
         case INTEGER:
-            py_key_arg = Py_BuildValue("(i)", key.i);
+            py_key_arg = Py_BuildValue("(l)", key.i);
             break;
         case DOUBLE:
-            py_key_arg = Py_BuildValue("(f)", key.f);
+            py_key_arg = Py_BuildValue("(d)", key.f);
             break;
         case STRING:
-            py_key_arg = Py_BuildValue("(s)", key.str);
+            py_key_arg = Py_BuildValue("(s#)", key.str, (int)key.len);
             break;
         default:
             PyErr_SetString(PyExc_RuntimeError, "Invalid key type.");
@@ -88,6 +161,7 @@ get_hash(union Hashable key, hash_type type, PyObject *hash_func)
     Py_DECREF(py_key_arg);
 
     if ((py_hash == NULL) || (! PyInt_Check(py_hash))) {
+        Py_XDECREF(py_hash);
         PyErr_SetString(PyExc_ValueError, "Invalid hash function -- all keys must hash to an integer.");
         return LONG_MAX;
     }
@@ -95,19 +169,87 @@ get_hash(union Hashable key, hash_type type, PyObject *hash_func)
     hash = PyInt_AsLong(py_hash);
     Py_DECREF(py_hash);
 
-    return hash;
+    return (hash == LONG_MAX) ? LONG_MAX - 1 : hash;
 }
 
+/***
+* Returns Python's built-in hash function (a borrowed reference).
+***/
 PyObject *
 default_py_hash_func(void)
 {
-    PyObject* built_ins = PyEval_GetBuiltins();
+    static PyObject* built_in_hash_func = NULL;
 
-    PyObject* hash_key = Py_BuildValue("s", "hash");
-    PyObject* built_in_hash_func = PyDict_GetItem(built_ins, hash_key);
+    if (built_in_hash_func == NULL) {
+        PyObject* built_ins = PyEval_GetBuiltins();
+        built_in_hash_func = PyDict_GetItemString(built_ins, "hash");
+        Py_XINCREF(built_in_hash_func);
+    }
+    return built_in_hash_func;
+}
 
-    Py_DECREF(built_ins);
-    Py_DECREF(hash_key);
+/***
+* Converts every element of a sequence (from PySequence_Fast) into keys, and hashes each one
+*   (see get_hash) unless hashes is NULL. Strings are borrowed if borrow is set (see
+*   borrow_hashable_from_user_input), and copied otherwise.
+*   Returns 0, or -1 with an exception set -- in which case nothing is left allocated.
+***/
+int
+set_hashables_from_sequence(PyObject *sequence, union Hashable *keys, hash_type *key_types,
+                            long int *hashes, PyObject *hash_func, HashTable *hashtable, int borrow)
+{
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+    Py_ssize_t i;
+    for (i = 0; i < count; i++) {
+        PyObject* input = PySequence_Fast_GET_ITEM(sequence, i);
+        key_types[i] = INTEGER; // default
+        if (convert_user_input(&keys[i], &key_types[i], input, !borrow) < 0) {
+            break;
+        }
+        if (hashes != NULL) {
+            hashes[i] = get_hash(input, keys[i], key_types[i], hash_func, hashtable);
+            if (hashes[i] == LONG_MAX) { // error
+                if (!borrow) {
+                    free_hashable(keys[i], key_types[i]);
+                }
+                break;
+            }
+        }
+    }
+    if (i < count) {
+        if (!borrow) {
+            free_hashables(i, keys, key_types);
+        }
+        return -1;
+    }
+    return 0;
+}
 
-    return built_in_hash_func;
+/***
+* Converts every element of a sequence (from PySequence_Fast) into values to be stored,
+*   as set_value_from_user_input does. Returns 0, or -1 with an exception set.
+***/
+int
+set_values_from_sequence(PyObject *sequence, union Hashable *values, hash_type *value_types, int objects)
+{
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+    Py_ssize_t i;
+    for (i = 0; i < count; i++) {
+        value_types[i] = INTEGER; // default
+        if (set_value_from_user_input(&values[i], &value_types[i], PySequence_Fast_GET_ITEM(sequence, i),
+                                      objects) < 0) {
+            free_hashables(i, values, value_types);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+free_hashables(Py_ssize_t count, union Hashable *hashables, hash_type *types)
+{
+    Py_ssize_t i;
+    for (i = 0; i < count; i++) {
+        free_hashable(hashables[i], types[i]);
+    }
 }
@@ -2,7 +2,14 @@
 #include "limits.h"
 
 int set_hashable_from_user_input(union Hashable *to_set, hash_type *type, PyObject* input);
+int set_value_from_user_input(union Hashable *to_set, hash_type *type, PyObject* input, int objects);
+int borrow_hashable_from_user_input(union Hashable *to_set, hash_type *type, PyObject* input);
 void free_hashable(union Hashable hashable, hash_type type);
+int set_hashables_from_sequence(PyObject *sequence, union Hashable *keys, hash_type *key_types,
+                                long int *hashes, PyObject *hash_func, HashTable *hashtable, int borrow);
+int set_values_from_sequence(PyObject *sequence, union Hashable *values, hash_type *value_types, int objects);
+void free_hashables(Py_ssize_t count, union Hashable *hashables, hash_type *types);
 PyObject* format_python_return_val_from_item(Item *item);
-long int get_hash(union Hashable key, hash_type type, PyObject *hash_func);
+PyObject* hashable_to_python(union Hashable hashable, hash_type type);
+long int get_hash(PyObject *key_input, union Hashable key, hash_type type, PyObject *hash_func, HashTable *hashtable);
 PyObject *default_py_hash_func(void);
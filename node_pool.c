@@ -0,0 +1,70 @@
+#include "hashtable.h"
+
+/***
+* Node pool
+*   Instead of one malloc per key-value pair, each hashtable carves its Nodes
+*   out of large chunks and recycles freed Nodes through a free list.
+*   Chunks grow geometrically (NODE_CHUNK_MIN up to NODE_CHUNK_MAX nodes), and
+*   free_table releases them a chunk at a time rather than a node at a time.
+***/
+
+static void add_chunk(HashTable *hashtable) {
+    long int count = hashtable->next_chunk_size;
+    NodeChunk *chunk = malloc(sizeof(NodeChunk) + count*sizeof(Node));
+    chunk->count = count;
+    chunk->next = hashtable->chunks;
+    hashtable->chunks = chunk;
+
+    // thread the new nodes onto the free list, lowest address first
+    long int i;
+    for (i = count - 1; i >= 0; i--) {
+        chunk->nodes[i].next = hashtable->free_nodes;
+        hashtable->free_nodes = &chunk->nodes[i];
+    }
+
+    if (hashtable->next_chunk_size < NODE_CHUNK_MAX) {
+        hashtable->next_chunk_size *= 2;
+    }
+}
+
+Node *allocate_node(HashTable *hashtable) {
+    if (hashtable->free_nodes == NULL) {
+        add_chunk(hashtable);
+    }
+    Node *node = hashtable->free_nodes;
+    hashtable->free_nodes = node->next;
+    return node;
+}
+
+void release_node(Node *node, HashTable *hashtable) {
+    node->next = hashtable->free_nodes;
+    hashtable->free_nodes = node;
+}
+
+void free_node_pool(HashTable *hashtable) {
+    NodeChunk *chunk = hashtable->chunks;
+    while (chunk != NULL) {
+        NodeChunk *temp = chunk->next;
+        free(chunk);
+        chunk = temp;
+    }
+    hashtable->chunks = NULL;
+    hashtable->free_nodes = NULL;
+}
+
+/***
+* Returns how many nodes are handed out: a chained table's items, plus any removed
+*   items that haven't been passed to free_item yet.
+***/
+long int nodes_in_use(HashTable *hashtable) {
+    long int count = 0;
+    NodeChunk *chunk;
+    for (chunk = hashtable->chunks; chunk != NULL; chunk = chunk->next) {
+        count += chunk->count;
+    }
+    Node *node;
+    for (node = hashtable->free_nodes; node != NULL; node = node->next) {
+        count--;
+    }
+    return count;
+}
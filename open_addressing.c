@@ -0,0 +1,189 @@
+#include "hashtable.h"
+
+/***
+* Open-addressing storage
+*   Every item lives inline in one flat array of Slots, so a lookup walks
+*   neighbouring memory instead of chasing Node and Item pointers.
+*   Collisions are resolved with Robin Hood linear probing: an item that is
+*   further from its home bin takes the slot of an item that is closer to its
+*   own. This keeps probe sequences short, lets lookups stop early on a miss,
+*   and lets removal shift items back instead of leaving tombstones.
+***/
+
+Slot *allocate_slots(long int size) {
+    Slot *slots = malloc(size*sizeof(Slot));
+
+    long int i;
+    for (i = 0; i < size; i++) {
+        slots[i].distance = EMPTY_SLOT;
+    }
+    return slots;
+}
+
+/***
+* Adds a copy of item to the slot array, or updates the value if the key is already present.
+*   The slot array is doubled first if this could fill it, whatever max_load_proportion
+*   allows: probes only end at an empty slot, so one must always be left.
+***/
+void open_addressing_add(Item *item, HashTable *hashtable) {
+    if (hashtable->load + 1 >= hashtable->size) {
+        resize_to(2*hashtable->size, hashtable);
+    }
+    Slot *slots = hashtable->slots;
+    long int size = hashtable->size;
+    long int index = calculate_bin_index(item->hash, hashtable);
+
+    Slot carried;
+    carried.item = *item;
+    carried.distance = 0;
+    int displaced = 0; // once we displace an item, the key can't already be stored further along
+
+    while (1) {
+        Slot *slot = &slots[index];
+        if (slot->distance == EMPTY_SLOT) {
+            *slot = carried;
+            hashtable->load++;
+            return;
+        }
+        if (!displaced && item_has_key(&slot->item, item->hash, item->key, item->key_type)) {
+            // keys are equal -- replace
+            free_item_contents(&slot->item);
+            slot->item = *item;
+            return;
+        }
+        if (slot->distance < carried.distance) {
+            Slot temp = *slot;
+            *slot = carried;
+            carried = temp;
+            displaced = 1;
+        }
+        carried.distance++;
+        index++;
+        if (index == size) {
+            index = 0;
+        }
+    }
+}
+
+/***
+* Returns the slot index holding the given key, or -1 if it is not stored.
+***/
+static long int find_slot(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    Slot *slots = hashtable->slots;
+    long int size = hashtable->size;
+    long int index = calculate_bin_index(hash, hashtable);
+    long int distance = 0;
+
+    // Robin Hood invariant: once we reach a slot whose item is closer to home than
+    // we are (or an empty slot), our key can't be stored any further along.
+    while (slots[index].distance >= distance) {
+        Item *current_item = &slots[index].item;
+        if (item_has_key(current_item, hash, key, key_type)) {
+            return index;
+        }
+        distance++;
+        index++;
+        if (index == size) {
+            index = 0;
+        }
+    }
+    return -1;
+}
+
+/***
+* Returns item associated with the given hash and key, or NULL if no such item exists.
+*   The item points into the slot array, so it is only valid until the next add or remove.
+***/
+Item *open_addressing_lookup(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    long int index = find_slot(hash, key, key_type, hashtable);
+    if (index < 0) {
+        return NULL;
+    }
+    return &hashtable->slots[index].item;
+}
+
+/***
+* Empties the slot at index, shifting following items back one slot,
+*   so no tombstones are left behind.
+***/
+static void vacate_slot(long int index, HashTable *hashtable) {
+    Slot *slots = hashtable->slots;
+    long int size = hashtable->size;
+
+    long int next = (index + 1 == size) ? 0 : index + 1;
+    while (slots[next].distance > 0) {
+        slots[index] = slots[next];
+        slots[index].distance--;
+        index = next;
+        next = (next + 1 == size) ? 0 : next + 1;
+    }
+    slots[index].distance = EMPTY_SLOT;
+
+    hashtable->load--;
+}
+
+/***
+* Removes and returns item with given hash and key, or NULL if no such item exists.
+*   The returned item is a copy, held in a node from the hashtable's node pool,
+*   that the caller must free with free_item.
+***/
+Item *open_addressing_remove(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    long int index = find_slot(hash, key, key_type, hashtable);
+    if (index < 0) {
+        return NULL;
+    }
+
+    Item *removed = &allocate_node(hashtable)->item;
+    *removed = hashtable->slots[index].item;
+    vacate_slot(index, hashtable);
+    return removed;
+}
+
+/***
+* Removes and frees the item with given hash and key in place. Returns 1 if it was found, 0 otherwise.
+***/
+int open_addressing_discard(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    long int index = find_slot(hash, key, key_type, hashtable);
+    if (index < 0) {
+        return 0;
+    }
+
+    free_item_contents(&hashtable->slots[index].item);
+    vacate_slot(index, hashtable);
+    return 1;
+}
+
+/***
+* Rebuilds the slot array with the given number of slots and re-places every item.
+*   The hashtable is updated in place, so the same pointer is returned.
+***/
+HashTable *open_addressing_resize(long int size, HashTable *hashtable) {
+    Slot *old_slots = hashtable->slots;
+    long int old_size = hashtable->size;
+
+    hashtable->size = size;
+    hashtable->bin_shift = bin_shift_for_size(hashtable);
+    hashtable->slots = allocate_slots(hashtable->size);
+    hashtable->load = 0;
+
+    long int i;
+    for (i = 0; i < old_size; i++) {
+        if (old_slots[i].distance != EMPTY_SLOT) {
+            open_addressing_add(&old_slots[i].item, hashtable);
+        }
+    }
+    free(old_slots);
+    return hashtable;
+}
+
+void open_addressing_free(HashTable *hashtable) {
+    long int i;
+    for (i = 0; i < hashtable->size; i++) {
+        if (hashtable->slots[i].distance != EMPTY_SLOT) {
+            free_item_contents(&hashtable->slots[i].item);
+        }
+    }
+    free(hashtable->slots);
+    free_node_pool(hashtable);
+    free(hashtable);
+}
@@ -3,4 +3,15 @@ setup(name="hashtable", version="1.0",
       ext_modules=[
          Extension("hashtable", ["hashtablemodule_helpers.c",
                                  "hashtablemodule.c",
-                                 "hashtable.c"])])
+                                 "hashtable.c",
+                                 "open_addressing.c",
+                                 "swiss_table.c",
+                                 "hash_functions.c",
+                                 "node_pool.c",
+                                 "stats.c",
+                                 "stream.c",
+                                 "snapshot.c",
+                                 "frozen_hashtable.c",
+                                 "cache.c",
+                                 "typed_hashtable.c"],
+                   define_macros=[("HASHTABLE_NO_MAIN", None)])])
@@ -0,0 +1,337 @@
+#include "sharded_hashtable.h"
+
+/***
+* Sharded hashtable
+*   Splits one big table into 2^shard_bits independent HashTables. Each shard
+*   has its own bins, load and resizes, so a resize only ever rehashes one
+*   shard's items, and bulk work can be spread over threads a shard at a time.
+*
+*   A key's shard is picked from the top bits of a remix of its hash, which are
+*   unrelated to the bits each shard then uses to pick a bin.
+***/
+
+static long int shard_index(long int hash, ShardedHashTable *table) {
+    if (table->shard_bits == 0) {
+        return 0;
+    }
+    return (long int)(hash_integer_mix((unsigned long int)hash, table->seed) >> (64 - table->shard_bits));
+}
+
+/***
+* Creates a sharded table with room for about size items in total.
+*   Every shard gets the given options -- with the same seed, picked here if options.seed is 0.
+***/
+ShardedHashTable *sharded_init(long int size, double max_load_proportion, int shard_bits, TableOptions options) {
+    ShardedHashTable *table = malloc(sizeof(ShardedHashTable));
+    table->shard_bits = shard_bits;
+    table->shard_count = 1L << shard_bits;
+    table->shards = malloc(table->shard_count*sizeof(HashTable*));
+    if (options.seed == 0) {
+        options.seed = random_seed();
+    }
+    table->seed = options.seed;
+
+    long int shard_size = size / table->shard_count;
+    if (shard_size < 1) {
+        shard_size = 1;
+    }
+    long int i;
+    for (i = 0; i < table->shard_count; i++) {
+        table->shards[i] = init_with_options(shard_size, max_load_proportion, options);
+    }
+    return table;
+}
+
+void sharded_free(ShardedHashTable *table) {
+    long int i;
+    for (i = 0; i < table->shard_count; i++) {
+        free_table(table->shards[i]);
+    }
+    free(table->shards);
+    free(table);
+}
+
+long int sharded_load(ShardedHashTable *table) {
+    long int load = 0;
+    long int i;
+    for (i = 0; i < table->shard_count; i++) {
+        load += table->shards[i]->load;
+    }
+    return load;
+}
+
+/***
+* Hashes a key with the shards' built-in hash function.
+***/
+long int sharded_hash(union Hashable key, hash_type key_type, ShardedHashTable *table) {
+    return calculate_hash(key, key_type, table->shards[0]);
+}
+
+HashTable *shard_for_hash(long int hash, ShardedHashTable *table) {
+    return table->shards[shard_index(hash, table)];
+}
+
+/***
+* Single-key operations -- as for HashTable, a hash of LONG_MAX means "use the built-in hash function"
+***/
+void sharded_add(long int hash, union Hashable key, hash_type key_type,
+                 union Hashable value, hash_type value_type, ShardedHashTable *table) {
+    if (hash == LONG_MAX) {
+        hash = sharded_hash(key, key_type, table);
+    }
+    long int index = shard_index(hash, table);
+    table->shards[index] = add(hash, key, key_type, value, value_type, table->shards[index]);
+}
+
+Item *sharded_lookup(long int hash, union Hashable key, hash_type key_type, ShardedHashTable *table) {
+    if (hash == LONG_MAX) {
+        hash = sharded_hash(key, key_type, table);
+    }
+    return lookup_by_hash(hash, key, key_type, shard_for_hash(hash, table));
+}
+
+/***
+* Removes and returns the item with given hash and key, or NULL if no such item exists.
+*   The caller must free the item with sharded_free_item.
+***/
+Item *sharded_remove(long int hash, union Hashable key, hash_type key_type, ShardedHashTable *table) {
+    if (hash == LONG_MAX) {
+        hash = sharded_hash(key, key_type, table);
+    }
+    return remove_item_from_table_by_hash(hash, key, key_type, shard_for_hash(hash, table));
+}
+
+/***
+* Frees an item removed with sharded_remove, returning it to its shard's node pool.
+***/
+void sharded_free_item(Item *item, ShardedHashTable *table) {
+    if (item == NULL) {
+        return;
+    }
+    free_item(item, shard_for_hash(item->hash, table));
+}
+
+/***
+* Worker threads
+*   Each parallel operation starts its workers, which share out the work
+*   (a range of the input each, or shards claimed one at a time), and joins them.
+***/
+
+typedef struct worker {
+    pthread_t thread;
+    int started; // whether thread is running this worker
+    int index;
+    struct parallel_job *job;
+} Worker;
+
+typedef struct parallel_job {
+    ShardedHashTable *table;
+    int threads;
+    void *(*work)(Worker *worker);
+    atomic_long next_shard;
+
+    // parallel_build
+    long int count;
+    long int *hashes;
+    union Hashable *keys;
+    hash_type *key_types;
+    union Hashable *values;
+    hash_type *value_types;
+    long int *input_hashes;   // hash of each input pair
+    long int *shards_of;      // shard of each input pair
+    long int *thread_counts;  // [thread][shard]: pairs from thread's range in shard, then their offsets
+    long int *shard_starts;   // [shard + 1]: where each shard's pairs start in the sorted arrays
+    long int *sorted_hashes;
+    union Hashable *sorted_keys;
+    hash_type *sorted_key_types;
+    union Hashable *sorted_values;
+    hash_type *sorted_value_types;
+
+    // parallel_for_each
+    void (*fn)(Item *item, void *arg);
+    void *arg;
+} ParallelJob;
+
+static void *run_worker(void *arg) {
+    Worker *worker = arg;
+    return worker->job->work(worker);
+}
+
+static void run_workers(void *(*work)(Worker *worker), ParallelJob *job) {
+    Worker *workers = malloc(job->threads*sizeof(Worker));
+    job->work = work;
+    atomic_store(&job->next_shard, 0);
+
+    int i;
+    for (i = 0; i < job->threads; i++) {
+        workers[i].index = i;
+        workers[i].job = job;
+        workers[i].started = (i > 0) && (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) == 0);
+    }
+    // the calling thread is worker 0, and does the share of any worker whose thread couldn't be started
+    for (i = 0; i < job->threads; i++) {
+        if (!workers[i].started) {
+            work(&workers[i]);
+        }
+    }
+    for (i = 1; i < job->threads; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    free(workers);
+}
+
+static void input_range(Worker *worker, long int *first, long int *last) {
+    ParallelJob *job = worker->job;
+    *first = job->count * worker->index / job->threads;
+    *last = job->count * (worker->index + 1) / job->threads;
+}
+
+/***
+* parallel_build, step 1: hash each pair in this worker's range and count how many go to each shard
+***/
+static void *hash_and_count(Worker *worker) {
+    ParallelJob *job = worker->job;
+    long int *counts = job->thread_counts + worker->index*job->table->shard_count;
+    long int first, last, i;
+    input_range(worker, &first, &last);
+
+    for (i = first; i < last; i++) {
+        if ((job->hashes == NULL) || (job->hashes[i] == LONG_MAX)) {
+            job->input_hashes[i] = sharded_hash(job->keys[i], job->key_types[i], job->table);
+        }
+        else {
+            job->input_hashes[i] = job->hashes[i];
+        }
+        job->shards_of[i] = shard_index(job->input_hashes[i], job->table);
+        counts[job->shards_of[i]]++;
+    }
+    return NULL;
+}
+
+/***
+* parallel_build, step 2: copy this worker's pairs to their shards' places in the sorted arrays.
+*   Pairs keep their input order within a shard, so a repeated key ends with its last value.
+***/
+static void *scatter(Worker *worker) {
+    ParallelJob *job = worker->job;
+    long int *offsets = job->thread_counts + worker->index*job->table->shard_count;
+    long int first, last, i;
+    input_range(worker, &first, &last);
+
+    for (i = first; i < last; i++) {
+        long int to = offsets[job->shards_of[i]]++;
+        job->sorted_hashes[to] = job->input_hashes[i];
+        job->sorted_keys[to] = job->keys[i];
+        job->sorted_key_types[to] = job->key_types[i];
+        job->sorted_values[to] = job->values[i];
+        job->sorted_value_types[to] = job->value_types[i];
+    }
+    return NULL;
+}
+
+/***
+* parallel_build, step 3: add each claimed shard's pairs, growing the shard once
+***/
+static void *build_shards(Worker *worker) {
+    ParallelJob *job = worker->job;
+    ShardedHashTable *table = job->table;
+    long int shard;
+    while ((shard = atomic_fetch_add(&job->next_shard, 1)) < table->shard_count) {
+        long int start = job->shard_starts[shard];
+        long int count = job->shard_starts[shard + 1] - start;
+        if (count > 0) {
+            table->shards[shard] = add_many(count, job->sorted_hashes + start,
+                                            job->sorted_keys + start, job->sorted_key_types + start,
+                                            job->sorted_values + start, job->sorted_value_types + start,
+                                            table->shards[shard]);
+        }
+    }
+    return NULL;
+}
+
+/***
+* Adds count key, value pairs from parallel arrays, like add_many, using the given number of threads.
+*   The pairs are hashed and sorted by shard in parallel, then whole shards are
+*   handed out to the threads, so each shard is resized and filled by one thread.
+*   hashes may be NULL, or hold LONG_MAX for keys that should use the built-in hash function.
+***/
+void parallel_build(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                    union Hashable *values, hash_type *value_types, int threads, ShardedHashTable *table) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    long int shards = table->shard_count;
+
+    ParallelJob job;
+    job.table = table;
+    job.threads = threads;
+    job.count = count;
+    job.hashes = hashes;
+    job.keys = keys;
+    job.key_types = key_types;
+    job.values = values;
+    job.value_types = value_types;
+    job.input_hashes = malloc(count*sizeof(long int));
+    job.shards_of = malloc(count*sizeof(long int));
+    job.thread_counts = calloc(threads*shards, sizeof(long int));
+    job.shard_starts = malloc((shards + 1)*sizeof(long int));
+    job.sorted_hashes = malloc(count*sizeof(long int));
+    job.sorted_keys = malloc(count*sizeof(union Hashable));
+    job.sorted_key_types = malloc(count*sizeof(hash_type));
+    job.sorted_values = malloc(count*sizeof(union Hashable));
+    job.sorted_value_types = malloc(count*sizeof(hash_type));
+
+    run_workers(hash_and_count, &job);
+
+    // turn each thread's per-shard counts into where its pairs go
+    long int offset = 0;
+    long int shard;
+    int t;
+    for (shard = 0; shard < shards; shard++) {
+        job.shard_starts[shard] = offset;
+        for (t = 0; t < threads; t++) {
+            long int thread_count = job.thread_counts[t*shards + shard];
+            job.thread_counts[t*shards + shard] = offset;
+            offset += thread_count;
+        }
+    }
+    job.shard_starts[shards] = offset;
+
+    run_workers(scatter, &job);
+    run_workers(build_shards, &job);
+
+    free(job.input_hashes);
+    free(job.shards_of);
+    free(job.thread_counts);
+    free(job.shard_starts);
+    free(job.sorted_hashes);
+    free(job.sorted_keys);
+    free(job.sorted_key_types);
+    free(job.sorted_values);
+    free(job.sorted_value_types);
+}
+
+static void *for_each_in_shards(Worker *worker) {
+    ParallelJob *job = worker->job;
+    long int shard;
+    while ((shard = atomic_fetch_add(&job->next_shard, 1)) < job->table->shard_count) {
+        for_each_item(job->table->shards[shard], job->fn, job->arg);
+    }
+    return NULL;
+}
+
+/***
+* Calls fn on every item, with the given number of threads each working through whole shards.
+*   fn is called from several threads at once (never twice for the same item), so
+*   anything it shares through arg needs its own synchronization.
+***/
+void parallel_for_each(ShardedHashTable *table, void (*fn)(Item *item, void *arg), void *arg, int threads) {
+    ParallelJob job;
+    job.table = table;
+    job.threads = (threads < 1) ? 1 : threads;
+    job.fn = fn;
+    job.arg = arg;
+    run_workers(for_each_in_shards, &job);
+}
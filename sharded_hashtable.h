@@ -0,0 +1,36 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hashtable.h"
+
+/***
+* Definitions
+***/
+
+// N independent HashTables -- a key's shard comes from the top shard_bits bits of its mixed hash
+typedef struct sharded_hashtable {
+    int shard_bits;
+    long int shard_count;   // 1 << shard_bits
+    HashTable **shards;
+    unsigned long int seed; // every shard hashes with the same family and seed, so a key is hashed once
+} ShardedHashTable;
+
+/***
+* Function declarations
+*   Shards are independent, so threads may use different shards at once --
+*   but a single shard is no more thread-safe than a HashTable.
+***/
+ShardedHashTable *sharded_init(long int size, double max_load_proportion, int shard_bits, TableOptions options);
+void sharded_free(ShardedHashTable *table);
+long int sharded_load(ShardedHashTable *table);
+long int sharded_hash(union Hashable key, hash_type key_type, ShardedHashTable *table);
+HashTable *shard_for_hash(long int hash, ShardedHashTable *table);
+
+void sharded_add(long int hash, union Hashable key, hash_type key_type,
+                 union Hashable value, hash_type value_type, ShardedHashTable *table);
+Item *sharded_lookup(long int hash, union Hashable key, hash_type key_type, ShardedHashTable *table);
+Item *sharded_remove(long int hash, union Hashable key, hash_type key_type, ShardedHashTable *table);
+void sharded_free_item(Item *item, ShardedHashTable *table);
+
+void parallel_build(long int count, long int *hashes, union Hashable *keys, hash_type *key_types,
+                    union Hashable *values, hash_type *value_types, int threads, ShardedHashTable *table);
+void parallel_for_each(ShardedHashTable *table, void (*fn)(Item *item, void *arg), void *arg, int threads);
@@ -0,0 +1,325 @@
+#include "hashtable.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/***
+* Snapshots
+*   save_snapshot writes a hashtable to a compact binary file; open_snapshot maps
+*   that file read-only and snapshot_lookup serves lookups straight out of the
+*   mapping, so loading costs one mmap no matter how big the table is.
+*
+*   Layout (see SnapshotHeader): the header, then bin_count + 1 entry indexes
+*   (a compressed sparse row index -- bin i's entries are [bins[i], bins[i + 1])),
+*   then fixed-size entries grouped by bin, then every string, NUL-terminated.
+*   Bins are picked with a multiply-shift of the stored hash, independent of the
+*   table's own layout, so chained, open-addressing and Swiss tables all save the same way.
+*
+*   Files are written in the machine's own byte order and are only checked
+*   for size and structure on open -- they are meant to be trusted.
+***/
+
+static void collect_item(Item *item, void *arg) {
+    Item ***next = arg;
+    *(*next)++ = item;
+}
+
+static long int snapshot_bin(long int hash, int bin_shift) {
+    if (bin_shift == 64) {
+        return 0;
+    }
+    return (long int)(((unsigned long int)hash * 0x9e3779b97f4a7c15UL) >> bin_shift);
+}
+
+/***
+* Fills in one field of an entry; strings get the next place in the string pool.
+***/
+static void set_entry_field(union Hashable field, hash_type type, unsigned long int *to, unsigned long int *len,
+                            unsigned long int *string_offset) {
+    *len = 0;
+    switch (type) {
+        case INTEGER:
+            *to = (unsigned long int)field.i;
+            break;
+        case DOUBLE:
+            memcpy(to, &field.f, sizeof(double));
+            break;
+        case STRING:
+            *to = *string_offset;
+            *len = field.len;
+            *string_offset += field.len + 1;
+            break;
+        case OBJECT: // write_snapshot turns these away
+            break;
+    }
+}
+
+/***
+* Writes hashtable to the file at path. Returns 0, or -1 (with errno set) if the file can't be written.
+***/
+int save_snapshot(HashTable *hashtable, const char *path) {
+    Item **items = malloc((hashtable->load + 1)*sizeof(Item*));
+    Item **next = items;
+    for_each_item(hashtable, collect_item, &next);
+    int result = write_snapshot(next - items, items, hashtable->hash_family, hashtable->seed, path);
+    free(items);
+    return result;
+}
+
+/***
+* Writes count items to a snapshot file at path, for tables hashing with the given family and seed.
+*   Returns 0, or -1 (with errno set) if the file can't be written, or the items
+*   hold OBJECT values (errno is then EINVAL).
+***/
+int write_snapshot(long int count, Item **items, hash_family family, unsigned long int seed, const char *path) {
+    unsigned long int string_bytes = 0;
+    long int i;
+    for (i = 0; i < count; i++) {
+        if (items[i]->value_type == OBJECT) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (items[i]->key_type == STRING) {
+            string_bytes += items[i]->key.len + 1;
+        }
+        if (items[i]->value_type == STRING) {
+            string_bytes += items[i]->value.len + 1;
+        }
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.hash_family = family;
+    header.seed = seed;
+    header.item_count = count;
+    header.bin_count = 1;
+    int bin_shift = 64;
+    while (header.bin_count < (unsigned long int)count) {
+        header.bin_count *= 2;
+        bin_shift--;
+    }
+    header.bins_offset = sizeof(SnapshotHeader);
+    header.entries_offset = header.bins_offset + (header.bin_count + 1)*sizeof(unsigned long int);
+    header.strings_offset = header.entries_offset + count*sizeof(SnapshotEntry);
+    header.file_size = header.strings_offset + string_bytes;
+
+    // counting sort of the items by bin
+    unsigned long int *bins = calloc(header.bin_count + 1, sizeof(unsigned long int));
+    for (i = 0; i < count; i++) {
+        bins[snapshot_bin(items[i]->hash, bin_shift) + 1]++;
+    }
+    unsigned long int b;
+    for (b = 0; b < header.bin_count; b++) {
+        bins[b + 1] += bins[b];
+    }
+    Item **sorted = malloc((count + 1)*sizeof(Item*));
+    unsigned long int *next = malloc(header.bin_count*sizeof(unsigned long int));
+    memcpy(next, bins, header.bin_count*sizeof(unsigned long int));
+    for (i = 0; i < count; i++) {
+        sorted[next[snapshot_bin(items[i]->hash, bin_shift)]++] = items[i];
+    }
+    free(next);
+
+    FILE *file = fopen(path, "wb");
+    int ok = (file != NULL);
+    if (ok) {
+        ok = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+             (fwrite(bins, sizeof(unsigned long int), header.bin_count + 1, file) == header.bin_count + 1);
+    }
+
+    unsigned long int string_offset = header.strings_offset;
+    for (i = 0; ok && (i < count); i++) {
+        SnapshotEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.hash = sorted[i]->hash;
+        entry.key_type = sorted[i]->key_type;
+        entry.value_type = sorted[i]->value_type;
+        set_entry_field(sorted[i]->key, sorted[i]->key_type, &entry.key, &entry.key_len, &string_offset);
+        set_entry_field(sorted[i]->value, sorted[i]->value_type, &entry.value, &entry.value_len, &string_offset);
+        ok = (fwrite(&entry, sizeof(entry), 1, file) == 1);
+    }
+    // strings go in the same order their offsets were handed out in
+    for (i = 0; ok && (i < count); i++) {
+        if (sorted[i]->key_type == STRING) {
+            ok = (fwrite(sorted[i]->key.str, 1, sorted[i]->key.len + 1, file) == sorted[i]->key.len + 1);
+        }
+        if (ok && (sorted[i]->value_type == STRING)) {
+            ok = (fwrite(sorted[i]->value.str, 1, sorted[i]->value.len + 1, file) == sorted[i]->value.len + 1);
+        }
+    }
+
+    if (file != NULL) {
+        int saved_errno = errno;
+        if ((fclose(file) != 0) && ok) {
+            ok = 0;
+        }
+        else {
+            errno = saved_errno;
+        }
+    }
+    free(bins);
+    free(sorted);
+    return ok ? 0 : -1;
+}
+
+/***
+* Maps the snapshot file at path. Returns NULL (with errno set) if it can't be
+*   opened, or isn't a snapshot this version can read (errno is then EINVAL).
+***/
+Snapshot *open_snapshot(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(SnapshotHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    const SnapshotHeader *header = base;
+    unsigned long int bin_count = header->bin_count;
+    int valid = (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0) &&
+                (header->version == SNAPSHOT_VERSION) &&
+                (header->file_size == size) &&
+                (bin_count > 0) && ((bin_count & (bin_count - 1)) == 0) &&
+                (header->bins_offset == sizeof(SnapshotHeader)) &&
+                (header->entries_offset == header->bins_offset + (bin_count + 1)*sizeof(unsigned long int)) &&
+                (header->strings_offset == header->entries_offset + header->item_count*sizeof(SnapshotEntry)) &&
+                (header->strings_offset <= size);
+    if (valid) {
+        const unsigned long int *bins = (const unsigned long int *)((const char *)base + header->bins_offset);
+        valid = (bins[bin_count] == header->item_count);
+    }
+    if (!valid) {
+        munmap(base, size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    Snapshot *snapshot = malloc(sizeof(Snapshot));
+    snapshot->base = base;
+    snapshot->size = size;
+    snapshot->header = header;
+    snapshot->bins = (const unsigned long int *)(snapshot->base + header->bins_offset);
+    snapshot->entries = (const SnapshotEntry *)(snapshot->base + header->entries_offset);
+    snapshot->bin_shift = 64;
+    while ((1UL << (64 - snapshot->bin_shift)) < bin_count) {
+        snapshot->bin_shift--;
+    }
+    return snapshot;
+}
+
+void close_snapshot(Snapshot *snapshot) {
+    munmap((void *)snapshot->base, snapshot->size);
+    free(snapshot);
+}
+
+/***
+* Turns one field of an entry back into a Hashable -- strings point into the mapping.
+***/
+static union Hashable entry_field(unsigned long int field, unsigned long int len, int type, Snapshot *snapshot) {
+    union Hashable hashable;
+    switch (type) {
+        case INTEGER:
+            hashable.i = (long int)field;
+            break;
+        case DOUBLE:
+            memcpy(&hashable.f, &field, sizeof(double));
+            break;
+        case STRING:
+            hashable.str = (char *)(snapshot->base + field);
+            hashable.len = len;
+            break;
+    }
+    return hashable;
+}
+
+static void entry_to_item(const SnapshotEntry *entry, Snapshot *snapshot, Item *item) {
+    item->hash = entry->hash;
+    item->key_type = entry->key_type;
+    item->key = entry_field(entry->key, entry->key_len, entry->key_type, snapshot);
+    item->value_type = entry->value_type;
+    item->value = entry_field(entry->value, entry->value_len, entry->value_type, snapshot);
+}
+
+/***
+* Fills in *item with the snapshot's index'th entry (0 <= index < item_count), strings pointing into the mapping.
+***/
+void snapshot_item(long int index, Snapshot *snapshot, Item *item) {
+    entry_to_item(&snapshot->entries[index], snapshot, item);
+}
+
+/***
+* Looks up the given hash and key in a mapped snapshot.
+*   If found, fills in *found and returns 1; its strings point into the mapping, so
+*   they are read-only and only valid until close_snapshot. Otherwise returns 0.
+*   As with lookup_by_hash, the hash must come from the same hash function as the
+*   saved table's -- or pass LONG_MAX to use the table's built-in hash function.
+***/
+int snapshot_lookup(long int hash, union Hashable key, hash_type key_type, Snapshot *snapshot, Item *found) {
+    if (hash == LONG_MAX) {
+        hash = hash_with_family(key, key_type, snapshot->header->hash_family, snapshot->header->seed);
+    }
+    long int bin_index = snapshot_bin(hash, snapshot->bin_shift);
+
+    unsigned long int i;
+    for (i = snapshot->bins[bin_index]; i < snapshot->bins[bin_index + 1]; i++) {
+        const SnapshotEntry *entry = &snapshot->entries[i];
+        if ((entry->hash != hash) || (entry->key_type != (int)key_type)) {
+            continue;
+        }
+        Item item;
+        entry_to_item(entry, snapshot, &item);
+        if (item_has_key(&item, hash, key, key_type)) {
+            *found = item;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/***
+* Builds an ordinary (mutable) hashtable holding copies of everything in a snapshot.
+*   The table hashes with the snapshot's hash family and seed, whatever options says.
+***/
+HashTable *snapshot_to_table(Snapshot *snapshot, double max_load_proportion, TableOptions options) {
+    long int count = (long int)snapshot->header->item_count;
+    options.hash_family = snapshot->header->hash_family;
+    options.seed = snapshot->header->seed;
+    HashTable *hashtable = init_with_options(1, max_load_proportion, options);
+    hashtable = reserve(count, hashtable);
+
+    long int i;
+    for (i = 0; i < count; i++) {
+        Item item;
+        snapshot_item(i, snapshot, &item);
+        if (item.key_type == STRING) {
+            char *str = malloc(item.key.len + 1);
+            memcpy(str, item.key.str, item.key.len + 1);
+            item.key.str = str;
+        }
+        if (item.value_type == STRING) {
+            char *str = malloc(item.value.len + 1);
+            memcpy(str, item.value.str, item.value.len + 1);
+            item.value.str = str;
+        }
+        hashtable = add(item.hash, item.key, item.key_type, item.value, item.value_type, hashtable);
+    }
+    return hashtable;
+}
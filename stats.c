@@ -0,0 +1,128 @@
+#include <time.h>
+#include "hashtable.h"
+
+/***
+* Stats
+*   Operation counters cost one NULL check per operation while they're disabled,
+*   so they're off unless a table is created with collect_stats or enable_stats is called.
+*   Everything about the table's layout -- the probe length histogram, the longest
+*   probe and the memory in use -- is measured by table_stats when asked for,
+*   so it costs nothing on the hot path at all.
+*
+*   A probe length is how many places a lookup of an item checks to find it:
+*   nodes for CHAINED (so the longest probe is the longest chain), slots for
+*   OPEN_ADDRESSING and groups of SWISS_GROUP_WIDTH slots for SWISS_TABLE.
+***/
+
+void enable_stats(HashTable *hashtable) {
+    if (hashtable->stats == NULL) {
+        hashtable->stats = calloc(1, sizeof(TableStats));
+    }
+}
+
+void disable_stats(HashTable *hashtable) {
+    free(hashtable->stats);
+    hashtable->stats = NULL;
+}
+
+/***
+* Seconds on a monotonic clock, for timing resizes.
+***/
+double stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/***
+* Counts a resize that started at start (from stats_clock). Only called while stats are enabled.
+***/
+void record_resize(double start, HashTable *hashtable) {
+    hashtable->stats->resizes++;
+    hashtable->stats->resize_seconds += stats_clock() - start;
+}
+
+static void count_probe(long int length, TableStats *stats) {
+    stats->probe_histogram[(length < STATS_HISTOGRAM_BUCKETS) ? length - 1 : STATS_HISTOGRAM_BUCKETS - 1]++;
+    if (length > stats->max_probe) {
+        stats->max_probe = length;
+    }
+}
+
+static long int string_bytes(Item *item) {
+    long int bytes = 0;
+    if (item->key_type == STRING) {
+        bytes += item->key.len + 1;
+    }
+    if (item->value_type == STRING) {
+        bytes += item->value.len + 1;
+    }
+    return bytes;
+}
+
+static void count_chains(Node **bins, long int first, long int last, TableStats *stats) {
+    long int i;
+    for (i = first; i < last; i++) {
+        long int length = 0;
+        Node *current_node;
+        for (current_node = bins[i]; current_node != NULL; current_node = current_node->next) {
+            count_probe(++length, stats);
+            stats->bytes_allocated += string_bytes(&current_node->item);
+        }
+    }
+}
+
+/***
+* Fills in *stats: the operation counters so far (all 0 while stats are disabled),
+*   and the probe lengths and memory use of the table as it is now.
+*   Takes one pass over the table's storage, and leaves it as it was.
+***/
+void table_stats(HashTable *hashtable, TableStats *stats) {
+    if (hashtable->stats != NULL) {
+        *stats = *hashtable->stats;
+    }
+    else {
+        memset(stats, 0, sizeof(TableStats));
+    }
+    memset(stats->probe_histogram, 0, sizeof(stats->probe_histogram));
+    stats->max_probe = 0;
+    stats->bytes_allocated = sizeof(HashTable) + ((hashtable->stats != NULL) ? sizeof(TableStats) : 0);
+
+    // removed items are handed back in pool nodes, whatever the storage
+    NodeChunk *chunk;
+    for (chunk = hashtable->chunks; chunk != NULL; chunk = chunk->next) {
+        stats->bytes_allocated += sizeof(NodeChunk) + chunk->count*sizeof(Node);
+    }
+
+    long int i;
+    if (hashtable->storage == OPEN_ADDRESSING) {
+        stats->bytes_allocated += hashtable->size*sizeof(Slot);
+        for (i = 0; i < hashtable->size; i++) {
+            Slot *slot = &hashtable->slots[i];
+            if (slot->distance != EMPTY_SLOT) {
+                count_probe(slot->distance + 1, stats);
+                stats->bytes_allocated += string_bytes(&slot->item);
+            }
+        }
+        return;
+    }
+    if (hashtable->storage == SWISS_TABLE) {
+        stats->bytes_allocated += hashtable->size*(sizeof(Item) + 1);
+        for (i = 0; i < hashtable->size; i++) {
+            if (hashtable->control[i] >= 0) {
+                count_probe(swiss_table_probe_length(i, hashtable), stats);
+                stats->bytes_allocated += string_bytes(&hashtable->items[i]);
+            }
+        }
+        return;
+    }
+
+    stats->bytes_allocated += hashtable->size*sizeof(Node*);
+    count_chains(hashtable->bin_list, 0, hashtable->size, stats);
+    if (hashtable->old_bin_list != NULL) {
+        // mid-resize, the bins that haven't moved yet are counted where they are --
+        // finishing the resize here would make reading stats change the table
+        stats->bytes_allocated += hashtable->old_size*sizeof(Node*);
+        count_chains(hashtable->old_bin_list, hashtable->rehash_index, hashtable->old_size, stats);
+    }
+}
@@ -0,0 +1,341 @@
+#include "hashtable.h"
+#include <errno.h>
+#include <unistd.h>
+
+/***
+* Streams
+*   dump_table writes a hashtable out a chunk of entries at a time, and load_table
+*   rebuilds one from such a stream a chunk at a time -- so neither side ever holds
+*   more than one chunk of encoded entries, however big the table. Unlike a
+*   snapshot (snapshot.c), a stream can go anywhere bytes can: a pipe, a socket,
+*   a Python file object or a pickle.
+*
+*   Each entry is its hash, key type and value type, then the key and the value:
+*   8 bytes for an integer or a double, or an 8-byte length and the bytes of a string.
+*   Like snapshots, streams use the writing machine's byte order.
+***/
+
+typedef struct stream_chunk {
+    char *data;
+    unsigned long int size;
+    unsigned long int capacity;
+    unsigned long int entry_count;
+} StreamChunk;
+
+typedef struct dump_state {
+    stream_writer write;
+    void *arg;
+    long int chunk_items;
+    StreamChunk chunk;
+    int error;
+} DumpState;
+
+static void append_bytes(const void *data, unsigned long int size, StreamChunk *chunk) {
+    if (chunk->size + size > chunk->capacity) {
+        while (chunk->size + size > chunk->capacity) {
+            chunk->capacity *= 2;
+        }
+        chunk->data = realloc(chunk->data, chunk->capacity);
+    }
+    memcpy(chunk->data + chunk->size, data, size);
+    chunk->size += size;
+}
+
+static void append_field(union Hashable field, hash_type type, StreamChunk *chunk) {
+    if (type == STRING) {
+        unsigned long int len = field.len;
+        append_bytes(&len, sizeof(len), chunk);
+        append_bytes(field.str, len, chunk);
+    }
+    else {
+        append_bytes(&field, sizeof(long int), chunk);
+    }
+}
+
+static int flush_chunk(DumpState *state) {
+    StreamChunkHeader header;
+    header.entry_count = state->chunk.entry_count;
+    header.byte_count = state->chunk.size;
+    if ((state->write(&header, sizeof(header), state->arg) < 0) ||
+        ((header.byte_count > 0) && (state->write(state->chunk.data, header.byte_count, state->arg) < 0))) {
+        return -1;
+    }
+    state->chunk.size = 0;
+    state->chunk.entry_count = 0;
+    return 0;
+}
+
+static void dump_item(Item *item, void *arg) {
+    DumpState *state = arg;
+    if (state->error) {
+        return;
+    }
+    int types[2] = {item->key_type, item->value_type};
+    append_bytes(&item->hash, sizeof(item->hash), &state->chunk);
+    append_bytes(types, sizeof(types), &state->chunk);
+    append_field(item->key, item->key_type, &state->chunk);
+    append_field(item->value, item->value_type, &state->chunk);
+    state->chunk.entry_count++;
+    if ((long int)state->chunk.entry_count >= state->chunk_items) {
+        state->error = (flush_chunk(state) < 0);
+    }
+}
+
+/***
+* Writes hashtable as a stream, passing write chunks of up to chunk_items
+*   entries (or STREAM_CHUNK_ITEMS if chunk_items isn't positive).
+*   Returns 0, or -1 as soon as write fails -- or, with errno set to EINVAL and
+*   nothing written, if the table holds OBJECT values.
+***/
+int dump_table(stream_writer write, void *arg, long int chunk_items, HashTable *hashtable) {
+    if (table_holds_objects(hashtable)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    DumpState state;
+    state.write = write;
+    state.arg = arg;
+    state.chunk_items = (chunk_items > 0) ? chunk_items : STREAM_CHUNK_ITEMS;
+    state.chunk.capacity = 4096;
+    state.chunk.data = malloc(state.chunk.capacity);
+    state.chunk.size = 0;
+    state.chunk.entry_count = 0;
+    state.error = 0;
+
+    StreamHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STREAM_MAGIC, sizeof(header.magic));
+    header.version = STREAM_VERSION;
+    header.hash_family = hashtable->hash_family;
+    header.seed = hashtable->seed;
+    header.item_count = hashtable->load;
+    state.error = (write(&header, sizeof(header), arg) < 0);
+
+    if (!state.error) {
+        for_each_item(hashtable, dump_item, &state);
+    }
+    if (!state.error && (state.chunk.entry_count > 0)) {
+        state.error = (flush_chunk(&state) < 0);
+    }
+    if (!state.error) {
+        state.error = (flush_chunk(&state) < 0); // the empty chunk that ends the stream
+    }
+    free(state.chunk.data);
+    return state.error ? -1 : 0;
+}
+
+static int write_to_fd(const void *data, size_t size, void *arg) {
+    int fd = *(int *)arg;
+    const char *next = data;
+    while (size > 0) {
+        ssize_t written = write(fd, next, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        next += written;
+        size -= written;
+    }
+    return 0;
+}
+
+int dump_table_to_fd(int fd, long int chunk_items, HashTable *hashtable) {
+    return dump_table(write_to_fd, &fd, chunk_items, hashtable);
+}
+
+/***
+* Reads exactly size bytes, returning 0, or -1 if the stream ends first or read fails.
+***/
+static int read_exactly(stream_reader read, void *arg, void *buffer, size_t size) {
+    char *next = buffer;
+    while (size > 0) {
+        long int got = read(next, size, arg);
+        if (got <= 0) {
+            return -1;
+        }
+        next += got;
+        size -= got;
+    }
+    return 0;
+}
+
+/***
+* Decodes one field at *position, copying strings, and moves past it.
+*   Returns 0, or -1 if the field runs past end.
+***/
+static int decode_field(const char **position, const char *end, hash_type type, union Hashable *field) {
+    if (end - *position < (long int)sizeof(long int)) {
+        return -1;
+    }
+    if (type != STRING) {
+        memcpy(field, *position, sizeof(long int));
+        *position += sizeof(long int);
+        return 0;
+    }
+    unsigned long int len;
+    memcpy(&len, *position, sizeof(len));
+    *position += sizeof(len);
+    if ((unsigned long int)(end - *position) < len) {
+        return -1;
+    }
+    field->str = malloc(len + 1);
+    memcpy(field->str, *position, len);
+    field->str[len] = '\0';
+    field->len = len;
+    *position += len;
+    return 0;
+}
+
+static int valid_type(int type) {
+    return (type == INTEGER) || (type == DOUBLE) || (type == STRING);
+}
+
+/***
+* Decodes and adds a chunk's entries. Returns 0, or -1 if the chunk is malformed
+*   (in which case none of its entries are added).
+***/
+static int load_chunk(const char *data, StreamChunkHeader *header, HashTable **hashtable) {
+    long int count = header->entry_count;
+    long int *hashes = malloc(count*sizeof(long int));
+    union Hashable *keys = malloc(count*sizeof(union Hashable));
+    hash_type *key_types = malloc(count*sizeof(hash_type));
+    union Hashable *values = malloc(count*sizeof(union Hashable));
+    hash_type *value_types = malloc(count*sizeof(hash_type));
+
+    const char *position = data;
+    const char *end = data + header->byte_count;
+    long int decoded = 0;
+    int error = 0;
+    while (!error && (decoded < count)) {
+        int types[2];
+        if (end - position < (long int)(sizeof(long int) + sizeof(types))) {
+            error = 1;
+            break;
+        }
+        memcpy(&hashes[decoded], position, sizeof(long int));
+        memcpy(types, position + sizeof(long int), sizeof(types));
+        position += sizeof(long int) + sizeof(types);
+        if (!valid_type(types[0]) || !valid_type(types[1])) {
+            error = 1;
+            break;
+        }
+        key_types[decoded] = types[0];
+        value_types[decoded] = types[1];
+        if (decode_field(&position, end, key_types[decoded], &keys[decoded]) < 0) {
+            error = 1;
+            break;
+        }
+        if (decode_field(&position, end, value_types[decoded], &values[decoded]) < 0) {
+            if (key_types[decoded] == STRING) {
+                free(keys[decoded].str);
+            }
+            error = 1;
+            break;
+        }
+        decoded++;
+    }
+
+    if (error || (position != end)) {
+        long int i;
+        for (i = 0; i < decoded; i++) {
+            Item item = {hashes[i], keys[i], key_types[i], values[i], value_types[i]};
+            free_item_contents(&item);
+        }
+        error = 1;
+    }
+    else {
+        *hashtable = add_many(count, hashes, keys, key_types, values, value_types, *hashtable);
+    }
+
+    free(hashes);
+    free(keys);
+    free(key_types);
+    free(values);
+    free(value_types);
+    return error ? -1 : 0;
+}
+
+/***
+* Builds a hashtable from a stream written by dump_table, reading and adding a chunk at a time.
+*   The table is sized up front from the count in the stream's header (up to
+*   STREAM_RESERVE_LIMIT pairs), and hashes with the dumped table's hash family and
+*   seed, whatever options says.
+*   Returns NULL if read fails or the stream is malformed or cut short.
+***/
+HashTable *load_table(stream_reader read, void *arg, double max_load_proportion, TableOptions options) {
+    StreamHeader header;
+    if ((read_exactly(read, arg, &header, sizeof(header)) < 0) ||
+        (memcmp(header.magic, STREAM_MAGIC, sizeof(header.magic)) != 0) ||
+        (header.version != STREAM_VERSION) ||
+        (header.hash_family > IDENTITY)) {
+        return NULL;
+    }
+    options.hash_family = header.hash_family;
+    options.seed = header.seed;
+    HashTable *hashtable = init_with_options(1, max_load_proportion, options);
+    // item_count is only a hint from the stream, so don't trust it with more than
+    // STREAM_RESERVE_LIMIT pairs -- past that, the table grows as chunks are added
+    hashtable = reserve((header.item_count < STREAM_RESERVE_LIMIT) ? (long int)header.item_count
+                                                                   : STREAM_RESERVE_LIMIT, hashtable);
+
+    unsigned long int capacity = 4096;
+    char *data = malloc(capacity);
+    int error = 0;
+    while (!error) {
+        StreamChunkHeader chunk;
+        if (read_exactly(read, arg, &chunk, sizeof(chunk)) < 0) {
+            error = 1;
+            break;
+        }
+        if (chunk.entry_count == 0) {
+            break;
+        }
+        // every entry takes at least a hash, two types and two 8-byte fields
+        if (chunk.entry_count > chunk.byte_count / (2*sizeof(long int) + 2*sizeof(int) + sizeof(long int))) {
+            error = 1;
+            break;
+        }
+        if (chunk.byte_count > capacity) {
+            // byte_count comes from the stream too -- don't double capacity past the point
+            // of overflowing, and give up if the memory isn't there
+            if (chunk.byte_count > (unsigned long int)LONG_MAX) {
+                error = 1;
+                break;
+            }
+            while (chunk.byte_count > capacity) {
+                capacity *= 2;
+            }
+            char *grown = realloc(data, capacity);
+            if (grown == NULL) {
+                error = 1;
+                break;
+            }
+            data = grown;
+        }
+        error = (read_exactly(read, arg, data, chunk.byte_count) < 0) ||
+                (load_chunk(data, &chunk, &hashtable) < 0);
+    }
+    free(data);
+
+    if (error) {
+        free_table(hashtable);
+        return NULL;
+    }
+    return hashtable;
+}
+
+static long int read_from_fd(void *buffer, size_t size, void *arg) {
+    int fd = *(int *)arg;
+    ssize_t got;
+    do {
+        got = read(fd, buffer, size);
+    } while ((got < 0) && (errno == EINTR));
+    return (long int)got;
+}
+
+HashTable *load_table_from_fd(int fd, double max_load_proportion, TableOptions options) {
+    return load_table(read_from_fd, &fd, max_load_proportion, options);
+}
@@ -0,0 +1,298 @@
+#include "hashtable.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/***
+* Swiss table storage
+*   Items live in one flat array, next to a parallel array of control bytes.
+*   A full slot's control byte holds 7 bits of its hash, so a probe can rule out
+*   almost every non-matching slot without touching the item or comparing keys.
+*   Slots are probed a group (SWISS_GROUP_WIDTH bytes) at a time -- with SSE2,
+*   one compare-and-movemask finds every candidate in the group at once.
+*   The number of slots is always a power of two and a multiple of the group width.
+***/
+
+/***
+* Spreads the bits of a (possibly weak) user-supplied hash,
+*   so both the group index and the 7-bit fragment are well distributed.
+***/
+static unsigned long int mix_hash(long int hash) {
+    unsigned long int h = (unsigned long int)hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdUL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53UL;
+    h ^= h >> 33;
+    return h;
+}
+
+static signed char hash_fragment(unsigned long int mixed) {
+    return (signed char)(mixed & 0x7f);
+}
+
+/***
+* Group scans -- each returns a bitmask with bit i set if slot i of the group matches
+***/
+#ifdef __SSE2__
+static unsigned int match_byte(const signed char *group, signed char byte) {
+    __m128i control = _mm_loadu_si128((const __m128i *)group);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(byte)));
+}
+
+static unsigned int match_empty_or_deleted(const signed char *group) {
+    // SWISS_EMPTY and SWISS_DELETED are the only control bytes with the high bit set
+    __m128i control = _mm_loadu_si128((const __m128i *)group);
+    return (unsigned int)_mm_movemask_epi8(control);
+}
+#else
+static unsigned int match_byte(const signed char *group, signed char byte) {
+    unsigned int bits = 0;
+    int i;
+    for (i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (group[i] == byte) {
+            bits |= 1u << i;
+        }
+    }
+    return bits;
+}
+
+static unsigned int match_empty_or_deleted(const signed char *group) {
+    unsigned int bits = 0;
+    int i;
+    for (i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (group[i] < 0) {
+            bits |= 1u << i;
+        }
+    }
+    return bits;
+}
+#endif
+
+static long int round_up_capacity(long int size) {
+    long int capacity = SWISS_GROUP_WIDTH;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/***
+* Sets up an empty slot and control array with room for at least size items.
+***/
+void swiss_table_allocate(long int size, HashTable *hashtable) {
+    hashtable->size = round_up_capacity(size);
+    hashtable->items = malloc(hashtable->size*sizeof(Item));
+    hashtable->control = malloc(hashtable->size);
+    memset(hashtable->control, SWISS_EMPTY, hashtable->size);
+    hashtable->tombstones = 0;
+}
+
+/***
+* Returns the slot index holding the given key, or -1 if it is not stored.
+*   Groups are visited in triangular order, which reaches every group of a
+*   power-of-two table exactly once.
+***/
+static long int find_slot(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    unsigned long int mixed = mix_hash(hash);
+    signed char fragment = hash_fragment(mixed);
+    long int group_mask = hashtable->size / SWISS_GROUP_WIDTH - 1;
+    long int group_index = (mixed >> 7) & group_mask;
+
+    long int probes;
+    for (probes = 0; probes <= group_mask; probes++) {
+        long int first_slot = group_index * SWISS_GROUP_WIDTH;
+        const signed char *group = hashtable->control + first_slot;
+
+        unsigned int candidates = match_byte(group, fragment);
+        while (candidates != 0) {
+            long int index = first_slot + __builtin_ctz(candidates);
+            Item *current_item = &hashtable->items[index];
+            if (item_has_key(current_item, hash, key, key_type)) {
+                return index;
+            }
+            candidates &= candidates - 1;
+        }
+        if (match_byte(group, SWISS_EMPTY) != 0) {
+            // the key would have been placed in this group's empty slot
+            return -1;
+        }
+        group_index = (group_index + probes + 1) & group_mask;
+    }
+    return -1;
+}
+
+void swiss_table_prefetch(long int hash, HashTable *hashtable) {
+    unsigned long int mixed = mix_hash(hash);
+    long int group_mask = hashtable->size / SWISS_GROUP_WIDTH - 1;
+    long int first_slot = ((mixed >> 7) & group_mask) * SWISS_GROUP_WIDTH;
+    __builtin_prefetch(hashtable->control + first_slot);
+    __builtin_prefetch(hashtable->items + first_slot);
+}
+
+/***
+* Returns how many groups a lookup of the item in the given (full) slot probes to find it.
+***/
+long int swiss_table_probe_length(long int index, HashTable *hashtable) {
+    unsigned long int mixed = mix_hash(hashtable->items[index].hash);
+    long int group_mask = hashtable->size / SWISS_GROUP_WIDTH - 1;
+    long int group_index = (mixed >> 7) & group_mask;
+    long int target = index / SWISS_GROUP_WIDTH;
+
+    long int probes = 0;
+    while ((group_index != target) && (probes <= group_mask)) {
+        probes++;
+        group_index = (group_index + probes) & group_mask;
+    }
+    return probes + 1;
+}
+
+/***
+* Places item in the first free slot along its probe sequence, without checking for duplicates.
+***/
+static void place_item(Item *item, HashTable *hashtable) {
+    unsigned long int mixed = mix_hash(item->hash);
+    long int group_mask = hashtable->size / SWISS_GROUP_WIDTH - 1;
+    long int group_index = (mixed >> 7) & group_mask;
+
+    long int probes;
+    for (probes = 0; probes <= group_mask; probes++) {
+        long int first_slot = group_index * SWISS_GROUP_WIDTH;
+        unsigned int free_slots = match_empty_or_deleted(hashtable->control + first_slot);
+        if (free_slots != 0) {
+            long int index = first_slot + __builtin_ctz(free_slots);
+            if (hashtable->control[index] == SWISS_DELETED) {
+                hashtable->tombstones--;
+            }
+            hashtable->control[index] = hash_fragment(mixed);
+            hashtable->items[index] = *item;
+            hashtable->load++;
+            return;
+        }
+        group_index = (group_index + probes + 1) & group_mask;
+    }
+}
+
+/***
+* Adds a copy of item to the table, or updates the value if the key is already present.
+*   Deleted slots still lengthen probe sequences, so they count towards the load
+*   limit; if most of the used slots are tombstones, the table is rebuilt at the same size.
+***/
+void swiss_table_add(Item *item, HashTable *hashtable) {
+    long int index = find_slot(item->hash, item->key, item->key_type, hashtable);
+    if (index >= 0) {
+        // keys are equal -- replace
+        free_item_contents(&hashtable->items[index]);
+        hashtable->items[index] = *item;
+        return;
+    }
+
+    double used = (double)(hashtable->load + hashtable->tombstones + 1);
+    if ((used / (double)hashtable->size > hashtable->max_load_proportion) || (used > hashtable->size)) {
+        // through resize_to, so stats see these rebuilds too
+        if (hashtable->tombstones > hashtable->load) {
+            resize_to(hashtable->size, hashtable);
+        }
+        else {
+            resize_to(2*hashtable->size, hashtable);
+        }
+    }
+    place_item(item, hashtable);
+}
+
+/***
+* Returns item associated with the given hash and key, or NULL if no such item exists.
+*   The item points into the slot array, so it is only valid until the next add or remove.
+***/
+Item *swiss_table_lookup(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    long int index = find_slot(hash, key, key_type, hashtable);
+    if (index < 0) {
+        return NULL;
+    }
+    return &hashtable->items[index];
+}
+
+/***
+* Marks the slot at index free.
+*   A slot can go straight back to SWISS_EMPTY if its group still has an empty
+*   slot, since no probe sequence can have continued past that group.
+***/
+static void vacate_slot(long int index, HashTable *hashtable) {
+    const signed char *group = hashtable->control + (index - index % SWISS_GROUP_WIDTH);
+    if (match_byte(group, SWISS_EMPTY) != 0) {
+        hashtable->control[index] = SWISS_EMPTY;
+    }
+    else {
+        hashtable->control[index] = SWISS_DELETED;
+        hashtable->tombstones++;
+    }
+    hashtable->load--;
+}
+
+/***
+* Removes and returns item with given hash and key, or NULL if no such item exists.
+*   The returned item is a copy, held in a node from the hashtable's node pool,
+*   that the caller must free with free_item.
+***/
+Item *swiss_table_remove(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    long int index = find_slot(hash, key, key_type, hashtable);
+    if (index < 0) {
+        return NULL;
+    }
+
+    Item *removed = &allocate_node(hashtable)->item;
+    *removed = hashtable->items[index];
+    vacate_slot(index, hashtable);
+    return removed;
+}
+
+/***
+* Removes and frees the item with given hash and key in place. Returns 1 if it was found, 0 otherwise.
+***/
+int swiss_table_discard(long int hash, union Hashable key, hash_type key_type, HashTable *hashtable) {
+    long int index = find_slot(hash, key, key_type, hashtable);
+    if (index < 0) {
+        return 0;
+    }
+
+    free_item_contents(&hashtable->items[index]);
+    vacate_slot(index, hashtable);
+    return 1;
+}
+
+/***
+* Rebuilds the table with room for size items, dropping all tombstones.
+*   The hashtable is updated in place, so the same pointer is returned.
+***/
+HashTable *swiss_table_resize(long int size, HashTable *hashtable) {
+    Item *old_items = hashtable->items;
+    signed char *old_control = hashtable->control;
+    long int old_size = hashtable->size;
+
+    swiss_table_allocate(size, hashtable);
+    hashtable->load = 0;
+
+    long int i;
+    for (i = 0; i < old_size; i++) {
+        if (old_control[i] >= 0) {
+            place_item(&old_items[i], hashtable);
+        }
+    }
+    free(old_items);
+    free(old_control);
+    return hashtable;
+}
+
+void swiss_table_free(HashTable *hashtable) {
+    long int i;
+    for (i = 0; i < hashtable->size; i++) {
+        if (hashtable->control[i] >= 0) {
+            free_item_contents(&hashtable->items[i]);
+        }
+    }
+    free(hashtable->items);
+    free(hashtable->control);
+    free_node_pool(hashtable);
+    free(hashtable);
+}
@@ -0,0 +1,13 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/***
+* A minimal harness for the C tests: CHECK stops the test run at the first failure.
+***/
+#define CHECK(condition)                                                          \
+    do {                                                                          \
+        if (!(condition)) {                                                       \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1);                                                              \
+        }                                                                         \
+    } while (0)
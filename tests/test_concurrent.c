@@ -0,0 +1,138 @@
+#include "concurrent_hashtable.h"
+#include "test.h"
+
+/***
+* Concurrent hashtable: writers add, update and discard their own ranges of keys
+*   into a table that starts small, so stripes are being migrated the whole time,
+*   while readers check a set of stable keys without taking any locks.
+*   Values are strings, so a node freed while a reader could still see it shows up
+*   as a wrong value here, or as a use-after-free under -fsanitize=address.
+***/
+
+#define WRITERS 4
+#define READERS 2
+#define KEYS_PER_WRITER 20000
+#define STABLE_KEYS 1000
+
+typedef struct test_thread {
+    pthread_t thread;
+    ConcurrentHashTable *table;
+    int id;
+    atomic_int *writers_done;
+    unsigned long int rng;
+} TestThread;
+
+static union Hashable make_string(char prefix, long int n) {
+    union Hashable value;
+    value.str = malloc(32);
+    value.len = (size_t)sprintf(value.str, "%c%ld", prefix, n);
+    return value;
+}
+
+static int has_value(Item *item, char prefix, long int n) {
+    char expected[32];
+    size_t len = (size_t)sprintf(expected, "%c%ld", prefix, n);
+    return (item != NULL) && (item->value_type == STRING) && (item->value.len == len) &&
+           (memcmp(item->value.str, expected, len) == 0);
+}
+
+static void *write_keys(void *arg) {
+    TestThread *tt = arg;
+    ConcurrentHandle *handle = concurrent_attach(tt->table);
+    union Hashable key;
+    long int first = (long int)tt->id * KEYS_PER_WRITER;
+    long int k;
+    for (k = first; k < first + KEYS_PER_WRITER; k++) {
+        key.i = k;
+        concurrent_add(LONG_MAX, key, INTEGER, make_string('v', k), STRING, handle);
+        if (k % 4 == 0) { // an update retires the node it replaces
+            concurrent_add(LONG_MAX, key, INTEGER, make_string('u', k), STRING, handle);
+        }
+        concurrent_read_begin(handle);
+        CHECK(has_value(concurrent_lookup(LONG_MAX, key, INTEGER, handle), (k % 4 == 0) ? 'u' : 'v', k));
+        concurrent_read_end(handle);
+    }
+    for (k = first; k < first + KEYS_PER_WRITER; k += 2) {
+        key.i = k;
+        CHECK(concurrent_discard(LONG_MAX, key, INTEGER, handle) == 1);
+        CHECK(concurrent_discard(LONG_MAX, key, INTEGER, handle) == 0);
+    }
+    concurrent_detach(handle);
+    atomic_fetch_add(tt->writers_done, 1);
+    return NULL;
+}
+
+static void *read_keys(void *arg) {
+    TestThread *tt = arg;
+    ConcurrentHandle *handle = concurrent_attach(tt->table);
+    union Hashable key;
+    while (atomic_load(tt->writers_done) < WRITERS) {
+        tt->rng ^= tt->rng << 13;
+        tt->rng ^= tt->rng >> 7;
+        tt->rng ^= tt->rng << 17;
+        long int n = (long int)(tt->rng % STABLE_KEYS);
+        key.i = -1 - n;
+        concurrent_read_begin(handle);
+        CHECK(has_value(concurrent_lookup(LONG_MAX, key, INTEGER, handle), 's', n));
+
+        // a writer's key may be there or not, but if it is, its value must be intact
+        key.i = (long int)(tt->rng % (WRITERS * KEYS_PER_WRITER));
+        Item *item = concurrent_lookup(LONG_MAX, key, INTEGER, handle);
+        CHECK((item == NULL) || has_value(item, 'v', key.i) || has_value(item, 'u', key.i));
+        concurrent_read_end(handle);
+    }
+    concurrent_detach(handle);
+    return NULL;
+}
+
+int main(void) {
+    TableOptions options = default_table_options();
+    ConcurrentHashTable *table = concurrent_init(LOCK_STRIPES, 0.75, options);
+    long int initial_size = atomic_load(&table->bins)->size;
+
+    ConcurrentHandle *handle = concurrent_attach(table);
+    union Hashable key;
+    long int n;
+    for (n = 0; n < STABLE_KEYS; n++) {
+        key.i = -1 - n;
+        concurrent_add(LONG_MAX, key, INTEGER, make_string('s', n), STRING, handle);
+    }
+
+    atomic_int writers_done = 0;
+    TestThread threads[WRITERS + READERS];
+    int i;
+    for (i = 0; i < WRITERS + READERS; i++) {
+        threads[i].table = table;
+        threads[i].id = i;
+        threads[i].writers_done = &writers_done;
+        threads[i].rng = 0x9e3779b97f4a7c15UL + (unsigned long int)i;
+        CHECK(pthread_create(&threads[i].thread, NULL, (i < WRITERS) ? write_keys : read_keys, &threads[i]) == 0);
+    }
+    for (i = 0; i < WRITERS + READERS; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    CHECK(atomic_load(&table->bins)->size > initial_size);
+    CHECK(concurrent_load(table) == STABLE_KEYS + WRITERS * KEYS_PER_WRITER / 2);
+    concurrent_read_begin(handle);
+    for (n = 0; n < WRITERS * KEYS_PER_WRITER; n++) {
+        key.i = n;
+        Item *item = concurrent_lookup(LONG_MAX, key, INTEGER, handle);
+        if (n % 2 == 0) {
+            CHECK(item == NULL);
+        }
+        else {
+            CHECK(has_value(item, 'v', n));
+        }
+    }
+    for (n = 0; n < STABLE_KEYS; n++) {
+        key.i = -1 - n;
+        CHECK(has_value(concurrent_lookup(LONG_MAX, key, INTEGER, handle), 's', n));
+    }
+    concurrent_read_end(handle);
+    concurrent_detach(handle);
+    concurrent_free(table);
+
+    printf("test_concurrent: ok\n");
+    return 0;
+}
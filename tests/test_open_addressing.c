@@ -0,0 +1,71 @@
+#include "hashtable.h"
+#include "test.h"
+
+/***
+* Open addressing with max_load_proportion >= 1: the slot array must grow before it fills,
+*   or adding a new key (and looking up a missing one) would probe forever.
+***/
+static void test_add_past_size(void) {
+    TableOptions options = default_table_options();
+    options.storage = OPEN_ADDRESSING;
+    HashTable *hashtable = init_with_options(8, 1.5, options);
+
+    union Hashable key, value;
+    long int i;
+    for (i = 0; i < 100; i++) {
+        key.i = i;
+        value.i = i * i;
+        hashtable = add(LONG_MAX, key, INTEGER, value, INTEGER, hashtable);
+        CHECK(hashtable->load < hashtable->size);
+    }
+    CHECK(hashtable->load == 100);
+    for (i = 0; i < 100; i++) {
+        key.i = i;
+        Item *item = lookup(key, INTEGER, hashtable);
+        CHECK((item != NULL) && (item->value.i == i * i));
+    }
+    key.i = 100;
+    CHECK(lookup(key, INTEGER, hashtable) == NULL);
+
+    // updates of a table with one empty slot left
+    for (i = 0; i < 100; i++) {
+        key.i = i;
+        value.i = -i;
+        hashtable = add(LONG_MAX, key, INTEGER, value, INTEGER, hashtable);
+    }
+    CHECK(hashtable->load == 100);
+    key.i = 99;
+    CHECK(lookup(key, INTEGER, hashtable)->value.i == -99);
+    free_table(hashtable);
+}
+
+static void test_add_many_past_size(void) {
+    TableOptions options = default_table_options();
+    options.storage = OPEN_ADDRESSING;
+    HashTable *hashtable = init_with_options(4, 2.0, options);
+
+    long int count = 50;
+    union Hashable keys[50], values[50];
+    hash_type key_types[50], value_types[50];
+    long int i;
+    for (i = 0; i < count; i++) {
+        keys[i].i = i;
+        values[i].i = i;
+        key_types[i] = INTEGER;
+        value_types[i] = INTEGER;
+    }
+    hashtable = add_many(count, NULL, keys, key_types, values, value_types, hashtable);
+    CHECK(hashtable->load == count);
+    CHECK(hashtable->load < hashtable->size);
+    union Hashable key;
+    key.i = 49;
+    CHECK(lookup(key, INTEGER, hashtable) != NULL);
+    free_table(hashtable);
+}
+
+int main(void) {
+    test_add_past_size();
+    test_add_many_past_size();
+    printf("test_open_addressing: ok\n");
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "sharded_hashtable.h"
+#include "test.h"
+
+/***
+* Sharded hashtable: parallel_build with several threads must end up holding
+*   exactly what a serial add_many of the same pairs does -- including which value
+*   a repeated key keeps (its last), however the pairs are split between threads.
+***/
+
+#define PAIRS 50000
+#define DISTINCT_KEYS 20000
+
+static union Hashable make_string(char prefix, long int n) {
+    union Hashable s;
+    s.str = malloc(32);
+    s.len = (size_t)sprintf(s.str, "%c%ld", prefix, n);
+    return s;
+}
+
+// Fills parallel arrays of PAIRS pairs: each key appears two or three times, with a value of its position
+static void make_pairs(hash_type type, union Hashable *keys, hash_type *key_types,
+                       union Hashable *values, hash_type *value_types) {
+    long int i;
+    for (i = 0; i < PAIRS; i++) {
+        long int k = (i * 7919) % DISTINCT_KEYS; // repeats land far apart in the arrays
+        key_types[i] = type;
+        value_types[i] = type;
+        if (type == STRING) {
+            keys[i] = make_string('k', k);
+            values[i] = make_string('v', i);
+        }
+        else {
+            keys[i].i = k;
+            values[i].i = i;
+        }
+    }
+}
+
+typedef struct totals {
+    atomic_long items;
+    atomic_long value_sum;
+} Totals;
+
+static void count_item(Item *item, void *arg) {
+    Totals *totals = arg;
+    atomic_fetch_add(&totals->items, 1);
+    atomic_fetch_add(&totals->value_sum, (item->value_type == STRING) ? (long int)item->value.len : item->value.i);
+}
+
+static void check_against_serial(hash_type type, int threads, int with_hashes) {
+    union Hashable *keys = malloc(PAIRS*sizeof(union Hashable));
+    union Hashable *values = malloc(PAIRS*sizeof(union Hashable));
+    hash_type *key_types = malloc(PAIRS*sizeof(hash_type));
+    hash_type *value_types = malloc(PAIRS*sizeof(hash_type));
+    long int *hashes = malloc(PAIRS*sizeof(long int));
+
+    TableOptions options = default_table_options();
+    options.seed = 12345;
+    HashTable *serial = init_with_options(8, 0.75, options);
+    make_pairs(type, keys, key_types, values, value_types);
+    serial = add_many(PAIRS, NULL, keys, key_types, values, value_types, serial);
+
+    ShardedHashTable *sharded = sharded_init(8, 0.75, 4, options);
+    make_pairs(type, keys, key_types, values, value_types);
+    long int i;
+    for (i = 0; i < PAIRS; i++) {
+        // some hashes given, the rest left to the table
+        hashes[i] = (i % 3 == 0) ? sharded_hash(keys[i], key_types[i], sharded) : LONG_MAX;
+    }
+    parallel_build(PAIRS, with_hashes ? hashes : NULL, keys, key_types, values, value_types, threads, sharded);
+
+    CHECK(serial->load == DISTINCT_KEYS);
+    CHECK(sharded_load(sharded) == DISTINCT_KEYS);
+
+    Totals serial_totals = {0, 0};
+    for_each_item(serial, count_item, &serial_totals);
+    Totals sharded_totals = {0, 0};
+    parallel_for_each(sharded, count_item, &sharded_totals, threads);
+    CHECK(atomic_load(&sharded_totals.items) == DISTINCT_KEYS);
+    CHECK(atomic_load(&sharded_totals.value_sum) == atomic_load(&serial_totals.value_sum));
+
+    // every key holds the value of its last position in the arrays
+    long int *last = malloc(DISTINCT_KEYS*sizeof(long int));
+    for (i = 0; i < PAIRS; i++) {
+        last[(i * 7919) % DISTINCT_KEYS] = i;
+    }
+    char key_buffer[32];
+    union Hashable key;
+    long int k;
+    for (k = 0; k < DISTINCT_KEYS; k++) {
+        if (type == STRING) {
+            key.str = key_buffer;
+            key.len = (size_t)sprintf(key_buffer, "k%ld", k);
+        }
+        else {
+            key.i = k;
+        }
+        Item *expected = lookup(key, type, serial);
+        Item *found = sharded_lookup(sharded_hash(key, type, sharded), key, type, sharded);
+        CHECK((expected != NULL) && (found != NULL));
+        CHECK(hashable_equal(expected->value, expected->value_type, found->value, found->value_type));
+        if (type == STRING) {
+            char last_value[32];
+            CHECK(found->value.len == (size_t)sprintf(last_value, "v%ld", last[k]));
+            CHECK(memcmp(found->value.str, last_value, found->value.len) == 0);
+        }
+        else {
+            CHECK(found->value.i == last[k]);
+        }
+    }
+    free(last);
+
+    free_table(serial);
+    sharded_free(sharded);
+    free(keys);
+    free(values);
+    free(key_types);
+    free(value_types);
+    free(hashes);
+}
+
+int main(void) {
+    int threads;
+    for (threads = 1; threads <= 4; threads *= 2) {
+        check_against_serial(INTEGER, threads, 0);
+        check_against_serial(STRING, threads, 1);
+    }
+    printf("test_sharded: ok\n");
+    return 0;
+}
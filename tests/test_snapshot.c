@@ -0,0 +1,131 @@
+#include <unistd.h>
+#include "hashtable.h"
+#include "test.h"
+
+/***
+* Snapshots: save a table of every storage kind, look every key up in the mapped
+*   file, then copy it back into a table of every storage kind and compare.
+***/
+
+#define PAIRS 3000
+
+typedef struct lookup_check {
+    Snapshot *snapshot;
+    HashTable *copy;
+    long int checked;
+} LookupCheck;
+
+static void check_in_snapshot(Item *item, void *arg) {
+    LookupCheck *check = arg;
+    Item found;
+    // alternate between the stored hash and letting the snapshot hash the key
+    long int hash = (check->checked++ % 2 == 0) ? item->hash : LONG_MAX;
+    CHECK(snapshot_lookup(hash, item->key, item->key_type, check->snapshot, &found) == 1);
+    CHECK(found.hash == item->hash);
+    CHECK(hashable_equal(found.key, found.key_type, item->key, item->key_type));
+    CHECK(hashable_equal(found.value, found.value_type, item->value, item->value_type));
+}
+
+static void check_in_copy(Item *item, void *arg) {
+    LookupCheck *check = arg;
+    Item *found = lookup_by_hash(item->hash, item->key, item->key_type, check->copy);
+    CHECK(found != NULL);
+    CHECK(hashable_equal(found->value, found->value_type, item->value, item->value_type));
+    check->checked++;
+}
+
+static union Hashable make_string(const char *format, long int n) {
+    union Hashable s;
+    s.str = malloc(32);
+    s.len = (size_t)sprintf(s.str, format, n);
+    return s;
+}
+
+// Integer keys with string values (holding a NUL), string keys with doubles, double keys with integers
+static HashTable *filled_table(storage_type storage) {
+    TableOptions options = default_table_options();
+    options.storage = storage;
+    HashTable *hashtable = init_with_options(8, 0.75, options);
+    union Hashable key, value;
+    long int i;
+    for (i = 0; i < PAIRS; i++) {
+        key.i = i;
+        value = make_string("v%ld", i);
+        value.str[0] = '\0';
+        hashtable = add(LONG_MAX, key, INTEGER, value, STRING, hashtable);
+
+        key = make_string("key-%ld", i);
+        value.f = i / 4.0;
+        hashtable = add(LONG_MAX, key, STRING, value, DOUBLE, hashtable);
+
+        key.f = i + 0.5;
+        value.i = -i;
+        hashtable = add(LONG_MAX, key, DOUBLE, value, INTEGER, hashtable);
+    }
+    // leave some gaps (and Swiss table tombstones) behind
+    for (i = 0; i < PAIRS; i += 3) {
+        key.i = i;
+        CHECK(discard(key, INTEGER, hashtable) == 1);
+    }
+    return hashtable;
+}
+
+static void round_trip(storage_type storage, const char *path) {
+    HashTable *hashtable = filled_table(storage);
+    CHECK(save_snapshot(hashtable, path) == 0);
+
+    Snapshot *snapshot = open_snapshot(path);
+    CHECK(snapshot != NULL);
+    CHECK((long int)snapshot->header->item_count == hashtable->load);
+
+    LookupCheck check = {snapshot, NULL, 0};
+    for_each_item(hashtable, check_in_snapshot, &check);
+    CHECK(check.checked == hashtable->load);
+
+    Item found;
+    union Hashable missing;
+    missing.i = 0; // discarded above
+    CHECK(snapshot_lookup(LONG_MAX, missing, INTEGER, snapshot, &found) == 0);
+    missing.i = PAIRS;
+    CHECK(snapshot_lookup(LONG_MAX, missing, INTEGER, snapshot, &found) == 0);
+    missing.f = 0.25;
+    CHECK(snapshot_lookup(LONG_MAX, missing, DOUBLE, snapshot, &found) == 0);
+
+    int copy_storage;
+    for (copy_storage = CHAINED; copy_storage <= SWISS_TABLE; copy_storage++) {
+        TableOptions options = default_table_options();
+        options.storage = copy_storage;
+        check.copy = snapshot_to_table(snapshot, 0.75, options);
+        CHECK(check.copy->storage == (storage_type)copy_storage);
+        CHECK(check.copy->load == hashtable->load);
+        check.checked = 0;
+        for_each_item(hashtable, check_in_copy, &check);
+        CHECK(check.checked == hashtable->load);
+
+        // the copy owns its strings, so it outlives the mapping and can be changed
+        union Hashable key, value;
+        key.i = 0;
+        value.i = 1;
+        check.copy = add(LONG_MAX, key, INTEGER, value, INTEGER, check.copy);
+        CHECK(lookup(key, INTEGER, check.copy)->value.i == 1);
+        free_table(check.copy);
+    }
+
+    close_snapshot(snapshot);
+    free_table(hashtable);
+}
+
+int main(void) {
+    char path[] = "/tmp/test_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    int storage;
+    for (storage = CHAINED; storage <= SWISS_TABLE; storage++) {
+        round_trip(storage, path);
+    }
+    unlink(path);
+    printf("test_snapshot: ok\n");
+    return 0;
+}
@@ -0,0 +1,16 @@
+#include "typed_hashtable.h"
+
+/***
+* Hashing, comparing and freeing keys of the predefined typed tables
+***/
+#define INT_KEY_HASH(key, seed) hash_integer_mix((unsigned long int)(key), (seed))
+#define INT_KEYS_EQUAL(a, b) ((a) == (b))
+#define INT_KEY_FREE(key)
+
+#define STR_KEY_HASH(key, seed) hash_string_wyhash((key).str, (key).len, (seed))
+#define STR_KEYS_EQUAL(a, b) (((a).len == (b).len) && (memcmp((a).str, (b).str, (a).len) == 0))
+#define STR_KEY_FREE(key) free((key).str)
+
+TYPED_TABLE_DEFINE(IntIntTable, int_int, long int, long int, INT_KEY_HASH, INT_KEYS_EQUAL, INT_KEY_FREE)
+TYPED_TABLE_DEFINE(IntDoubleTable, int_double, long int, double, INT_KEY_HASH, INT_KEYS_EQUAL, INT_KEY_FREE)
+TYPED_TABLE_DEFINE(StrIntTable, str_int, TypedString, long int, STR_KEY_HASH, STR_KEYS_EQUAL, STR_KEY_FREE)
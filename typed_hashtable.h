@@ -0,0 +1,223 @@
+#include "hashtable.h"
+
+/***
+* Typed hashtables
+*   A HashTable stores every pair as an Item: a hash, two tagged unions and two
+*   type tags, with a switch on the tags for every compare. When every key has
+*   one type and every value another (counters, id maps...), a typed table does
+*   without all of that: keys and values sit unboxed in two parallel arrays, with
+*   one byte per slot marking it full, probed linearly.
+*
+*   Each typed table is generated from the macros below -- TYPED_TABLE_DECLARE in a
+*   header, TYPED_TABLE_DEFINE in one .c file -- given its key and value types,
+*   how to hash and compare keys, and how to free a key the table owns.
+*   typed_hashtable.c defines IntIntTable, IntDoubleTable and StrIntTable.
+***/
+
+// Size of a typed table with no size given; sizes are rounded up to a power of two
+#define TYPED_TABLE_MIN_SIZE 8
+
+// String keys for typed tables -- length-counted and NUL-terminated, like Hashable strings
+typedef struct typed_string {
+    char *str;
+    size_t len;
+} TypedString;
+
+/***
+* Declares NAME, a table from KEY_T to VALUE_T, and its functions PREFIX_init, PREFIX_set...
+*   PREFIX_set and PREFIX_increment take ownership of a key that holds memory
+*   (freeing it at once if the table already holds an equal key);
+*   PREFIX_get and PREFIX_remove only borrow it.
+***/
+#define TYPED_TABLE_DECLARE(NAME, PREFIX, KEY_T, VALUE_T)                                   \
+typedef struct {                                                                            \
+    long int size;        /* a power of two */                                              \
+    long int load;                                                                          \
+    double max_load_proportion;                                                             \
+    unsigned long int seed;                                                                 \
+    int shift;            /* 64 - log2(size): a key's home slot is the top bits of its hash */ \
+    unsigned char *full;  /* 1 for slots holding a pair */                                  \
+    KEY_T *keys;                                                                            \
+    VALUE_T *values;                                                                        \
+} NAME;                                                                                     \
+                                                                                            \
+NAME *PREFIX##_init(long int size, double max_load_proportion);                             \
+void PREFIX##_free(NAME *table);                                                            \
+void PREFIX##_reserve(long int count, NAME *table);                                         \
+void PREFIX##_set(KEY_T key, VALUE_T value, NAME *table);                                   \
+VALUE_T PREFIX##_increment(KEY_T key, VALUE_T delta, NAME *table);                          \
+int PREFIX##_get(KEY_T key, VALUE_T *value, NAME *table);                                   \
+int PREFIX##_remove(KEY_T key, VALUE_T *value, NAME *table);
+
+/***
+* Defines the functions TYPED_TABLE_DECLARE declared.
+*   HASH(key, seed) must return an unsigned long int with well-mixed top bits,
+*   EQUAL(a, b) must be nonzero for equal keys, and FREE_KEY(key) frees what a key holds.
+***/
+#define TYPED_TABLE_DEFINE(NAME, PREFIX, KEY_T, VALUE_T, HASH, EQUAL, FREE_KEY)             \
+static long int PREFIX##_home(KEY_T key, NAME *table) {                                     \
+    return (long int)(HASH(key, table->seed) >> table->shift);                              \
+}                                                                                           \
+                                                                                            \
+static void PREFIX##_allocate(long int size, NAME *table) {                                 \
+    table->size = size;                                                                     \
+    table->shift = 64;                                                                      \
+    while ((1L << (64 - table->shift)) < size) {                                            \
+        table->shift--;                                                                     \
+    }                                                                                       \
+    table->full = calloc(size, 1);                                                          \
+    table->keys = malloc(size*sizeof(KEY_T));                                               \
+    table->values = malloc(size*sizeof(VALUE_T));                                           \
+}                                                                                           \
+                                                                                            \
+NAME *PREFIX##_init(long int size, double max_load_proportion) {                            \
+    NAME *table = malloc(sizeof(NAME));                                                     \
+    table->load = 0;                                                                        \
+    table->max_load_proportion = max_load_proportion;                                       \
+    table->seed = random_seed();                                                            \
+    PREFIX##_allocate(round_up_to_power_of_two((size < TYPED_TABLE_MIN_SIZE) ? TYPED_TABLE_MIN_SIZE : size), \
+                      table);                                                               \
+    return table;                                                                           \
+}                                                                                           \
+                                                                                            \
+void PREFIX##_free(NAME *table) {                                                           \
+    long int i;                                                                             \
+    for (i = 0; i < table->size; i++) {                                                     \
+        if (table->full[i]) {                                                               \
+            FREE_KEY(table->keys[i]);                                                       \
+        }                                                                                   \
+    }                                                                                       \
+    free(table->full);                                                                      \
+    free(table->keys);                                                                      \
+    free(table->values);                                                                    \
+    free(table);                                                                            \
+}                                                                                           \
+                                                                                            \
+/* Returns the slot holding key, or -1 - the empty slot where it would go */                \
+static long int PREFIX##_find(KEY_T key, NAME *table) {                                     \
+    long int mask = table->size - 1;                                                        \
+    long int i = PREFIX##_home(key, table);                                                 \
+    while (table->full[i]) {                                                                \
+        if (EQUAL(table->keys[i], key)) {                                                   \
+            return i;                                                                       \
+        }                                                                                   \
+        i = (i + 1) & mask;                                                                 \
+    }                                                                                       \
+    return -1 - i;                                                                          \
+}                                                                                           \
+                                                                                            \
+static void PREFIX##_resize_to(long int size, NAME *table) {                                \
+    long int old_size = table->size;                                                        \
+    unsigned char *old_full = table->full;                                                  \
+    KEY_T *old_keys = table->keys;                                                          \
+    VALUE_T *old_values = table->values;                                                    \
+    PREFIX##_allocate(size, table);                                                         \
+    long int i;                                                                             \
+    for (i = 0; i < old_size; i++) {                                                        \
+        if (old_full[i]) {                                                                  \
+            long int to = -1 - PREFIX##_find(old_keys[i], table);                           \
+            table->full[to] = 1;                                                            \
+            table->keys[to] = old_keys[i];                                                  \
+            table->values[to] = old_values[i];                                              \
+        }                                                                                   \
+    }                                                                                       \
+    free(old_full);                                                                         \
+    free(old_keys);                                                                         \
+    free(old_values);                                                                       \
+}                                                                                           \
+                                                                                            \
+void PREFIX##_reserve(long int count, NAME *table) {                                        \
+    long int size = table->size;                                                            \
+    while ((double)(count + 1) / (double)size > table->max_load_proportion) {               \
+        size *= 2;                                                                          \
+    }                                                                                       \
+    if (size != table->size) {                                                              \
+        PREFIX##_resize_to(size, table);                                                    \
+    }                                                                                       \
+}                                                                                           \
+                                                                                            \
+/* Returns the slot holding key, adding it (with an undefined value) if it isn't there */   \
+static long int PREFIX##_insert(KEY_T key, NAME *table, int *added) {                       \
+    long int i = PREFIX##_find(key, table);                                                 \
+    if (i >= 0) {                                                                           \
+        FREE_KEY(key);                                                                      \
+        *added = 0;                                                                         \
+        return i;                                                                           \
+    }                                                                                       \
+    /* always keep an empty slot, which ends every probe */                                 \
+    if (((double)(table->load + 1) / (double)table->size > table->max_load_proportion) ||   \
+        (table->load + 1 == table->size)) {                                                 \
+        PREFIX##_resize_to(table->size * 2, table);                                         \
+        i = PREFIX##_find(key, table);                                                      \
+    }                                                                                       \
+    i = -1 - i;                                                                             \
+    table->full[i] = 1;                                                                     \
+    table->keys[i] = key;                                                                   \
+    table->load++;                                                                          \
+    *added = 1;                                                                             \
+    return i;                                                                               \
+}                                                                                           \
+                                                                                            \
+void PREFIX##_set(KEY_T key, VALUE_T value, NAME *table) {                                  \
+    int added;                                                                              \
+    long int i = PREFIX##_insert(key, table, &added); /* may reallocate table->values */   \
+    table->values[i] = value;                                                               \
+}                                                                                           \
+                                                                                            \
+/* Adds delta to key's value (which starts at 0), returning the new value */                \
+VALUE_T PREFIX##_increment(KEY_T key, VALUE_T delta, NAME *table) {                         \
+    int added;                                                                              \
+    long int i = PREFIX##_insert(key, table, &added);                                       \
+    table->values[i] = added ? delta : table->values[i] + delta;                            \
+    return table->values[i];                                                                \
+}                                                                                           \
+                                                                                            \
+/* Returns 1 and sets *value (if value isn't NULL) if the table holds key, 0 otherwise */   \
+int PREFIX##_get(KEY_T key, VALUE_T *value, NAME *table) {                                  \
+    long int i = PREFIX##_find(key, table);                                                 \
+    if (i < 0) {                                                                            \
+        return 0;                                                                           \
+    }                                                                                       \
+    if (value != NULL) {                                                                    \
+        *value = table->values[i];                                                          \
+    }                                                                                       \
+    return 1;                                                                               \
+}                                                                                           \
+                                                                                            \
+/* Like get, but also removes the pair -- shifting later keys of the run back into the gap, \
+   so no tombstones are needed */                                                           \
+int PREFIX##_remove(KEY_T key, VALUE_T *value, NAME *table) {                               \
+    long int i = PREFIX##_find(key, table);                                                 \
+    if (i < 0) {                                                                            \
+        return 0;                                                                           \
+    }                                                                                       \
+    if (value != NULL) {                                                                    \
+        *value = table->values[i];                                                          \
+    }                                                                                       \
+    FREE_KEY(table->keys[i]);                                                               \
+    long int mask = table->size - 1;                                                        \
+    long int j = i;                                                                         \
+    while (1) {                                                                             \
+        j = (j + 1) & mask;                                                                 \
+        if (!table->full[j]) {                                                              \
+            break;                                                                          \
+        }                                                                                   \
+        long int home = PREFIX##_home(table->keys[j], table);                               \
+        /* j's key may move back to i only if its home isn't cyclically in (i, j] */        \
+        if (((j - home) & mask) >= ((j - i) & mask)) {                                      \
+            table->keys[i] = table->keys[j];                                                \
+            table->values[i] = table->values[j];                                            \
+            i = j;                                                                          \
+        }                                                                                   \
+    }                                                                                       \
+    table->full[i] = 0;                                                                     \
+    table->load--;                                                                          \
+    return 1;                                                                               \
+}
+
+/***
+* The predefined typed tables (typed_hashtable.c)
+***/
+TYPED_TABLE_DECLARE(IntIntTable, int_int, long int, long int)
+TYPED_TABLE_DECLARE(IntDoubleTable, int_double, long int, double)
+TYPED_TABLE_DECLARE(StrIntTable, str_int, TypedString, long int)